@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include "allocations.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// count the allocations of the whole binary, reported per iteration by the benchmarks;
+// not inlined, otherwise GCC confuses the replaced operators with the built-in ones
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+std::size_t allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_BENCHMARKS_ALLOCATIONS_HPP
+#define SATELLITE_LINK_BENCHMARKS_ALLOCATIONS_HPP
+
+#include <cstddef>
+
+/// @brief Count of heap allocations of the whole binary so far; the benchmarks report the difference
+///        per iteration.
+std::size_t allocation_count();
+
+#endif // SATELLITE_LINK_BENCHMARKS_ALLOCATIONS_HPP
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <satellite_link/batch_reader.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+// a backlog of variables as the agent delivers it after the controller stalled for a while
+std::vector<std::uint8_t> make_batch(std::size_t items) {
+    const auto limits = R"({
+        "uuid": "evse1",
+        "max_current": 16.0,
+        "nr_of_phases_available": 3
+    })"_json;
+
+    json batch{{"errors", json::array()}, {"vars", json::array()}};
+
+    for (std::size_t i = 0; i < items; i++)
+        batch["vars"].push_back({{"seq", i + 1}, {"tag", 3}, {"value", limits}});
+
+    return json::to_msgpack(batch);
+}
+
+// parses the whole batch into a DOM first and then walks over the items
+void dom(benchmark::State& state) {
+    const auto batch = make_batch(state.range(0));
+
+    for (auto _ : state) {
+        std::uint64_t sum{0};
+        json j = json::from_msgpack(batch);
+
+        for (auto& item : j["vars"])
+            sum += item.at("seq").get<std::uint64_t>();
+
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// hands each item over as soon as it is parsed
+void sax(benchmark::State& state) {
+    const auto batch = make_batch(state.range(0));
+
+    for (auto _ : state) {
+        std::uint64_t sum{0};
+        satellite_link::BatchReader reader(
+            [&sum](satellite_link::BatchList, json& item) { sum += item.at("seq").get<std::uint64_t>(); });
+
+        json::sax_parse(batch.begin(), batch.end(), &reader, json::input_format_t::msgpack);
+        benchmark::DoNotOptimize(sum);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+BENCHMARK(dom)->Arg(10)->Arg(1000);
+BENCHMARK(sax)->Arg(10)->Arg(1000);
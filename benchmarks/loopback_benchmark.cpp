@@ -0,0 +1,537 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+//
+// Load test of the satellite link: both sides run in this process and talk over a real TCP loopback
+// connection. The SatelliteAgent and SatelliteController modules cannot be instantiated without a
+// running EVerest, so their transport is driven here through the same satellite_link classes the modules
+// use: the generated variable traits subscribe to and publish on lightweight fakes instead of the
+// generated interface objects, the variables are queued in a VarQueue, delivered with the sequence
+// numbers and acknowledgements of UnackedItems and ReceiveWindow, and serialized, parsed and decoded
+// like in the modules. Commands are served concurrently.
+//
+// Reported are the sustained event rate, the end-to-end latency of the variables, the round trip
+// time of commands and the CPU time per delivered event, for a configurable mix of variables:
+//
+//   satellite_link_loopback --duration-s 10 --session-event-hz 10 --telemetry-hz 100 --powermeter-hz 100
+//                           --command-hz 20 --payload-encoding msgpack --compression none
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <sys/resource.h>
+#include <nlohmann/json.hpp>
+#include <rpc/client.h>
+#include <rpc/server.h>
+#include <satellite_link/batch_reader.hpp>
+#include <satellite_link/codec.hpp>
+#include <satellite_link/compression.hpp>
+#include <satellite_link/delivery.hpp>
+#include <satellite_link/generated/commands.hpp>
+#include <satellite_link/packed_types.hpp>
+#include <satellite_link/payload.hpp>
+#include <satellite_link/trace.hpp>
+#include <satellite_link/var_queue.hpp>
+#include <satellite_link/vars.hpp>
+
+using json = nlohmann::json;
+using satellite_link::AgentVar;
+
+namespace {
+
+using SessionEventVar = satellite_link::var_traits<AgentVar::EvseManagerSessionEvent>;
+using TelemetryVar = satellite_link::var_traits<AgentVar::EvseManagerTelemetry>;
+using PowermeterVar = satellite_link::var_traits<AgentVar::EvseManagerPowermeter>;
+using PauseCharging = satellite_link::commands::evse_manager::pause_charging;
+
+constexpr std::size_t VAR_COUNT{satellite_link::agent_var_infos.size()};
+
+/// @brief Returns the time of the monotonic clock in microseconds; both sides share it here.
+std::int64_t steady_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct Options {
+    int duration_s{10};
+    double session_event_hz{10.0};
+    double telemetry_hz{100.0};
+    double powermeter_hz{100.0};
+    double command_hz{20.0};
+    int long_poll_timeout_ms{1000};
+    int bulk_batching_window_ms{250};
+    int port{41290};
+    int rpc_worker_threads{4};
+    bool packed_vars{true};
+    satellite_link::PayloadEncoding payload_encoding{satellite_link::PayloadEncoding::MsgPack};
+    satellite_link::Compression compression{satellite_link::Compression::None};
+    int compression_threshold_bytes{512};
+};
+
+/// @brief Stands in for the evse_manager requirement of the SatelliteAgent: the generated traits subscribe
+///        to it, and the load generators publish on it.
+struct FakeEvseManagerRequirement {
+    std::function<void(SessionEventVar::type)> session_event;
+    std::function<void(TelemetryVar::type)> telemetry;
+    std::function<void(PowermeterVar::type)> powermeter;
+
+    template <typename F> void subscribe_session_event(F callback) {
+        this->session_event = std::move(callback);
+    }
+
+    template <typename F> void subscribe_telemetry(F callback) {
+        this->telemetry = std::move(callback);
+    }
+
+    template <typename F> void subscribe_powermeter(F callback) {
+        this->powermeter = std::move(callback);
+    }
+};
+
+struct FakeAgentModule {
+    std::unique_ptr<FakeEvseManagerRequirement> r_evse_manager{std::make_unique<FakeEvseManagerRequirement>()};
+};
+
+/// @brief Stands in for the evse_manager implementation of the SatelliteController: the generated traits
+///        publish on it, it just counts.
+struct FakeEvseManagerProvider {
+    std::atomic<std::uint64_t> published{0};
+
+    void publish_session_event(const SessionEventVar::type&) {
+        this->published++;
+    }
+
+    void publish_telemetry(const TelemetryVar::type&) {
+        this->published++;
+    }
+
+    void publish_powermeter(const PowermeterVar::type&) {
+        this->published++;
+    }
+};
+
+struct FakeControllerModule {
+    std::unique_ptr<FakeEvseManagerProvider> p_evse_manager{std::make_unique<FakeEvseManagerProvider>()};
+};
+
+/// @brief Samples of a latency in microseconds, evaluated at the end.
+class Samples {
+public:
+    void add(std::int64_t us) {
+        std::scoped_lock lock(this->guard);
+        this->values.push_back(us);
+    }
+
+    /// @brief Prints count, p50, p99 and max in milliseconds.
+    void print(const char* name) {
+        std::scoped_lock lock(this->guard);
+
+        if (this->values.empty()) {
+            std::printf("  %-28s %10s\n", name, "-");
+            return;
+        }
+
+        std::sort(this->values.begin(), this->values.end());
+        const auto at = [this](double q) {
+            return this->values[static_cast<std::size_t>(q * (this->values.size() - 1))] / 1000.0;
+        };
+
+        std::printf("  %-28s %10zu %10.3f %10.3f %10.3f\n", name, this->values.size(), at(0.5), at(0.99),
+                    this->values.back() / 1000.0);
+    }
+
+private:
+    std::mutex guard;
+    std::vector<std::int64_t> values;
+};
+
+/// @brief The SatelliteAgent's side: queues the published variables and serves "retrieve_vars_and_errors"
+///        and commands.
+class LoopbackAgent {
+public:
+    explicit LoopbackAgent(const Options& options) : options(options), server(options.port) {
+        SessionEventVar::subscribe(this->module, [this](SessionEventVar::type value) {
+            this->publish(AgentVar::EvseManagerSessionEvent, std::move(value));
+        });
+        TelemetryVar::subscribe(this->module, [this](TelemetryVar::type value) {
+            this->publish(AgentVar::EvseManagerTelemetry, std::move(value));
+        });
+        PowermeterVar::subscribe(this->module, [this](PowermeterVar::type value) {
+            this->publish(AgentVar::EvseManagerPowermeter, std::move(value));
+        });
+
+        this->server.bind("retrieve_vars_and_errors", [this](int& max_wait_ms, std::uint64_t& ack) {
+            return this->retrieve(max_wait_ms, ack);
+        });
+
+        this->server.bind(PauseCharging::name, [this](satellite_link::TraceContext&) {
+            return satellite_link::Codec<bool>::encode(true, this->options.payload_encoding);
+        });
+
+        // like the module: command workers plus the reserved ones for the event drain and control calls
+        this->server.async_run(options.rpc_worker_threads + 2);
+    }
+
+    ~LoopbackAgent() {
+        this->stop();
+        this->server.stop();
+    }
+
+    /// @brief Releases a pending long-poll, so that the controller can shut down.
+    void stop() {
+        this->stopped = true;
+        this->queue.wake();
+    }
+
+    FakeEvseManagerRequirement& evse_manager() {
+        return *this->module.r_evse_manager;
+    }
+
+    std::atomic<std::uint64_t> events_published{0};
+    std::atomic<std::uint64_t> events_dropped{0};
+    std::atomic<std::uint64_t> sent_bytes{0};
+
+private:
+    template <typename T> void publish(AgentVar var, T value) {
+        this->events_published++;
+
+        if (not this->queue.push(var, std::move(value)))
+            this->events_dropped++;
+    }
+
+    satellite_link::Payload retrieve(int max_wait_ms, std::uint64_t ack) {
+        std::unique_lock<std::mutex> lock(this->guard);
+
+        if (not this->unacked.acknowledge(ack) and max_wait_ms > 0) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(max_wait_ms);
+            const auto bulk_window = std::chrono::milliseconds(this->options.bulk_batching_window_ms);
+
+            this->queue.wait(lock, deadline, bulk_window, [this]() { return this->stopped.load(); });
+        }
+
+        for (auto& event : this->queue.drain()) {
+            json value;
+
+            std::visit([this, &value](const auto& v) {
+                value = satellite_link::to_forwarded_value(v, this->options.packed_vars);
+            }, event.value);
+
+            auto item = satellite_link::make_var_item(this->unacked.next_seq(), event.var, event.published);
+            item["value"] = std::move(value);
+            this->unacked.add_var(std::move(item));
+        }
+
+        auto rv = satellite_link::encode(this->unacked.batch(), this->options.payload_encoding);
+        satellite_link::compress(rv, this->options.compression, this->options.compression_threshold_bytes);
+        this->sent_bytes += rv.data.size();
+
+        return rv;
+    }
+
+    const Options& options;
+    FakeAgentModule module;
+    rpc::server server;
+
+    std::mutex guard;
+    satellite_link::VarQueue queue{this->guard};
+    std::atomic_bool stopped{false};
+    satellite_link::UnackedItems unacked;
+};
+
+/// @brief The SatelliteController's side: fetches the variables with long-polls, decodes them and publishes
+///        them on the fakes, and sends commands.
+class LoopbackController {
+public:
+    explicit LoopbackController(const Options& options) :
+        options(options), client("127.0.0.1", static_cast<std::uint16_t>(options.port)) {
+    }
+
+    /// @brief Fetches and dispatches variables until 'stop' is set.
+    void run_poll(const std::atomic_bool& stop) {
+        satellite_link::ReceiveWindow window;
+
+        while (not stop) {
+            auto response =
+                this->client.async_call("retrieve_vars_and_errors", this->options.long_poll_timeout_ms, window.ack())
+                    .get();
+            window.start_batch();
+
+            // there is no dispatch queue here, so the items are published right away
+            satellite_link::BatchReader reader([&](satellite_link::BatchList list, json& item) {
+                if (window.receive(item.at("seq").get<std::uint64_t>()) and list == satellite_link::BatchList::Vars)
+                    this->dispatch(item);
+            });
+
+            satellite_link::decode(response.get(), reader);
+            this->received_bytes += satellite_link::wire_size(response.get());
+        }
+    }
+
+    /// @brief Sends commands at the given rate until 'stop' is set, and records their round trip time.
+    void run_commands(const std::atomic_bool& stop, double hz) {
+        const auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / hz));
+        auto next = std::chrono::steady_clock::now();
+
+        while (not stop) {
+            const auto start = std::chrono::steady_clock::now();
+            auto result = this->client.async_call(PauseCharging::name, satellite_link::TraceContext{}).get();
+
+            if (satellite_link::Codec<bool>::decode(result.get()))
+                this->command_rtt.add(std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::steady_clock::now() - start)
+                                          .count());
+
+            next += interval;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    FakeEvseManagerProvider& evse_manager() {
+        return *this->module.p_evse_manager;
+    }
+
+    std::array<Samples, VAR_COUNT> latency;
+    Samples command_rtt;
+    std::atomic<std::uint64_t> received_bytes{0};
+
+private:
+    void dispatch(json& item) {
+        const auto var = satellite_link::agent_var_from_tag(item.at("tag").get<std::uint64_t>());
+
+        if (not var.has_value())
+            return;
+
+        satellite_link::visit_var(var.value(), [&](auto id) {
+            using Var = satellite_link::var_traits<decltype(id)::value>;
+
+            if constexpr (id == AgentVar::EvseManagerSessionEvent or id == AgentVar::EvseManagerTelemetry or
+                          id == AgentVar::EvseManagerPowermeter)
+                Var::publish(this->module, satellite_link::from_forwarded_value<typename Var::type>(item["value"]));
+        });
+
+        this->latency[static_cast<std::size_t>(var.value())].add(steady_time_us() - item.at("ts").get<std::int64_t>());
+    }
+
+    const Options& options;
+    FakeControllerModule module;
+    rpc::client client;
+};
+
+/// @brief Calls the given function at the given rate until 'stop' is set.
+void run_generator(const std::atomic_bool& stop, double hz, const std::function<void(std::uint64_t)>& publish) {
+    const auto interval =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / hz));
+    auto next = std::chrono::steady_clock::now();
+
+    for (std::uint64_t n = 0; not stop; n++) {
+        publish(n);
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+double cpu_time_s() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+           usage.ru_stime.tv_usec / 1e6;
+}
+
+void usage(const char* argv0) {
+    std::printf("usage: %s [options]\n"
+                "  --duration-s N             measurement time (default 10)\n"
+                "  --session-event-hz R       rate of session events (default 10, 0 to disable)\n"
+                "  --telemetry-hz R           rate of telemetry updates (default 100, 0 to disable)\n"
+                "  --powermeter-hz R          rate of powermeter updates (default 100, 0 to disable)\n"
+                "  --command-hz R             rate of commands (default 20, 0 to disable)\n"
+                "  --long-poll-timeout-ms N   long-poll timeout of the controller (default 1000)\n"
+                "  --bulk-window-ms N         batching window of bulk variables (default 250)\n"
+                "  --payload-encoding E       json or msgpack (default msgpack)\n"
+                "  --packed-vars 0|1          forward variables in their packed layout (default 1)\n"
+                "  --compression C            none, lz4 or zstd (default none)\n"
+                "  --compression-threshold N  minimum batch size to compress (default 512)\n"
+                "  --rpc-worker-threads N     command workers of the agent (default 4)\n"
+                "  --port N                   loopback port (default 41290)\n",
+                argv0);
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string name = argv[i];
+
+        if (name == "--help" or name == "-h") {
+            usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        }
+
+        if (i + 1 >= argc)
+            throw std::invalid_argument("missing value of " + name);
+        const std::string value = argv[++i];
+
+        if (name == "--duration-s")
+            options.duration_s = std::stoi(value);
+        else if (name == "--session-event-hz")
+            options.session_event_hz = std::stod(value);
+        else if (name == "--telemetry-hz")
+            options.telemetry_hz = std::stod(value);
+        else if (name == "--powermeter-hz")
+            options.powermeter_hz = std::stod(value);
+        else if (name == "--command-hz")
+            options.command_hz = std::stod(value);
+        else if (name == "--long-poll-timeout-ms")
+            options.long_poll_timeout_ms = std::stoi(value);
+        else if (name == "--bulk-window-ms")
+            options.bulk_batching_window_ms = std::stoi(value);
+        else if (name == "--payload-encoding")
+            options.payload_encoding = satellite_link::string_to_payload_encoding(value);
+        else if (name == "--packed-vars")
+            options.packed_vars = value != "0";
+        else if (name == "--compression")
+            options.compression = satellite_link::string_to_compression(value);
+        else if (name == "--compression-threshold")
+            options.compression_threshold_bytes = std::stoi(value);
+        else if (name == "--rpc-worker-threads")
+            options.rpc_worker_threads = std::stoi(value);
+        else if (name == "--port")
+            options.port = std::stoi(value);
+        else
+            throw std::invalid_argument("unknown option " + name);
+    }
+
+    if (not satellite_link::compression_supported(options.compression))
+        throw std::invalid_argument("compression not supported by this build");
+
+    return options;
+}
+
+// typical values as published by an EvseManager during an AC charging session
+
+SessionEventVar::type make_session_event(std::uint64_t n) {
+    return json{{"uuid", "evse1"},
+                {"timestamp", "2026-02-11T14:03:27.412Z"},
+                {"event", n % 2 == 0 ? "ChargingPausedEV" : "ChargingResumed"}}
+        .get<SessionEventVar::type>();
+}
+
+TelemetryVar::type make_telemetry(std::uint64_t n) {
+    return json{{"evse_temperature_C", 31.5 + (n % 10) * 0.1},
+                {"fan_rpm", 0.0},
+                {"supply_voltage_12V", 12.07},
+                {"supply_voltage_minus_12V", -11.94},
+                {"relais_on", true}}
+        .get<TelemetryVar::type>();
+}
+
+PowermeterVar::type make_powermeter(std::uint64_t n) {
+    const double energy = 1523874.0 + n * 0.5;
+
+    return json{{"timestamp", "2026-02-11T14:03:27.412Z"},
+                {"meter_id", "SDM72DM-0001"},
+                {"energy_Wh_import", {{"total", energy}, {"L1", energy / 3}, {"L2", energy / 3}, {"L3", energy / 3}}},
+                {"energy_Wh_export", {{"total", 0.0}}},
+                {"power_W", {{"total", 10872.4}, {"L1", 3620.1}, {"L2", 3631.5}, {"L3", 3620.8}}},
+                {"voltage_V", {{"L1", 230.4}, {"L2", 231.1}, {"L3", 229.8}}},
+                {"current_A", {{"L1", 15.71}, {"L2", 15.72}, {"L3", 15.76}, {"N", 0.08}}},
+                {"frequency_Hz", {{"L1", 50.01}}}}
+        .get<PowermeterVar::type>();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    LoopbackAgent agent(options);
+    LoopbackController controller(options);
+
+    std::atomic_bool stop_load{false};
+    std::atomic_bool stop_poll{false};
+    std::vector<std::thread> threads;
+
+    const double cpu_start = cpu_time_s();
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread poll([&]() { controller.run_poll(stop_poll); });
+
+    auto& evse_manager = agent.evse_manager();
+    const std::vector<std::pair<double, std::function<void(std::uint64_t)>>> generators{
+        {options.session_event_hz, [&](std::uint64_t n) { evse_manager.session_event(make_session_event(n)); }},
+        {options.telemetry_hz, [&](std::uint64_t n) { evse_manager.telemetry(make_telemetry(n)); }},
+        {options.powermeter_hz, [&](std::uint64_t n) { evse_manager.powermeter(make_powermeter(n)); }},
+    };
+
+    for (const auto& generator : generators) {
+        if (generator.first > 0)
+            threads.emplace_back([&stop_load, &generator]() {
+                run_generator(stop_load, generator.first, generator.second);
+            });
+    }
+
+    if (options.command_hz > 0)
+        threads.emplace_back([&]() { controller.run_commands(stop_load, options.command_hz); });
+
+    std::this_thread::sleep_for(std::chrono::seconds(options.duration_s));
+    stop_load = true;
+
+    for (auto& thread : threads)
+        thread.join();
+
+    // let the controller pick up what is still queued, then release its last long-poll
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stop_poll = true;
+    agent.stop();
+    poll.join();
+
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double cpu_s = cpu_time_s() - cpu_start;
+    const std::uint64_t published = agent.events_published;
+    const std::uint64_t delivered = controller.evse_manager().published;
+
+    std::printf("satellite link loopback: %s%s, compression %s, %.1f s\n",
+                satellite_link::payload_encoding_to_string(options.payload_encoding).c_str(),
+                options.packed_vars ? " (packed)" : "",
+                satellite_link::compression_to_string(options.compression).c_str(), elapsed_s);
+    std::printf("  events published            %10llu %10.1f/s\n", static_cast<unsigned long long>(published),
+                published / elapsed_s);
+    std::printf("  events delivered            %10llu %10.1f/s (states coalesce, %llu dropped)\n",
+                static_cast<unsigned long long>(delivered), delivered / elapsed_s,
+                static_cast<unsigned long long>(agent.events_dropped.load()));
+    std::printf("  bytes on the wire           %10llu %10.1f/event\n",
+                static_cast<unsigned long long>(controller.received_bytes.load()),
+                delivered > 0 ? static_cast<double>(controller.received_bytes) / delivered : 0.0);
+    std::printf("  CPU time (both sides)       %10.3f s %8.1f us/event\n", cpu_s,
+                delivered > 0 ? cpu_s * 1e6 / delivered : 0.0);
+    std::printf("\n  %-28s %10s %10s %10s %10s\n", "latency [ms]", "count", "p50", "p99", "max");
+
+    controller.latency[static_cast<std::size_t>(AgentVar::EvseManagerSessionEvent)].print("evse_manager/session_event");
+    controller.latency[static_cast<std::size_t>(AgentVar::EvseManagerTelemetry)].print("evse_manager/telemetry");
+    controller.latency[static_cast<std::size_t>(AgentVar::EvseManagerPowermeter)].print("evse_manager/powermeter");
+    controller.command_rtt.print("command round trip");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <satellite_link/packed_types.hpp>
+#include "allocations.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// typical values as published by an EvseManager during an AC charging session
+
+const auto telemetry = R"({
+    "evse_temperature_C": 31.5,
+    "fan_rpm": 0.0,
+    "supply_voltage_12V": 12.07,
+    "supply_voltage_minus_12V": -11.94,
+    "relais_on": true
+})"_json.get<types::evse_board_support::Telemetry>();
+
+const auto powermeter = R"({
+    "timestamp": "2026-02-11T14:03:27.412Z",
+    "meter_id": "SDM72DM-0001",
+    "energy_Wh_import": {"total": 1523874.0, "L1": 508112.0, "L2": 507903.0, "L3": 507859.0},
+    "energy_Wh_export": {"total": 0.0},
+    "power_W": {"total": 10872.4, "L1": 3620.1, "L2": 3631.5, "L3": 3620.8},
+    "voltage_V": {"L1": 230.4, "L2": 231.1, "L3": 229.8},
+    "current_A": {"L1": 15.71, "L2": 15.72, "L3": 15.76, "N": 0.08},
+    "frequency_Hz": {"L1": 50.01}
+})"_json.get<types::powermeter::Powermeter>();
+
+// converts the value as the SatelliteAgent does when draining its event list, and serializes
+// it as part of the MessagePack encoded response
+template <typename T> void encode(benchmark::State& state, const T& value, bool packed) {
+    std::vector<std::uint8_t> buffer;
+    const auto allocations_before = allocation_count();
+
+    for (auto _ : state) {
+        buffer.clear();
+        json::to_msgpack(satellite_link::to_forwarded_value(value, packed), buffer);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.counters["bytes"] = static_cast<double>(buffer.size());
+    state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocation_count() - allocations_before),
+                                                  benchmark::Counter::kAvgIterations);
+}
+
+// parses the response and converts the value back as the SatelliteController does before publishing
+template <typename T> void decode(benchmark::State& state, const T& value, bool packed) {
+    const auto buffer = json::to_msgpack(satellite_link::to_forwarded_value(value, packed));
+    const auto allocations_before = allocation_count();
+
+    for (auto _ : state) {
+        T decoded = satellite_link::from_forwarded_value<T>(json::from_msgpack(buffer));
+        benchmark::DoNotOptimize(decoded);
+    }
+
+    state.counters["bytes"] = static_cast<double>(buffer.size());
+    state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocation_count() - allocations_before),
+                                                  benchmark::Counter::kAvgIterations);
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(encode, telemetry_json, telemetry, false);
+BENCHMARK_CAPTURE(encode, telemetry_packed, telemetry, true);
+BENCHMARK_CAPTURE(decode, telemetry_json, telemetry, false);
+BENCHMARK_CAPTURE(decode, telemetry_packed, telemetry, true);
+
+BENCHMARK_CAPTURE(encode, powermeter_json, powermeter, false);
+BENCHMARK_CAPTURE(encode, powermeter_packed, powermeter, true);
+BENCHMARK_CAPTURE(decode, powermeter_json, powermeter, false);
+BENCHMARK_CAPTURE(decode, powermeter_packed, powermeter, true);
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <cstddef>
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <rpc/msgpack.hpp>
+#include <satellite_link/payload.hpp>
+
+using json = nlohmann::json;
+using satellite_link::PayloadEncoding;
+
+namespace {
+
+// typical values as published by an EvseManager during an AC charging session
+
+const json telemetry = R"({
+    "evse_temperature_C": 31.5,
+    "fan_rpm": 0.0,
+    "supply_voltage_12V": 12.07,
+    "supply_voltage_minus_12V": -11.94,
+    "relais_on": true
+})"_json;
+
+const json powermeter = R"({
+    "timestamp": "2026-02-11T14:03:27.412Z",
+    "meter_id": "SDM72DM-0001",
+    "energy_Wh_import": {"total": 1523874.0, "L1": 508112.0, "L2": 507903.0, "L3": 507859.0},
+    "energy_Wh_export": {"total": 0.0},
+    "power_W": {"total": 10872.4, "L1": 3620.1, "L2": 3631.5, "L3": 3620.8},
+    "voltage_V": {"L1": 230.4, "L2": 231.1, "L3": 229.8},
+    "current_A": {"L1": 15.71, "L2": 15.72, "L3": 15.76, "N": 0.08},
+    "frequency_Hz": {"L1": 50.01}
+})"_json;
+
+const json session_event = R"({
+    "uuid": "6f1c1b0e-3d7a-4c55-9a53-2f0d8a1e9b42",
+    "timestamp": "2026-02-11T14:03:27.415Z",
+    "connector_id": 1,
+    "event": "TransactionStarted",
+    "transaction_started": {
+        "meter_value": {
+            "timestamp": "2026-02-11T14:03:27.412Z",
+            "meter_id": "SDM72DM-0001",
+            "energy_Wh_import": {"total": 1523874.0, "L1": 508112.0, "L2": 507903.0, "L3": 507859.0},
+            "power_W": {"total": 0.0}
+        },
+        "id_tag": {
+            "request_id": 1,
+            "id_token": {"value": "04A2B3C4D5E680", "type": "ISO14443"},
+            "authorization_type": "RFID",
+            "connectors": [1]
+        }
+    }
+})"_json;
+
+// encodes the value and packs it as rpclib would do for an RPC argument
+void encode(benchmark::State& state, const json& value, PayloadEncoding encoding) {
+    std::size_t bytes{0};
+
+    for (auto _ : state) {
+        RPCLIB_MSGPACK::sbuffer buffer;
+        RPCLIB_MSGPACK::pack(buffer, satellite_link::encode(value, encoding));
+        bytes = buffer.size();
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.counters["bytes"] = static_cast<double>(bytes);
+}
+
+// unpacks an RPC argument as rpclib would do and decodes the value
+void decode(benchmark::State& state, const json& value, PayloadEncoding encoding) {
+    RPCLIB_MSGPACK::sbuffer buffer;
+    RPCLIB_MSGPACK::pack(buffer, satellite_link::encode(value, encoding));
+
+    for (auto _ : state) {
+        auto handle = RPCLIB_MSGPACK::unpack(buffer.data(), buffer.size());
+        json decoded = satellite_link::decode(handle.get());
+        benchmark::DoNotOptimize(decoded);
+    }
+
+    state.counters["bytes"] = static_cast<double>(buffer.size());
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(encode, telemetry_json, telemetry, PayloadEncoding::Json);
+BENCHMARK_CAPTURE(encode, telemetry_msgpack, telemetry, PayloadEncoding::MsgPack);
+BENCHMARK_CAPTURE(decode, telemetry_json, telemetry, PayloadEncoding::Json);
+BENCHMARK_CAPTURE(decode, telemetry_msgpack, telemetry, PayloadEncoding::MsgPack);
+
+BENCHMARK_CAPTURE(encode, powermeter_json, powermeter, PayloadEncoding::Json);
+BENCHMARK_CAPTURE(encode, powermeter_msgpack, powermeter, PayloadEncoding::MsgPack);
+BENCHMARK_CAPTURE(decode, powermeter_json, powermeter, PayloadEncoding::Json);
+BENCHMARK_CAPTURE(decode, powermeter_msgpack, powermeter, PayloadEncoding::MsgPack);
+
+BENCHMARK_CAPTURE(encode, session_event_json, session_event, PayloadEncoding::Json);
+BENCHMARK_CAPTURE(encode, session_event_msgpack, session_event, PayloadEncoding::MsgPack);
+BENCHMARK_CAPTURE(decode, session_event_json, session_event, PayloadEncoding::Json);
+BENCHMARK_CAPTURE(decode, session_event_msgpack, session_event, PayloadEncoding::MsgPack);
+
+BENCHMARK_MAIN();
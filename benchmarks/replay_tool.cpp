@@ -0,0 +1,502 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+//
+// Replays a traffic recording of the satellite link (see 'traffic_record_file' of both modules) to drive
+// one side of the link again, at the original speed (or a multiple of it) or as fast as possible:
+//
+// - '--drive agent': takes the part of the SatelliteController, connects to a SatelliteAgent and issues
+//   the recorded calls and notifications; reports the latency of the calls per method.
+// - '--drive controller': takes the part of the SatelliteAgent, waits for a SatelliteController and
+//   answers its calls with the recorded results, in the recorded order per method; reports how fast the
+//   controller took the recorded variables and errors.
+//
+// The recording of either module can be used for both. The summary can be written as JSON ('--report'),
+// so that the results of two versions can be compared.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <rpc/client.h>
+#include <rpc/rpc_error.h>
+#include <rpc/server.h>
+#include <rpc/this_handler.h>
+#include <satellite_link/batch_reader.hpp>
+#include <satellite_link/payload.hpp>
+#include <satellite_link/recorder.hpp>
+
+using json = nlohmann::json;
+using satellite_link::Record;
+using satellite_link::RecordType;
+
+namespace {
+
+/// @brief Upper limit for the count of arguments of a replayed call; the calls of the link take at most
+///        a sequence number, a trace context and the arguments of a command.
+constexpr std::size_t MAX_ARGS{8};
+
+/// @brief Name of the call which delivers the variables and errors.
+const std::string RETRIEVE{"retrieve_vars_and_errors"};
+
+struct Options {
+    std::string recording;
+    std::string drive;
+    std::string host{"127.0.0.1"};
+    int port{4129};
+    /// @brief Factor on the original speed, 0 for as fast as possible.
+    double speed{1.0};
+    /// @brief Count of calls issued concurrently when driving an agent.
+    int threads{16};
+    std::string report;
+};
+
+/// @brief A recorded call with its outcome, if one was recorded.
+struct RecordedCall {
+    const Record* call{nullptr};
+    /// @brief The result or error record, or null if none was recorded (notifications, lost results).
+    const Record* outcome{nullptr};
+};
+
+/// @brief Reads the given recording; returns all records, and the calls in their recorded order.
+std::pair<std::deque<Record>, std::vector<RecordedCall>> read_recording(const std::string& path) {
+    satellite_link::RecordingReader reader(path);
+    std::deque<Record> records;
+    std::vector<RecordedCall> calls;
+    std::map<std::uint64_t, std::size_t> call_index;
+
+    while (auto record = reader.next()) {
+        records.push_back(std::move(record.value()));
+        const Record& r = records.back();
+
+        switch (r.type) {
+        case RecordType::Header:
+            std::printf("recording of %s\n", r.method.c_str());
+            break;
+        case RecordType::Call:
+        case RecordType::Notification:
+            call_index[r.id] = calls.size();
+            calls.push_back({&r, nullptr});
+            break;
+        case RecordType::Result:
+        case RecordType::Error:
+            if (const auto it = call_index.find(r.id); it != call_index.end())
+                calls[it->second].outcome = &r;
+            break;
+        }
+    }
+
+    return {std::move(records), std::move(calls)};
+}
+
+/// @brief Latencies of the calls of one method in microseconds.
+struct MethodStats {
+    std::vector<std::int64_t> latency_us;
+    std::uint64_t errors{0};
+
+    json summary() {
+        json rv{{"count", this->latency_us.size() + this->errors}, {"errors", this->errors}};
+
+        if (not this->latency_us.empty()) {
+            std::sort(this->latency_us.begin(), this->latency_us.end());
+            const auto at = [this](double q) {
+                return this->latency_us[static_cast<std::size_t>(q * (this->latency_us.size() - 1))] / 1000.0;
+            };
+            rv["p50_ms"] = at(0.5);
+            rv["p99_ms"] = at(0.99);
+            rv["max_ms"] = this->latency_us.back() / 1000.0;
+        }
+
+        return rv;
+    }
+};
+
+template <typename F, std::size_t... I>
+auto apply_args(const RPCLIB_MSGPACK::object& args, F& f, std::index_sequence<I...>) {
+    return f(args.via.array.ptr[I]...);
+}
+
+/// @brief Calls 'f' with the elements of the given msgpack array as separate arguments.
+template <std::size_t N = 0, typename F> auto apply_args(const RPCLIB_MSGPACK::object& args, F&& f) {
+    if constexpr (N == MAX_ARGS) {
+        if (args.via.array.size != N)
+            throw std::runtime_error("too many arguments");
+        return apply_args(args, f, std::make_index_sequence<N>{});
+    } else {
+        if (args.via.array.size == N)
+            return apply_args(args, f, std::make_index_sequence<N>{});
+
+        return apply_args<N + 1>(args, std::forward<F>(f));
+    }
+}
+
+/// @brief Takes the part of the SatelliteController: issues the recorded calls to a SatelliteAgent.
+json drive_agent(const Options& options, const std::vector<RecordedCall>& calls) {
+    rpc::client client(options.host, static_cast<std::uint16_t>(options.port));
+    std::map<std::string, MethodStats> stats;
+    std::mutex stats_guard;
+
+    // the calls are executed by a pool of workers, so that e.g. a parked long-poll does not hold back
+    // the calls recorded after it
+    std::deque<const Record*> pending;
+    std::mutex pending_guard;
+    std::condition_variable cv_pending;
+    bool done{false};
+
+    const auto worker = [&]() {
+        for (;;) {
+            std::unique_lock<std::mutex> lock(pending_guard);
+            cv_pending.wait(lock, [&]() { return done or not pending.empty(); });
+            if (pending.empty())
+                return;
+
+            const Record* call = pending.front();
+            pending.pop_front();
+            lock.unlock();
+
+            const auto start = std::chrono::steady_clock::now();
+            bool failed{false};
+
+            try {
+                apply_args(call->body(), [&](const auto&... args) {
+                    return client.async_call(call->method, args...);
+                }).get();
+            } catch (const std::exception&) {
+                failed = true;
+            }
+
+            const auto latency =
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+            std::scoped_lock stats_lock(stats_guard);
+            auto& method = stats[call->method];
+            if (failed)
+                method.errors++;
+            else
+                method.latency_us.push_back(latency.count());
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.threads; i++)
+        workers.emplace_back(worker);
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::int64_t origin_us = calls.empty() ? 0 : calls.front().call->time_us;
+
+    for (const auto& recorded : calls) {
+        const Record* call = recorded.call;
+
+        if (options.speed > 0) {
+            const auto offset = std::chrono::microseconds(
+                static_cast<std::int64_t>((call->time_us - origin_us) / options.speed));
+            std::this_thread::sleep_until(start + offset);
+        }
+
+        if (call->type == RecordType::Notification) {
+            apply_args(call->body(), [&](const auto&... args) { client.send(call->method, args...); });
+
+            std::scoped_lock stats_lock(stats_guard);
+            stats[call->method].latency_us.push_back(0);
+            continue;
+        }
+
+        {
+            std::scoped_lock lock(pending_guard);
+            pending.push_back(call);
+        }
+        cv_pending.notify_one();
+    }
+
+    {
+        std::scoped_lock lock(pending_guard);
+        done = true;
+    }
+    cv_pending.notify_all();
+
+    for (auto& thread : workers)
+        thread.join();
+
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    json report{{"drive", "agent"}, {"elapsed_s", elapsed_s}, {"calls", calls.size()},
+                {"calls_per_s", calls.size() / elapsed_s}, {"methods", json::object()}};
+
+    for (auto& [name, method] : stats)
+        report["methods"][name] = method.summary();
+
+    return report;
+}
+
+/// @brief Takes the part of the SatelliteAgent: answers the calls of a SatelliteController with the
+///        recorded results.
+class ControllerDriver {
+public:
+    ControllerDriver(const Options& options, const std::vector<RecordedCall>& calls) :
+        options(options), server(static_cast<std::uint16_t>(options.port)) {
+        std::map<std::string, std::uint32_t> arity;
+
+        for (const auto& recorded : calls) {
+            const auto& name = recorded.call->method;
+            arity.emplace(name, recorded.call->body().via.array.size);
+
+            // notifications have no outcome, their functions just take them
+            if (recorded.call->type == RecordType::Call)
+                this->outcomes[name].push_back(recorded);
+
+            if (name == RETRIEVE and recorded.outcome != nullptr and recorded.outcome->type == RecordType::Result) {
+                this->count_items(recorded.outcome->body());
+                this->remaining_batches++;
+            }
+        }
+
+        if (this->remaining_batches == 0)
+            throw std::runtime_error("the recording does not contain any results of " + RETRIEVE);
+
+        this->origin_us = calls.front().call->time_us;
+
+        for (const auto& [name, n] : arity) {
+            if (n > MAX_ARGS)
+                throw std::runtime_error("too many arguments of " + name);
+            this->bind(name, n);
+        }
+    }
+
+    json run() {
+        this->server.async_run(static_cast<std::size_t>(this->options.threads));
+        std::printf("waiting for a SatelliteController on port %d, %zu batches with %llu items to deliver\n",
+                    this->options.port, this->remaining_batches, static_cast<unsigned long long>(this->items));
+
+        std::unique_lock<std::mutex> lock(this->guard);
+        this->cv_finished.wait(lock, [this]() { return this->remaining_batches == 0; });
+
+        const double elapsed_s = std::chrono::duration<double>(this->finished - this->started.value()).count();
+        json report{{"drive", "controller"},
+                    {"elapsed_s", elapsed_s},
+                    {"items", this->items},
+                    {"items_per_s", this->items / elapsed_s},
+                    {"bytes", this->bytes},
+                    {"calls", json::object()}};
+
+        for (const auto& [name, count] : this->served)
+            report["calls"][name] = count;
+
+        return report;
+    }
+
+private:
+    /// @brief Binds the given method with the given count of arguments (rpclib checks the count).
+    template <std::size_t N = 0> void bind(const std::string& name, std::uint32_t n) {
+        if constexpr (N <= MAX_ARGS) {
+            if (n == N)
+                this->bind(name, std::make_index_sequence<N>{});
+            else
+                this->bind<N + 1>(name, n);
+        }
+    }
+
+    template <std::size_t... I> void bind(const std::string& name, std::index_sequence<I...>) {
+        // each argument is taken as msgpack object, the index only serves to expand the parameter pack
+        this->server.bind(name, [this, name](std::conditional_t<true, RPCLIB_MSGPACK::object,
+                                                                 std::integral_constant<std::size_t, I>>&... args) {
+            return this->respond(name, std::vector<RPCLIB_MSGPACK::object>{args...});
+        });
+    }
+
+    /// @brief Answers a call with the next recorded outcome of its method.
+    RPCLIB_MSGPACK::object respond(const std::string& name, const std::vector<RPCLIB_MSGPACK::object>& args) {
+        std::optional<RecordedCall> recorded;
+        std::chrono::steady_clock::time_point due;
+
+        {
+            std::scoped_lock lock(this->guard);
+
+            if (not this->started.has_value())
+                this->started = std::chrono::steady_clock::now();
+
+            this->served[name]++;
+
+            auto& queue = this->outcomes[name];
+            if (not queue.empty()) {
+                recorded = queue.front();
+                queue.pop_front();
+            }
+
+            if (recorded.has_value() and recorded->outcome != nullptr and this->options.speed > 0) {
+                const auto offset_us = (recorded->outcome->time_us - this->origin_us) / this->options.speed;
+                due = this->started.value() + std::chrono::microseconds(static_cast<std::int64_t>(offset_us));
+            }
+        }
+
+        if (not recorded.has_value() or recorded->outcome == nullptr) {
+            // all batches are delivered: like a long-poll without news, so that the controller does not spin
+            if (name == RETRIEVE) {
+                const int max_wait_ms = args.empty() ? 0 : args[0].as<int>();
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::clamp(max_wait_ms, 0, 1000)));
+                return this->empty_batch.get();
+            }
+
+            return {};
+        }
+
+        std::this_thread::sleep_until(due);
+
+        const auto& outcome = *recorded->outcome;
+        if (outcome.type == RecordType::Error) {
+            rpc::this_handler().respond_error(outcome.body().as<std::string>());
+            return {};
+        }
+
+        if (name == RETRIEVE) {
+            std::scoped_lock lock(this->guard);
+
+            this->bytes += satellite_link::wire_size(outcome.body());
+            if (--this->remaining_batches == 0) {
+                this->finished = std::chrono::steady_clock::now();
+                this->cv_finished.notify_all();
+            }
+        }
+
+        return outcome.body();
+    }
+
+    void count_items(const RPCLIB_MSGPACK::object& batch) {
+        satellite_link::BatchReader reader([this](satellite_link::BatchList, json&) { this->items++; });
+
+        try {
+            satellite_link::decode(batch, reader);
+        } catch (const std::exception&) {
+            // counted as far as it could be parsed
+        }
+    }
+
+    const Options& options;
+    rpc::server server;
+
+    std::mutex guard;
+    std::condition_variable cv_finished;
+    /// @brief The recorded calls per method, in the recorded order; protected by 'guard'.
+    std::map<std::string, std::deque<RecordedCall>> outcomes;
+    std::map<std::string, std::uint64_t> served;
+    std::size_t remaining_batches{0};
+    std::optional<std::chrono::steady_clock::time_point> started;
+    std::chrono::steady_clock::time_point finished;
+    std::int64_t origin_us{0};
+    std::uint64_t items{0};
+    std::uint64_t bytes{0};
+
+    /// @brief Returned to calls of 'retrieve_vars_and_errors' beyond the recording.
+    RPCLIB_MSGPACK::object_handle empty_batch{[]() {
+        RPCLIB_MSGPACK::sbuffer buffer;
+        RPCLIB_MSGPACK::pack(buffer, satellite_link::encode({{"vars", json::array()}, {"errors", json::array()}},
+                                                            satellite_link::PayloadEncoding::Json));
+        return RPCLIB_MSGPACK::unpack(buffer.data(), buffer.size());
+    }()};
+};
+
+void usage(const char* argv0) {
+    std::printf("usage: %s --recording FILE --drive agent|controller [options]\n"
+                "  --host H       host of the SatelliteAgent to drive (default 127.0.0.1)\n"
+                "  --port N       port of the SatelliteAgent to drive, or to listen on (default 4129)\n"
+                "  --speed F      factor on the original speed, 0 for as fast as possible (default 1)\n"
+                "  --threads N    concurrent calls, or RPC workers when driving a controller (default 16)\n"
+                "  --report FILE  write the summary as JSON\n",
+                argv0);
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string name = argv[i];
+
+        if (name == "--help" or name == "-h") {
+            usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        }
+
+        if (i + 1 >= argc)
+            throw std::invalid_argument("missing value of " + name);
+        const std::string value = argv[++i];
+
+        if (name == "--recording")
+            options.recording = value;
+        else if (name == "--drive")
+            options.drive = value;
+        else if (name == "--host")
+            options.host = value;
+        else if (name == "--port")
+            options.port = std::stoi(value);
+        else if (name == "--speed")
+            options.speed = std::stod(value);
+        else if (name == "--threads")
+            options.threads = std::max(std::stoi(value), 1);
+        else if (name == "--report")
+            options.report = value;
+        else
+            throw std::invalid_argument("unknown option " + name);
+    }
+
+    if (options.recording.empty())
+        throw std::invalid_argument("no recording given");
+    if (options.drive != "agent" and options.drive != "controller")
+        throw std::invalid_argument("--drive must be 'agent' or 'controller'");
+
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        const auto [records, calls] = read_recording(options.recording);
+        std::printf("%zu records, %zu calls\n", records.size(), calls.size());
+
+        json report;
+        if (options.drive == "agent") {
+            report = drive_agent(options, calls);
+        } else {
+            ControllerDriver driver(options, calls);
+            report = driver.run();
+        }
+
+        report["recording"] = options.recording;
+        report["speed"] = options.speed;
+        std::printf("%s\n", report.dump(2).c_str());
+
+        if (not options.report.empty()) {
+            std::ofstream file(options.report, std::ios::trunc);
+            file << report.dump(2) << '\n';
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+//
+// Encoding and decoding of each EVerest type which crosses the satellite link, with every codec the link
+// offers for it, so that the codecs can be compared per type. The values are read from the JSON files in
+// the 'fixtures' directory, which can be replaced by values captured from a real installation.
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <benchmark/benchmark.h>
+#include <generated/types/authorization.hpp>
+#include <generated/types/energy.hpp>
+#include <generated/types/evse_board_support.hpp>
+#include <generated/types/evse_manager.hpp>
+#include <generated/types/powermeter.hpp>
+#include <generated/types/system.hpp>
+#include <nlohmann/json.hpp>
+#include <rpc/msgpack.hpp>
+#include <satellite_link/codec.hpp>
+#include <satellite_link/compression.hpp>
+#include <satellite_link/packed_types.hpp>
+#include <satellite_link/payload.hpp>
+#include <utils/error/error_json.hpp>
+#include "allocations.hpp"
+
+using json = nlohmann::json;
+using satellite_link::Compression;
+using satellite_link::PayloadEncoding;
+
+namespace {
+
+/// @brief The ways a value can take over the link.
+struct WireFormat {
+    const char* name;
+    /// @brief Whether the value is sent in its packed layout (only for types which have one),
+    ///        otherwise it is converted to JSON and sent as payload in the given encoding.
+    bool packed;
+    PayloadEncoding encoding;
+    Compression compression;
+};
+
+constexpr WireFormat WIRE_FORMATS[]{
+    // the JSON text in a msgpack string, as the link started out
+    {"json", false, PayloadEncoding::Json, Compression::None},
+    {"msgpack", false, PayloadEncoding::MsgPack, Compression::None},
+    {"msgpack_lz4", false, PayloadEncoding::MsgPack, Compression::Lz4},
+    {"msgpack_zstd", false, PayloadEncoding::MsgPack, Compression::ZstdDict1},
+    {"packed", true, PayloadEncoding::MsgPack, Compression::None},
+};
+
+template <typename T> T load_fixture(const std::string& name) {
+    const std::string path = std::string(SATELLITE_LINK_FIXTURES_DIR) + "/" + name + ".json";
+    std::ifstream file(path);
+
+    if (not file.good())
+        throw std::runtime_error("Cannot open " + path);
+
+    return json::parse(file).get<T>();
+}
+
+// packs the value as rpclib does for an argument or result; compression is applied regardless of
+// the size, it is left out anyway if it does not pay off
+template <typename T> void pack(RPCLIB_MSGPACK::sbuffer& buffer, const T& value, const WireFormat& format) {
+    if constexpr (satellite_link::Packed<T>::available) {
+        if (format.packed) {
+            RPCLIB_MSGPACK::pack(buffer, satellite_link::Codec<T>::encode(value, format.encoding));
+            return;
+        }
+    }
+
+    auto payload = satellite_link::encode(json(value), format.encoding);
+    satellite_link::compress(payload, format.compression, 0);
+    RPCLIB_MSGPACK::pack(buffer, payload);
+}
+
+template <typename T> T unpack(const RPCLIB_MSGPACK::sbuffer& buffer, const WireFormat& format) {
+    auto handle = RPCLIB_MSGPACK::unpack(buffer.data(), buffer.size());
+
+    if constexpr (satellite_link::Packed<T>::available) {
+        if (format.packed)
+            return satellite_link::Codec<T>::decode(handle.get());
+    }
+
+    return satellite_link::decode(handle.get()).template get<T>();
+}
+
+void report(benchmark::State& state, std::size_t bytes, std::size_t allocations_before) {
+    state.counters["bytes"] = static_cast<double>(bytes);
+    state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocation_count() - allocations_before),
+                                                  benchmark::Counter::kAvgIterations);
+}
+
+template <typename T> void encode(benchmark::State& state, const std::string& fixture, const WireFormat& format) {
+    std::optional<T> value;
+
+    try {
+        value = load_fixture<T>(fixture);
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    std::size_t bytes{0};
+    const auto allocations_before = allocation_count();
+
+    for (auto _ : state) {
+        RPCLIB_MSGPACK::sbuffer buffer;
+        pack(buffer, value.value(), format);
+        bytes = buffer.size();
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    report(state, bytes, allocations_before);
+}
+
+template <typename T> void decode(benchmark::State& state, const std::string& fixture, const WireFormat& format) {
+    RPCLIB_MSGPACK::sbuffer buffer;
+
+    try {
+        pack(buffer, load_fixture<T>(fixture), format);
+    } catch (const std::exception& e) {
+        state.SkipWithError(e.what());
+        return;
+    }
+
+    const auto allocations_before = allocation_count();
+
+    for (auto _ : state) {
+        T decoded = unpack<T>(buffer, format);
+        benchmark::DoNotOptimize(decoded);
+    }
+
+    report(state, buffer.size(), allocations_before);
+}
+
+// registers encode/<fixture>/<format> and decode/<fixture>/<format> for each wire format applicable to T
+template <typename T> void register_type(const std::string& fixture) {
+    for (const auto& format : WIRE_FORMATS) {
+        if (format.packed and not satellite_link::Packed<T>::available)
+            continue;
+        if (not satellite_link::compression_supported(format.compression))
+            continue;
+
+        const std::string suffix = "/" + fixture + "/" + format.name;
+        benchmark::RegisterBenchmark(("encode" + suffix).c_str(), encode<T>, fixture, format);
+        benchmark::RegisterBenchmark(("decode" + suffix).c_str(), decode<T>, fixture, format);
+    }
+}
+
+bool register_types() {
+    register_type<types::evse_board_support::Telemetry>("telemetry");
+    register_type<types::powermeter::Powermeter>("powermeter");
+    register_type<types::evse_manager::SessionEvent>("session_event");
+    register_type<types::evse_manager::Limits>("limits");
+    register_type<types::evse_manager::EVInfo>("ev_info");
+    register_type<types::energy::EnergyFlowRequest>("energy_flow_request");
+    register_type<types::authorization::ProvidedIdToken>("provided_id_token");
+    register_type<Everest::error::Error>("error");
+    register_type<types::energy::EnforcedLimits>("enforced_limits");
+    register_type<types::system::FirmwareUpdateRequest>("firmware_update_request");
+
+    return true;
+}
+
+[[maybe_unused]] const bool registered = register_types();
+
+} // namespace
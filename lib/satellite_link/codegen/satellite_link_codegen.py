@@ -0,0 +1,362 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-only
+# Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+"""Generates the typed satellite link stubs from tunnel.yaml and the EVerest interface definitions.
+
+For each tunnelled variable, a 'var_traits' specialization is emitted which knows the C++ type of the
+variable and how to subscribe/publish it on a module, so that the SatelliteAgent and the
+SatelliteController do not need hand-written code per variable anymore.
+For each tunnelled command, a descriptor is emitted which carries the function name on the wire, the
+call class, the delivery mode and the C++ types of the arguments and the result; the modules use these
+descriptors as typed client stubs ('SatelliteController::forward') and server skeletons
+('SatelliteAgent::bind_forwarded').
+"""
+
+import argparse
+import hashlib
+import re
+import sys
+from pathlib import Path
+
+import yaml
+
+BANNER = """\
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+//
+// AUTO GENERATED by satellite_link_codegen.py from tunnel.yaml - DO NOT EDIT
+//
+"""
+
+SCALAR_TYPES = {
+    'boolean': 'bool',
+    'integer': 'int',
+    'number': 'double',
+    'string': 'std::string',
+}
+
+VAR_KINDS = {'state': 'State', 'event': 'Event'}
+VAR_PRIORITIES = {'critical': 'Critical', 'normal': 'Normal', 'bulk': 'Bulk'}
+CALL_CLASSES = {'control': 'Control', 'default': 'Default', 'long': 'Long'}
+DELIVERIES = ('call', 'notification')
+
+REF_PATTERN = re.compile(r'^/(?P<file>\w+)#/(?P<type>\w+)$')
+
+
+class CodegenError(Exception):
+    pass
+
+
+class Generator:
+    def __init__(self, interfaces_dir):
+        self.interfaces_dir = Path(interfaces_dir)
+        self.interfaces = {}
+        self.type_files = set()
+
+    def interface(self, name):
+        if name not in self.interfaces:
+            path = self.interfaces_dir / f'{name}.yaml'
+            try:
+                with path.open('r', encoding='utf-8') as f:
+                    self.interfaces[name] = yaml.safe_load(f) or {}
+            except OSError as e:
+                raise CodegenError(f'cannot read interface definition of \'{name}\': {e}') from e
+        return self.interfaces[name]
+
+    def cpp_type(self, schema, where):
+        """Maps the JSON schema of an argument, result or variable to the C++ type used by EVerest."""
+        if schema is None:
+            return 'void'
+
+        ref = schema.get('$ref')
+        if ref is not None:
+            match = REF_PATTERN.match(ref)
+            if match is None:
+                raise CodegenError(f'{where}: unsupported type reference \'{ref}\'')
+            self.type_files.add(match['file'])
+            return f'types::{match["file"]}::{match["type"]}'
+
+        schema_type = schema.get('type')
+        if schema_type in SCALAR_TYPES:
+            return SCALAR_TYPES[schema_type]
+        if schema_type == 'array':
+            return f'std::vector<{self.cpp_type(schema.get("items", {}), where)}>'
+        if schema_type == 'object' or schema_type is None:
+            return 'nlohmann::json'
+
+        raise CodegenError(f'{where}: unsupported type \'{schema_type}\'')
+
+    def var(self, entry, with_delivery):
+        interface, var = entry['interface'], entry['var']
+        where = f'{interface}/{var}'
+        definition = (self.interface(interface).get('vars') or {}).get(var)
+        if definition is None:
+            raise CodegenError(f'{where}: no such variable in the interface definition')
+
+        rv = {
+            'name': entry.get('name', interface),
+            'interface': interface,
+            'var': var,
+            'type': self.cpp_type(definition, where),
+            'kind': 'State',
+            'priority': 'Normal',
+            'delta': False,
+        }
+
+        if with_delivery:
+            try:
+                rv['kind'] = VAR_KINDS[entry['kind']]
+                rv['priority'] = VAR_PRIORITIES[entry['priority']]
+            except KeyError as e:
+                raise CodegenError(f'{where}: missing or invalid kind/priority') from e
+
+            rv['delta'] = entry.get('delta', False)
+            if not isinstance(rv['delta'], bool):
+                raise CodegenError(f'{where}: invalid delta')
+            if rv['delta'] and rv['kind'] != 'State':
+                raise CodegenError(f'{where}: only state variables can be delta encoded')
+
+        rv['id'] = camel_case(rv['name']) + camel_case(var)
+        return rv
+
+    def cmd(self, entry):
+        interface, cmd = entry['interface'], entry['cmd']
+        where = f'{interface}/{cmd}'
+        definition = (self.interface(interface).get('cmds') or {}).get(cmd)
+        if definition is None:
+            raise CodegenError(f'{where}: no such command in the interface definition')
+
+        result = self.cpp_type(definition.get('result'), where)
+        delivery = entry.get('delivery', 'notification' if result == 'void' else 'call')
+        if delivery not in DELIVERIES:
+            raise CodegenError(f'{where}: invalid delivery \'{delivery}\'')
+        if delivery == 'notification' and result != 'void':
+            raise CodegenError(f'{where}: a command with result cannot be delivered as notification')
+        if entry.get('call_class') not in CALL_CLASSES:
+            raise CodegenError(f'{where}: missing or invalid call_class')
+
+        name = entry.get('name', interface)
+        arguments = definition.get('arguments') or {}
+
+        return {
+            'name': name,
+            'interface': interface,
+            'cmd': cmd,
+            'wire_name': f'{name}_{cmd}',
+            'call_class': CALL_CLASSES[entry['call_class']],
+            'notification': delivery == 'notification',
+            'result': result,
+            'arguments': [(arg, self.cpp_type(schema, f'{where}/{arg}')) for arg, schema in arguments.items()],
+        }
+
+
+def camel_case(name):
+    return ''.join(part[:1].upper() + part[1:] for part in name.split('_'))
+
+
+def type_includes(type_files):
+    return ''.join(f'#include <generated/types/{name}.hpp>\n' for name in sorted(type_files))
+
+
+def emit_var_enum(lines, enum, description, vars):
+    lines.append(f'/// @brief {description}')
+    lines.append('///        The numeric value is the tag which identifies the variable on the wire.')
+    lines.append(f'enum class {enum} : std::uint8_t {{')
+    lines += [f'    {v["id"]},' for v in vars]
+    lines.append('};')
+    lines.append('')
+
+
+def emit_var_traits(lines, enum, vars):
+    for v in vars:
+        lines.append(f'template <> struct var_traits<{enum}::{v["id"]}> {{')
+        lines.append(f'    using type = {v["type"]};')
+        lines.append('')
+        lines.append('    template <typename Module, typename F> static void subscribe(Module& module, F callback) {')
+        lines.append(f'        if (auto* r = first_connection(module.r_{v["name"]}))')
+        lines.append(f'            r->subscribe_{v["var"]}(std::move(callback));')
+        lines.append('    }')
+        lines.append('')
+        lines.append('    template <typename Module> static void publish(Module& module, const type& value) {')
+        lines.append(f'        module.p_{v["name"]}->publish_{v["var"]}(value);')
+        lines.append('    }')
+        lines.append('};')
+        lines.append('')
+
+
+def emit_var_helpers(lines, enum, prefix, vars):
+    lines.append(f'constexpr std::array<VarInfo, {len(vars)}> {prefix}_var_infos{{{{')
+    lines += [f'    {{"{v["name"]}", "{v["var"]}", VarKind::{v["kind"]}, VarPriority::{v["priority"]}, '
+              f'{"true" if v["delta"] else "false"}}},' for v in vars]
+    lines.append('}};')
+    lines.append('')
+
+    lines.append(f'/// @brief Calls \'f\' with a std::integral_constant for each {enum}.')
+    lines.append(f'template <typename F> void for_each_{prefix}_var(F&& f) {{')
+    lines += [f'    f(std::integral_constant<{enum}, {enum}::{v["id"]}>{{}});' for v in vars]
+    lines.append('}')
+    lines.append('')
+
+    lines.append('/// @brief Calls \'f\' with a std::integral_constant for the given variable.')
+    lines.append(f'template <typename F> void visit_var({enum} var, F&& f) {{')
+    lines.append('    switch (var) {')
+    for v in vars:
+        lines.append(f'    case {enum}::{v["id"]}:')
+        lines.append(f'        f(std::integral_constant<{enum}, {enum}::{v["id"]}>{{}});')
+        lines.append('        break;')
+    lines.append('    }')
+    lines.append('}')
+    lines.append('')
+
+
+def tables_hash(gen, spec):
+    """Fingerprint of everything both sides of the link must agree on: the tags of the variables
+    (their position), their types and delivery properties, and the commands with their signatures."""
+    tables = []
+    for section, with_delivery in (('agent_vars', True), ('controller_vars', False)):
+        for tag, entry in enumerate(spec.get(section, [])):
+            v = gen.var(entry, with_delivery)
+            tables.append(f'{section}:{tag}:{v["interface"]}/{v["var"]}:{v["type"]}:{v["kind"]}:{v["priority"]}:'
+                          f'{v["delta"]}')
+    for entry in spec.get('commands', []):
+        c = gen.cmd(entry)
+        arguments = ','.join(t for _, t in c['arguments'])
+        tables.append(f'commands:{c["wire_name"]}:{c["call_class"]}:{c["notification"]}:{c["result"]}({arguments})')
+
+    return int.from_bytes(hashlib.sha256('\n'.join(tables).encode('utf-8')).digest()[:8], 'big')
+
+
+def generate_vars(gen, spec, hash_value):
+    agent_vars = [gen.var(entry, True) for entry in spec.get('agent_vars', [])]
+    controller_vars = [gen.var(entry, False) for entry in spec.get('controller_vars', [])]
+
+    for enum, vars in (('AgentVar', agent_vars), ('ControllerVar', controller_vars)):
+        ids = [v['id'] for v in vars]
+        duplicates = {i for i in ids if ids.count(i) > 1}
+        if duplicates:
+            raise CodegenError(f'duplicate {enum} entries: {", ".join(sorted(duplicates))}')
+        if len(vars) > 256:
+            raise CodegenError(f'too many {enum} entries for an 8-bit tag')
+
+    value_types = []
+    for v in agent_vars:
+        if v['type'] not in value_types:
+            value_types.append(v['type'])
+
+    lines = []
+    lines.append('/// @brief Fingerprint of the variable and command tables generated from tunnel.yaml; exchanged in')
+    lines.append('///        \'link_setup\', so that peers built from different revisions refuse the link instead of')
+    lines.append('///        dispatching variables and commands to the wrong handlers.')
+    lines.append(f'constexpr std::uint64_t TUNNEL_TABLES_HASH{{0x{hash_value:016x}ULL}};')
+    lines.append('')
+    emit_var_enum(lines, 'AgentVar', 'All variables which the SatelliteAgent forwards to the SatelliteController.',
+                  agent_vars)
+    emit_var_enum(lines, 'ControllerVar',
+                  'All variables which the SatelliteController forwards to the SatelliteAgent (via "push_var").',
+                  controller_vars)
+
+    lines.append('/// @brief Properties of all variables forwarded by the SatelliteAgent, indexed by \'AgentVar\'.')
+    emit_var_helpers(lines, 'AgentVar', 'agent', agent_vars)
+    lines.append('/// @brief Properties of all variables forwarded by the SatelliteController, indexed by \'ControllerVar\'.')
+    emit_var_helpers(lines, 'ControllerVar', 'controller', controller_vars)
+
+    lines.append('/// @brief Any value of a variable forwarded by the SatelliteAgent.')
+    lines.append('using AgentVarValue = std::variant<')
+    lines.append(',\n'.join(f'    {t}' for t in value_types) + '>;')
+    lines.append('')
+
+    emit_var_traits(lines, 'AgentVar', agent_vars)
+    emit_var_traits(lines, 'ControllerVar', controller_vars)
+
+    return (BANNER +
+            '#ifndef SATELLITE_LINK_GENERATED_VARS_HPP\n'
+            '#define SATELLITE_LINK_GENERATED_VARS_HPP\n\n'
+            '#include <array>\n#include <cstdint>\n#include <string>\n#include <type_traits>\n'
+            '#include <utility>\n#include <variant>\n#include <vector>\n\n'
+            '#include <nlohmann/json.hpp>\n#include <satellite_link/var_traits.hpp>\n\n' +
+            type_includes(gen.type_files) +
+            '\nnamespace satellite_link {\n\n' + '\n'.join(lines) +
+            '} // namespace satellite_link\n\n#endif // SATELLITE_LINK_GENERATED_VARS_HPP\n')
+
+
+def generate_commands(gen, spec):
+    gen.type_files = set()
+    cmds = [gen.cmd(entry) for entry in spec.get('commands', [])]
+
+    names = [c['wire_name'] for c in cmds]
+    duplicates = {n for n in names if names.count(n) > 1}
+    if duplicates:
+        raise CodegenError(f'duplicate commands: {", ".join(sorted(duplicates))}')
+
+    lines = []
+    for name in dict.fromkeys(c['name'] for c in cmds):
+        lines.append(f'namespace {name} {{')
+        lines.append('')
+        for c in (c for c in cmds if c['name'] == name):
+            arguments = ', '.join(t for _, t in c['arguments'])
+            signature = ', '.join(f'{t} {a}' for a, t in c['arguments'])
+            lines.append(f'/// @brief {c["interface"]}/{c["cmd"]}: {c["result"]} ({signature})')
+            lines.append(f'struct {c["cmd"]} {{')
+            lines.append(f'    static constexpr const char* name{{"{c["wire_name"]}"}};')
+            lines.append(f'    static constexpr CallClass call_class{{CallClass::{c["call_class"]}}};')
+            lines.append(f'    static constexpr bool notification{{{"true" if c["notification"] else "false"}}};')
+            lines.append(f'    using result_type = {c["result"]};')
+            lines.append(f'    using argument_types = std::tuple<{arguments}>;')
+            lines.append('};')
+            lines.append('')
+        lines.append(f'}} // namespace {name}')
+        lines.append('')
+
+    lines.append('/// @brief Wire names of all commands, e.g. to set up per command state in advance.')
+    lines.append(f'constexpr std::array<const char*, {len(cmds)}> wire_names{{{{')
+    lines.extend(f'    "{c["wire_name"]}",' for c in cmds)
+    lines.append('}};')
+    lines.append('')
+
+    return (BANNER +
+            '#ifndef SATELLITE_LINK_GENERATED_COMMANDS_HPP\n'
+            '#define SATELLITE_LINK_GENERATED_COMMANDS_HPP\n\n'
+            '#include <array>\n#include <string>\n#include <tuple>\n#include <vector>\n\n'
+            '#include <nlohmann/json.hpp>\n#include <satellite_link/call_class.hpp>\n\n' +
+            type_includes(gen.type_files) +
+            '\nnamespace satellite_link {\nnamespace commands {\n\n' + '\n'.join(lines) +
+            '} // namespace commands\n} // namespace satellite_link\n\n'
+            '#endif // SATELLITE_LINK_GENERATED_COMMANDS_HPP\n')
+
+
+def write_if_changed(path, content):
+    # keep the timestamp of unchanged files to avoid needless rebuilds
+    if path.exists() and path.read_text(encoding='utf-8') == content:
+        return
+    path.parent.mkdir(parents=True, exist_ok=True)
+    path.write_text(content, encoding='utf-8')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--spec', required=True, help='path to tunnel.yaml')
+    parser.add_argument('--interfaces-dir', required=True, help='directory with the EVerest interface definitions')
+    parser.add_argument('--output-dir', required=True, help='directory to place the satellite_link/generated headers in')
+    args = parser.parse_args()
+
+    try:
+        with open(args.spec, 'r', encoding='utf-8') as f:
+            spec = yaml.safe_load(f)
+
+        hash_value = tables_hash(Generator(args.interfaces_dir), spec)
+        gen = Generator(args.interfaces_dir)
+        vars_hpp = generate_vars(gen, spec, hash_value)
+        commands_hpp = generate_commands(gen, spec)
+    except (CodegenError, OSError, yaml.YAMLError) as e:
+        print(f'satellite_link_codegen: error: {e}', file=sys.stderr)
+        return 1
+
+    output_dir = Path(args.output_dir) / 'satellite_link' / 'generated'
+    write_if_changed(output_dir / 'vars.hpp', vars_hpp)
+    write_if_changed(output_dir / 'commands.hpp', commands_hpp)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_BATCH_READER_HPP
+#define SATELLITE_LINK_BATCH_READER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace satellite_link {
+
+/// @brief The lists of a batch returned by "retrieve_vars_and_errors".
+enum class BatchList {
+    Vars,
+    Errors,
+};
+
+/// @brief SAX handler which reads a batch returned by "retrieve_vars_and_errors" item by item: only
+///        the item currently parsed is built as JSON value, and it is passed to the callback as soon
+///        as it is complete. So a large batch (e.g. a backlog after a stall) is never held completely
+///        as DOM, and its items are dispatched while the rest is still being parsed.
+///        The items are passed in the order of the batch; since the agent's batch is an ordered map,
+///        the errors come before the variables.
+class BatchReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+    using json = nlohmann::json;
+    using Callback = std::function<void(BatchList list, json& item)>;
+
+    explicit BatchReader(Callback callback) : callback(std::move(callback)) {
+    }
+
+    /// @brief The message of the last parse error.
+    const std::string& error() const {
+        return this->error_message;
+    }
+
+    bool null() override {
+        return this->value(nullptr);
+    }
+
+    bool boolean(bool val) override {
+        return this->value(val);
+    }
+
+    bool number_integer(number_integer_t val) override {
+        return this->value(val);
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        return this->value(val);
+    }
+
+    bool number_float(number_float_t val, const string_t&) override {
+        return this->value(val);
+    }
+
+    bool string(string_t& val) override {
+        return this->value(std::move(val));
+    }
+
+    bool binary(binary_t& val) override {
+        return this->value(json::binary(std::move(val)));
+    }
+
+    bool start_object(std::size_t) override {
+        if (not this->stack.empty()) {
+            this->stack.push_back(this->add(json::object()));
+        } else if (this->depth == 2 and this->list_known) {
+            // an item of one of the lists starts
+            this->item = json::object();
+            this->stack.push_back(&this->item);
+        } else {
+            this->depth++;
+        }
+
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        if (not this->stack.empty()) {
+            this->element = &(*this->stack.back())[val];
+        } else if (this->depth == 1) {
+            this->list_known = true;
+            if (val == "vars")
+                this->list = BatchList::Vars;
+            else if (val == "errors")
+                this->list = BatchList::Errors;
+            else
+                this->list_known = false;
+        }
+
+        return true;
+    }
+
+    bool end_object() override {
+        return this->end_container();
+    }
+
+    bool start_array(std::size_t) override {
+        if (not this->stack.empty())
+            this->stack.push_back(this->add(json::array()));
+        else
+            this->depth++;
+
+        return true;
+    }
+
+    bool end_array() override {
+        return this->end_container();
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        this->error_message = std::string(ex.what()) + " (at byte " + std::to_string(position) + ")";
+        return false;
+    }
+
+private:
+    template <typename T> bool value(T&& val) {
+        // scalars outside of items are not expected, so they are just skipped
+        if (not this->stack.empty())
+            this->add(json(std::forward<T>(val)));
+
+        return true;
+    }
+
+    json* add(json&& val) {
+        json& parent = *this->stack.back();
+
+        if (parent.is_array()) {
+            parent.push_back(std::move(val));
+            return &parent.back();
+        }
+
+        *this->element = std::move(val);
+        return this->element;
+    }
+
+    bool end_container() {
+        if (this->stack.empty()) {
+            this->depth--;
+            return true;
+        }
+
+        this->stack.pop_back();
+
+        if (this->stack.empty()) {
+            this->callback(this->list, this->item);
+            this->item = nullptr;
+        }
+
+        return true;
+    }
+
+    Callback callback;
+
+    /// @brief Nesting level outside of the items: 1 is the batch object, 2 the lists.
+    int depth{0};
+    BatchList list{BatchList::Vars};
+    bool list_known{false};
+
+    /// @brief The item being parsed, and the path to the container currently being filled.
+    json item;
+    std::vector<json*> stack;
+    /// @brief The member of the object on top of 'stack' the next value is stored to.
+    json* element{nullptr};
+
+    std::string error_message;
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_BATCH_READER_HPP
@@ -0,0 +1,343 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_BLOB_HPP
+#define SATELLITE_LINK_BLOB_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <rpc/msgpack.hpp>
+
+namespace satellite_link {
+
+/// @brief Blobs up to this size are transported inline, larger ones over the blob channel.
+constexpr std::size_t BLOB_INLINE_MAX_SIZE{4096};
+/// @brief Size of the chunks of the blob channel; each chunk is a call of its own, so that small calls
+///        (e.g. control commands) on the same connection are not held back by a large blob.
+constexpr std::size_t BLOB_CHUNK_SIZE{4096};
+/// @brief Upper limit for the size of a blob, protects against bogus size fields.
+constexpr std::size_t MAX_BLOB_SIZE{1024 * 1024};
+/// @brief Blobs which were not picked up within this time are dropped.
+constexpr std::chrono::seconds BLOB_EXPIRY{60};
+/// @brief Upper limit for the count of blobs held at a time, the oldest one is dropped beyond.
+constexpr std::size_t MAX_PENDING_BLOBS{16};
+
+/// @brief Reference to a blob transferred over the blob channel, written instead of its bytes.
+struct BlobRef {
+    std::uint64_t id{0};
+    std::uint64_t size{0};
+};
+
+/// @brief Transfers blobs which are too large to be sent inline. Both modules provide an implementation:
+///        the SatelliteAgent holds its outgoing blobs until the SatelliteController fetches them
+///        ("retrieve_blob_chunk"), and the SatelliteController uploads its blobs before the call
+///        referencing them ("store_blob_chunk").
+class BlobChannel {
+public:
+    virtual ~BlobChannel() = default;
+
+    /// @brief Hands over the given blob to the channel (which may take its bytes); returns the reference
+    ///        to be sent instead, or nothing if the blob has to be sent inline after all.
+    virtual std::optional<BlobRef> send(std::vector<std::uint8_t>& bytes) = 0;
+
+    /// @brief Returns the blob the peer sent as the given reference; throws std::runtime_error if it is
+    ///        not available (anymore).
+    virtual std::vector<std::uint8_t> receive(const BlobRef& ref) = 0;
+};
+
+/// @brief Returns the size of the data encoded in the given base64 string, or nothing if the string
+///        is not in canonical base64 (i.e. it would not survive a round-trip through its bytes).
+inline std::optional<std::size_t> base64_decoded_size(const std::string& text) {
+    if (text.size() % 4 != 0)
+        return std::nullopt;
+
+    std::size_t padding{0};
+    if (not text.empty() and text.back() == '=')
+        padding = (text[text.size() - 2] == '=') ? 2 : 1;
+
+    return text.size() / 4 * 3 - padding;
+}
+
+namespace detail {
+
+inline int base64_value(char c) {
+    if (c >= 'A' and c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' and c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' and c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+} // namespace detail
+
+/// @brief Decodes the given base64 string to 'out', which must hold 'base64_decoded_size' bytes; returns
+///        false if the string is not in canonical base64.
+inline bool base64_decode(const std::string& text, std::uint8_t* out) {
+    const auto size = base64_decoded_size(text);
+    if (not size.has_value())
+        return false;
+
+    std::size_t n{0};
+    for (std::size_t i = 0; i < text.size(); i += 4) {
+        int v[4];
+        for (std::size_t k = 0; k < 4; k++)
+            v[k] = detail::base64_value(text[i + k]);
+
+        const std::size_t bytes = std::min<std::size_t>(3, size.value() - n);
+        // padding only at the very end, and the unused bits of the last character must be zero
+        if (v[0] < 0 or v[1] < 0 or (bytes > 1 and v[2] < 0) or (bytes > 2 and v[3] < 0))
+            return false;
+        if ((bytes == 1 and (v[1] & 0x0f) != 0) or (bytes == 2 and (v[2] & 0x03) != 0))
+            return false;
+
+        const std::uint32_t bits =
+            (v[0] << 18) | (v[1] << 12) | ((bytes > 1 ? v[2] : 0) << 6) | (bytes > 2 ? v[3] : 0);
+        out[n++] = static_cast<std::uint8_t>(bits >> 16);
+        if (bytes > 1)
+            out[n++] = static_cast<std::uint8_t>(bits >> 8);
+        if (bytes > 2)
+            out[n++] = static_cast<std::uint8_t>(bits);
+    }
+
+    return true;
+}
+
+/// @brief Encodes the given bytes as base64 into 'text', replacing its content.
+inline void base64_encode(const std::uint8_t* data, std::size_t size, std::string& text) {
+    static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    text.resize((size + 2) / 3 * 4);
+
+    std::size_t n{0};
+    for (std::size_t i = 0; i < size; i += 3) {
+        const std::size_t bytes = std::min<std::size_t>(3, size - i);
+        const std::uint32_t bits =
+            (data[i] << 16) | ((bytes > 1 ? data[i + 1] : 0) << 8) | (bytes > 2 ? data[i + 2] : 0);
+
+        text[n++] = alphabet[(bits >> 18) & 0x3f];
+        text[n++] = alphabet[(bits >> 12) & 0x3f];
+        text[n++] = bytes > 1 ? alphabet[(bits >> 6) & 0x3f] : '=';
+        text[n++] = bytes > 2 ? alphabet[bits & 0x3f] : '=';
+    }
+}
+
+/// @brief Outgoing blobs of the side which is asked for them chunk by chunk.
+class BlobStore {
+public:
+    /// @brief Stores the given blob; a held blob neither expires nor counts towards 'MAX_PENDING_BLOBS'
+    ///        until it is released, e.g. because it is referenced by an item which is delivered again and
+    ///        again until the peer acknowledges it.
+    BlobRef put(std::vector<std::uint8_t> bytes, bool held = false) {
+        std::scoped_lock lock(this->guard);
+        this->expire();
+
+        const BlobRef ref{this->next_id++, bytes.size()};
+        this->blobs[ref.id] = {std::chrono::steady_clock::now() + BLOB_EXPIRY, std::move(bytes), held};
+
+        return ref;
+    }
+
+    /// @brief Releases a held blob, which expires as usual from now on: the peer may still be fetching it.
+    void release(std::uint64_t id) {
+        std::scoped_lock lock(this->guard);
+
+        const auto it = this->blobs.find(id);
+        if (it != this->blobs.end()) {
+            it->second.expiry = std::chrono::steady_clock::now() + BLOB_EXPIRY;
+            it->second.held = false;
+        }
+    }
+
+    /// @brief Returns the chunk of the given blob starting at 'offset', or nothing if the blob is unknown
+    ///        or the offset is out of range.
+    std::optional<std::vector<std::uint8_t>> chunk(std::uint64_t id, std::uint64_t offset) {
+        std::scoped_lock lock(this->guard);
+
+        const auto it = this->blobs.find(id);
+        if (it == this->blobs.end() or offset >= it->second.bytes.size())
+            return std::nullopt;
+
+        const auto& bytes = it->second.bytes;
+        const auto size = std::min<std::uint64_t>(BLOB_CHUNK_SIZE, bytes.size() - offset);
+
+        return std::vector<std::uint8_t>(bytes.begin() + offset, bytes.begin() + offset + size);
+    }
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point expiry;
+        std::vector<std::uint8_t> bytes;
+        bool held{false};
+    };
+
+    /// @brief Drops expired blobs, and the oldest ones beyond the limit, except for held ones; expects
+    ///        'guard' to be held.
+    void expire() {
+        const auto now = std::chrono::steady_clock::now();
+        auto count = static_cast<std::size_t>(std::count_if(
+            this->blobs.begin(), this->blobs.end(), [](const auto& blob) { return not blob.second.held; }));
+
+        for (auto it = this->blobs.begin(); it != this->blobs.end();) {
+            if (not it->second.held and (it->second.expiry <= now or count >= MAX_PENDING_BLOBS)) {
+                it = this->blobs.erase(it);
+                count--;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::mutex guard;
+    /// @brief Ordered by id, so the oldest blobs come first.
+    std::map<std::uint64_t, Entry> blobs;
+    std::uint64_t next_id{1};
+};
+
+/// @brief Blob channel which stores the blobs it sends as held in the given store, and records their ids so
+///        that they can be released once the item referencing them is acknowledged.
+class HoldingBlobChannel : public BlobChannel {
+public:
+    explicit HoldingBlobChannel(BlobStore& store) : store(store) {
+    }
+
+    std::optional<BlobRef> send(std::vector<std::uint8_t>& bytes) override {
+        const auto ref = this->store.put(std::move(bytes), true);
+        this->held.push_back(ref.id);
+        return ref;
+    }
+
+    std::vector<std::uint8_t> receive(const BlobRef& ref) override {
+        throw std::runtime_error("Blob " + std::to_string(ref.id) + " cannot be received on this channel");
+    }
+
+    /// @brief Returns the ids of the blobs sent since the last call.
+    std::vector<std::uint64_t> take_held() {
+        return std::exchange(this->held, {});
+    }
+
+private:
+    BlobStore& store;
+    std::vector<std::uint64_t> held;
+};
+
+/// @brief Incoming blobs of the side to which they are uploaded chunk by chunk.
+class BlobAssembler {
+public:
+    /// @brief Stores a received chunk; returns false if it does not fit the blob.
+    bool add_chunk(std::uint64_t id, std::uint64_t offset, std::uint64_t size, const std::uint8_t* data,
+                   std::size_t chunk_size) {
+        if (size == 0 or size > MAX_BLOB_SIZE or offset % BLOB_CHUNK_SIZE != 0 or offset >= size or
+            chunk_size != std::min<std::uint64_t>(BLOB_CHUNK_SIZE, size - offset))
+            return false;
+
+        std::scoped_lock lock(this->guard);
+
+        auto it = this->blobs.find(id);
+        if (it == this->blobs.end()) {
+            this->expire();
+
+            Entry entry;
+            entry.expiry = std::chrono::steady_clock::now() + BLOB_EXPIRY;
+            entry.bytes.resize(size);
+            entry.received.resize((size + BLOB_CHUNK_SIZE - 1) / BLOB_CHUNK_SIZE);
+            entry.missing_chunks = entry.received.size();
+            it = this->blobs.emplace(id, std::move(entry)).first;
+        } else if (it->second.bytes.size() != size) {
+            return false;
+        }
+
+        auto& entry = it->second;
+        const auto index = offset / BLOB_CHUNK_SIZE;
+
+        if (not entry.received[index]) {
+            std::memcpy(entry.bytes.data() + offset, data, chunk_size);
+            entry.received[index] = true;
+            entry.missing_chunks--;
+        }
+
+        return true;
+    }
+
+    /// @brief Removes the given blob and returns it; throws std::runtime_error if it is incomplete.
+    std::vector<std::uint8_t> take(const BlobRef& ref) {
+        std::scoped_lock lock(this->guard);
+
+        const auto it = this->blobs.find(ref.id);
+        if (it == this->blobs.end() or it->second.bytes.size() != ref.size or it->second.missing_chunks != 0)
+            throw std::runtime_error("Blob " + std::to_string(ref.id) + " is not available");
+
+        auto bytes = std::move(it->second.bytes);
+        this->blobs.erase(it);
+
+        return bytes;
+    }
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point expiry;
+        std::vector<std::uint8_t> bytes;
+        std::vector<bool> received;
+        std::size_t missing_chunks{0};
+    };
+
+    /// @brief Drops expired blobs, and the oldest ones beyond the limit; expects 'guard' to be held.
+    void expire() {
+        const auto now = std::chrono::steady_clock::now();
+
+        for (auto it = this->blobs.begin(); it != this->blobs.end();) {
+            if (it->second.expiry <= now or this->blobs.size() >= MAX_PENDING_BLOBS)
+                it = this->blobs.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    std::mutex guard;
+    std::map<std::uint64_t, Entry> blobs;
+};
+
+/// @brief A chunk of a blob, passed as argument of "store_blob_chunk" without copying it.
+struct BlobChunk {
+    const std::uint8_t* data;
+    std::size_t size;
+};
+
+} // namespace satellite_link
+
+namespace RPCLIB_MSGPACK {
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+namespace adaptor {
+
+template <> struct pack<satellite_link::BlobChunk> {
+    template <typename Stream>
+    packer<Stream>& operator()(packer<Stream>& o, const satellite_link::BlobChunk& v) const {
+        const auto size = static_cast<uint32_t>(v.size);
+
+        o.pack_bin(size);
+        o.pack_bin_body(reinterpret_cast<const char*>(v.data), size);
+
+        return o;
+    }
+};
+
+} // namespace adaptor
+} // MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS)
+} // namespace RPCLIB_MSGPACK
+
+#endif // SATELLITE_LINK_BLOB_HPP
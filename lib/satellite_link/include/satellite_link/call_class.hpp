@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_CALL_CLASS_HPP
+#define SATELLITE_LINK_CALL_CLASS_HPP
+
+namespace satellite_link {
+
+/// @brief Classes of calls to the SatelliteAgent, each of them with its own configurable deadline.
+enum class CallClass {
+    /// @brief Commands controlling an ongoing session, which must fail fast (e.g. pause/stop charging).
+    Control,
+    /// @brief All other commands.
+    Default,
+    /// @brief Commands which are known to take long (e.g. a log upload).
+    Long,
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_CALL_CLASS_HPP
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_CODEC_HPP
+#define SATELLITE_LINK_CODEC_HPP
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <rpc/msgpack.hpp>
+#include <nlohmann/json.hpp>
+#include <satellite_link/blob.hpp>
+#include <satellite_link/packed.hpp>
+#include <satellite_link/payload.hpp>
+
+namespace satellite_link {
+
+/// @brief Converts arguments and results of tunnelled commands between their C++ type and their
+///        wire representation. By default, values take the generic path via JSON and are transported
+///        as 'Payload' in the negotiated encoding; hot types can get a specialization with a dedicated
+///        serializer, which then is used on both sides without touching the modules.
+///
+///        A specialization must provide:
+///        - 'encode(const T&, PayloadEncoding, BlobChannel* = nullptr)': returns something rpclib can pack
+///        - 'decode(const RPCLIB_MSGPACK::object&, BlobChannel* = nullptr)': returns the T, throws on
+///          malformed input
+///        The blob channel is used for blobs too large to be sent inline, see 'PackedWriter::put_blob'.
+template <typename T, typename = void> struct Codec {
+    static Payload encode(const T& value, PayloadEncoding encoding, BlobChannel* = nullptr) {
+        return satellite_link::encode(nlohmann::json(value), encoding);
+    }
+
+    static T decode(const RPCLIB_MSGPACK::object& o, BlobChannel* = nullptr) {
+        return satellite_link::decode(o).template get<T>();
+    }
+};
+
+/// @brief Scalars are passed as native msgpack values.
+template <typename T>
+struct Codec<T, std::enable_if_t<std::is_arithmetic_v<T> or std::is_same_v<T, std::string>>> {
+    static const T& encode(const T& value, PayloadEncoding, BlobChannel* = nullptr) {
+        return value;
+    }
+
+    static T decode(const RPCLIB_MSGPACK::object& o, BlobChannel* = nullptr) {
+        return o.as<T>();
+    }
+};
+
+/// @brief Types with a packed layout (see packed_types.hpp, which must be included before any use of
+///        the Codec) are passed as msgpack bin in that layout, regardless of the payload encoding; the
+///        receiver reads them straight from the received message.
+template <typename T> struct Codec<T, std::enable_if_t<Packed<T>::available>> {
+    static std::vector<std::uint8_t> encode(const T& value, PayloadEncoding, BlobChannel* blobs = nullptr) {
+        std::vector<std::uint8_t> buffer;
+        pack_value(value, buffer, blobs);
+
+        return buffer;
+    }
+
+    static T decode(const RPCLIB_MSGPACK::object& o, BlobChannel* blobs = nullptr) {
+        if (o.type != RPCLIB_MSGPACK::type::BIN)
+            throw PackedFormatError("expected binary");
+
+        return unpack_value<T>(reinterpret_cast<const std::uint8_t*>(o.via.bin.ptr), o.via.bin.size, blobs);
+    }
+};
+
+/// @brief The type which 'Codec<T>::encode' returns, i.e. the type of T on the wire.
+template <typename T> struct wire_type {
+    using type = std::decay_t<decltype(Codec<T>::encode(std::declval<const T&>(), PayloadEncoding::Json))>;
+};
+
+template <> struct wire_type<void> {
+    using type = void;
+};
+
+template <typename T> using wire_type_t = typename wire_type<T>::type;
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_CODEC_HPP
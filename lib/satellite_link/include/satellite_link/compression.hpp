@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_COMPRESSION_HPP
+#define SATELLITE_LINK_COMPRESSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef SATELLITE_LINK_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef SATELLITE_LINK_WITH_ZSTD
+#include <zstd.h>
+#include <satellite_link/zstd_dictionary.hpp>
+#endif
+
+namespace satellite_link {
+
+/// @brief Upper limit for the size of a decompressed payload, protects against bogus size fields.
+constexpr std::size_t MAX_DECOMPRESSED_SIZE{64 * 1024 * 1024};
+
+/// @brief Compression codecs which can be applied to large payloads on the satellite RPC link.
+///        The values are used as msgpack ext type on the wire, so they must not change.
+enum class Compression : std::int8_t {
+    None = 0,
+    /// @brief LZ4 block compression, fast and cheap on CPU for the smaller agents
+    Lz4 = 1,
+    /// @brief Zstandard using the built-in dictionary 'ZSTD_DICTIONARY' (version 1)
+    ZstdDict1 = 2,
+};
+
+inline std::string compression_to_string(Compression compression) {
+    switch (compression) {
+    case Compression::None:
+        return "none";
+    case Compression::Lz4:
+        return "lz4";
+    case Compression::ZstdDict1:
+        return "zstd-dict1";
+    }
+
+    throw std::out_of_range("No known string conversion for provided enum of type Compression");
+}
+
+inline Compression string_to_compression(const std::string& s) {
+    if (s == "none")
+        return Compression::None;
+    if (s == "lz4")
+        return Compression::Lz4;
+    if (s == "zstd" or s == "zstd-dict1")
+        return Compression::ZstdDict1;
+
+    throw std::out_of_range("Provided string " + s + " could not be converted to enum of type Compression");
+}
+
+/// @brief Returns whether the given codec was available when building the modules.
+inline bool compression_supported(Compression compression) {
+    switch (compression) {
+    case Compression::None:
+        return true;
+    case Compression::Lz4:
+#ifdef SATELLITE_LINK_WITH_LZ4
+        return true;
+#else
+        return false;
+#endif
+    case Compression::ZstdDict1:
+#ifdef SATELLITE_LINK_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+/// @brief Returns the names of all codecs which are supported, to be offered to the peer.
+inline std::vector<std::string> supported_compressions() {
+    std::vector<std::string> rv;
+
+    for (auto compression : {Compression::Lz4, Compression::ZstdDict1})
+        if (compression_supported(compression))
+            rv.push_back(compression_to_string(compression));
+
+    return rv;
+}
+
+#ifdef SATELLITE_LINK_WITH_ZSTD
+namespace detail {
+
+/// @brief The digested dictionary, shared by all threads.
+inline const ZSTD_CDict* zstd_cdict() {
+    static const struct CDict {
+        ZSTD_CDict* dict{ZSTD_createCDict(ZSTD_DICTIONARY, sizeof(ZSTD_DICTIONARY) - 1, 3)};
+        ~CDict() {
+            ZSTD_freeCDict(this->dict);
+        }
+    } cdict;
+
+    return cdict.dict;
+}
+
+inline const ZSTD_DDict* zstd_ddict() {
+    static const struct DDict {
+        ZSTD_DDict* dict{ZSTD_createDDict(ZSTD_DICTIONARY, sizeof(ZSTD_DICTIONARY) - 1)};
+        ~DDict() {
+            ZSTD_freeDDict(this->dict);
+        }
+    } ddict;
+
+    return ddict.dict;
+}
+
+/// @brief Contexts are re-used per thread, which avoids re-allocating their (large) work areas.
+template <typename Ctx, Ctx* (*Create)(), std::size_t (*Free)(Ctx*)> Ctx* zstd_context() {
+    thread_local const struct Holder {
+        Ctx* ctx{Create()};
+        ~Holder() {
+            Free(this->ctx);
+        }
+    } holder;
+
+    return holder.ctx;
+}
+
+} // namespace detail
+#endif
+
+/// @brief Compresses the given data into 'compressed'; returns false if the codec is not supported or
+///        the data did not shrink, so that the caller sends it uncompressed.
+inline bool compress(Compression compression, const std::string& data, std::string& compressed) {
+    switch (compression) {
+    case Compression::None:
+        return false;
+
+    case Compression::Lz4: {
+#ifdef SATELLITE_LINK_WITH_LZ4
+        compressed.resize(LZ4_compressBound(static_cast<int>(data.size())));
+        const int size = LZ4_compress_default(data.data(), compressed.data(), static_cast<int>(data.size()),
+                                              static_cast<int>(compressed.size()));
+        if (size <= 0 or static_cast<std::size_t>(size) >= data.size())
+            return false;
+
+        compressed.resize(size);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    case Compression::ZstdDict1: {
+#ifdef SATELLITE_LINK_WITH_ZSTD
+        auto* cctx = detail::zstd_context<ZSTD_CCtx, ZSTD_createCCtx, ZSTD_freeCCtx>();
+
+        compressed.resize(ZSTD_compressBound(data.size()));
+        const auto size = ZSTD_compress_usingCDict(cctx, compressed.data(), compressed.size(), data.data(),
+                                                   data.size(), detail::zstd_cdict());
+        if (ZSTD_isError(size) or size >= data.size())
+            return false;
+
+        compressed.resize(size);
+        return true;
+#else
+        return false;
+#endif
+    }
+    }
+
+    return false;
+}
+
+/// @brief Decompresses the given data, 'size' is the size of the original data.
+///        Throws std::runtime_error on malformed input or if the codec is not supported.
+inline std::string decompress(Compression compression, const char* data, std::size_t data_size, std::size_t size) {
+    if (size > MAX_DECOMPRESSED_SIZE)
+        throw std::runtime_error("Compressed payload too large: " + std::to_string(size) + " bytes");
+
+    std::string rv(size, '\0');
+
+    switch (compression) {
+    case Compression::None:
+        break;
+
+    case Compression::Lz4: {
+#ifdef SATELLITE_LINK_WITH_LZ4
+        const int n = LZ4_decompress_safe(data, rv.data(), static_cast<int>(data_size), static_cast<int>(size));
+        if (n < 0 or static_cast<std::size_t>(n) != size)
+            throw std::runtime_error("Malformed LZ4 compressed payload");
+
+        return rv;
+#else
+        break;
+#endif
+    }
+
+    case Compression::ZstdDict1: {
+#ifdef SATELLITE_LINK_WITH_ZSTD
+        auto* dctx = detail::zstd_context<ZSTD_DCtx, ZSTD_createDCtx, ZSTD_freeDCtx>();
+
+        const auto n = ZSTD_decompress_usingDDict(dctx, rv.data(), size, data, data_size, detail::zstd_ddict());
+        if (ZSTD_isError(n) or n != size)
+            throw std::runtime_error("Malformed Zstandard compressed payload");
+
+        return rv;
+#else
+        break;
+#endif
+    }
+    }
+
+    throw std::runtime_error("Unsupported compression of payload: " +
+                             std::to_string(static_cast<int>(compression)));
+}
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_COMPRESSION_HPP
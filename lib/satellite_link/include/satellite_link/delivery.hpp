@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_DELIVERY_HPP
+#define SATELLITE_LINK_DELIVERY_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <satellite_link/blob.hpp>
+#include <satellite_link/vars.hpp>
+
+namespace satellite_link {
+
+// Reliable delivery of variables and errors: each item carries a sequence number and is delivered by
+// the agent again and again until the controller acknowledges it by passing the highest sequence number
+// up to which it received everything as 'ack' of the next "retrieve_vars_and_errors".
+
+/// @brief Returns a variable item for a batch, without its value: the sequence number, the tag of the
+///        variable and its publication time in microseconds of the monotonic clock, which lets the
+///        controller measure the end-to-end latency.
+inline nlohmann::json make_var_item(std::uint64_t seq, AgentVar var,
+                                    std::chrono::steady_clock::time_point published) {
+    const auto ts = std::chrono::duration_cast<std::chrono::microseconds>(published.time_since_epoch()).count();
+
+    return {{"seq", seq}, {"tag", to_tag(var)}, {"ts", ts}};
+}
+
+/// @brief Returns the item which tells the controller that the agent had to drop the given count of events
+///        since its event queue ran full; it is delivered reliably in the variables list like any variable.
+inline nlohmann::json make_dropped_item(std::uint64_t seq, std::uint64_t dropped) {
+    return {{"seq", seq}, {"dropped", dropped}};
+}
+
+/// @brief The agent's side: the variables and errors already delivered, but not yet acknowledged by the
+///        controller, each in order of their sequence number. Each state variable has at most one pending
+///        item, since a newer value supersedes an older one. Not thread-safe.
+class UnackedItems {
+public:
+    /// @brief Count of pending variable items from which on no further events should be added; the state
+    ///        variables add at most one item each on top.
+    static constexpr std::size_t CAPACITY{1024};
+
+    /// @param blobs The store holding the blobs referenced by the variable items (if any), which are
+    ///        released once their item is acknowledged or superseded.
+    explicit UnackedItems(BlobStore* blobs = nullptr) : blobs(blobs) {
+    }
+
+    /// @brief Forgets everything up to the given acknowledgement.
+    /// @return True if there are items left, which were lost on the way and must be delivered again.
+    bool acknowledge(std::uint64_t ack) {
+        while (not this->var_items.empty() and this->var_items.front().seq <= ack) {
+            this->forget(this->var_items.front());
+            this->var_items.pop_front();
+        }
+        while (not this->error_items.empty() and this->error_items.front().at("seq").get<std::uint64_t>() <= ack)
+            this->error_items.pop_front();
+
+        return not this->empty();
+    }
+
+    /// @brief Returns the sequence number for the next item.
+    std::uint64_t next_seq() {
+        return this->next++;
+    }
+
+    /// @brief Adds a variable item, which must carry the sequence number returned by 'next_seq', together with
+    ///        the ids of the held blobs it references. A pending item of the same state variable is dropped.
+    void add_var(nlohmann::json item, std::vector<std::uint64_t> blob_ids = {}) {
+        VarItem added{item.at("seq").get<std::uint64_t>(), std::move(item), std::move(blob_ids)};
+        const auto var = added.item.contains("tag")
+                             ? agent_var_from_tag(added.item.at("tag").get<std::uint64_t>())
+                             : std::nullopt;
+
+        if (var.has_value() and var_info(var.value()).kind == VarKind::State) {
+            auto& pending = this->pending_states[static_cast<std::size_t>(var.value())];
+
+            if (pending != 0) {
+                const auto it = std::lower_bound(this->var_items.begin(), this->var_items.end(), pending,
+                                                 [](const VarItem& v, std::uint64_t seq) { return v.seq < seq; });
+                this->forget(*it);
+                this->var_items.erase(it);
+            }
+
+            pending = added.seq;
+        }
+
+        this->var_items.push_back(std::move(added));
+    }
+
+    /// @brief Numbers and adds an error item.
+    void add_error(nlohmann::json item) {
+        item["seq"] = this->next_seq();
+        this->error_items.push_back(std::move(item));
+    }
+
+    /// @brief Whether the given state variable has a pending item, which the next one will replace.
+    bool pending(AgentVar var) const {
+        return this->pending_states[static_cast<std::size_t>(var)] != 0;
+    }
+
+    /// @brief Whether 'CAPACITY' variable items are pending.
+    bool full() const {
+        return this->var_items.size() >= CAPACITY;
+    }
+
+    /// @brief Calls the given function with each pending variable item, e.g. to rewrite them when the
+    ///        encoding changes.
+    template <typename Function> void rewrite_vars(Function rewrite) {
+        for (auto& var_item : this->var_items)
+            rewrite(var_item.item);
+    }
+
+    /// @brief Returns the batch with all pending items.
+    nlohmann::json batch() const {
+        auto vars = nlohmann::json::array();
+        for (const auto& var_item : this->var_items)
+            vars.push_back(var_item.item);
+
+        return {{"vars", std::move(vars)}, {"errors", nlohmann::json(this->error_items)}};
+    }
+
+    std::size_t size() const {
+        return this->var_items.size() + this->error_items.size();
+    }
+
+    bool empty() const {
+        return this->var_items.empty() and this->error_items.empty();
+    }
+
+private:
+    struct VarItem {
+        std::uint64_t seq{0};
+        nlohmann::json item;
+        std::vector<std::uint64_t> blob_ids;
+    };
+
+    /// @brief Releases what is held for the given item, which is about to be removed.
+    void forget(const VarItem& var_item) {
+        for (auto& pending : this->pending_states) {
+            if (pending == var_item.seq)
+                pending = 0;
+        }
+
+        if (this->blobs != nullptr) {
+            for (const auto id : var_item.blob_ids)
+                this->blobs->release(id);
+        }
+    }
+
+    BlobStore* blobs;
+    std::uint64_t next{1};
+    std::deque<VarItem> var_items;
+    std::deque<nlohmann::json> error_items;
+    /// @brief Sequence number of the pending item of each state variable, or 0 if there is none.
+    std::array<std::uint64_t, agent_var_infos.size()> pending_states{};
+};
+
+/// @brief The controller's side: tracks the sequence numbers of the received items to skip those
+///        received before and to compute the acknowledgement. Not thread-safe.
+class ReceiveWindow {
+public:
+    /// @brief The sequence number up to which everything was received, passed as 'ack' with the next call.
+    std::uint64_t ack() const {
+        return this->received;
+    }
+
+    /// @brief To be called before the items of the next batch are received.
+    void start_batch() {
+        this->batch_start = this->received;
+        this->batch_seqs.clear();
+    }
+
+    /// @return False if the item was already received with an earlier batch and must be skipped.
+    bool receive(std::uint64_t seq) {
+        if (seq <= this->batch_start)
+            return false;
+
+        this->received = std::max(this->received, seq);
+        this->batch_seqs.push_back(seq);
+        return true;
+    }
+
+    /// @brief To be called when the batch could not be parsed completely: the agent numbers the variables
+    ///        before the errors but sends the errors first, so the items received so far may leave gaps
+    ///        below the highest one; only the unbroken run of sequence numbers above the previous
+    ///        acknowledgement is kept and acknowledged, the rest is delivered again.
+    /// @return The new acknowledgement; received items above it must be discarded.
+    std::uint64_t abort_batch() {
+        std::sort(this->batch_seqs.begin(), this->batch_seqs.end());
+
+        this->received = this->batch_start;
+        for (const auto seq : this->batch_seqs) {
+            if (seq != this->received + 1)
+                break;
+            this->received = seq;
+        }
+
+        return this->received;
+    }
+
+private:
+    std::uint64_t received{0};
+    std::uint64_t batch_start{0};
+    std::vector<std::uint64_t> batch_seqs;
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_DELIVERY_HPP
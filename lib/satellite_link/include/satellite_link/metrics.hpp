@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_METRICS_HPP
+#define SATELLITE_LINK_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace satellite_link {
+
+/// @brief Labels of a metric as pairs of name and value, e.g. {{"method", "heartbeat"}}.
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/// @brief Monotonically increasing count, e.g. of calls or bytes.
+class Counter {
+public:
+    void inc(std::uint64_t n = 1) {
+        this->value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const {
+        return this->value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> value{0};
+};
+
+/// @brief Current value of something, e.g. a queue depth.
+class Gauge {
+public:
+    void set(double value) {
+        this->value.store(value, std::memory_order_relaxed);
+    }
+
+    /// @brief Sets the gauge to the given value if it is larger, e.g. to track a maximum.
+    void set_max(double value) {
+        double current = this->value.load(std::memory_order_relaxed);
+
+        while (current < value and not this->value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            ;
+    }
+
+    double get() const {
+        return this->value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> value{0.0};
+};
+
+/// @brief Distribution of durations in fixed, roughly logarithmic buckets from 100 µs to 10 s.
+class Histogram {
+public:
+    /// @brief Upper bounds of the buckets in seconds; the last (implicit) bucket is +Inf.
+    static constexpr std::array<double, 16> BOUNDS{0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                                                   0.05,   0.1,     0.25,   0.5,   1.0,    2.5,   5.0,  10.0};
+
+    template <typename Rep, typename Period> void observe(std::chrono::duration<Rep, Period> duration) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        this->observe_ns(ns > 0 ? static_cast<std::uint64_t>(ns) : 0);
+    }
+
+    void observe_ns(std::uint64_t ns) {
+        const double seconds = ns / 1e9;
+        std::size_t bucket{0};
+
+        while (bucket < BOUNDS.size() and seconds > BOUNDS[bucket])
+            bucket++;
+
+        this->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        this->sum_ns.fetch_add(ns, std::memory_order_relaxed);
+        this->count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Count of observations in each bucket (not cumulative).
+    std::array<std::uint64_t, BOUNDS.size() + 1> get_buckets() const {
+        std::array<std::uint64_t, BOUNDS.size() + 1> rv;
+
+        for (std::size_t i = 0; i < rv.size(); i++)
+            rv[i] = this->buckets[i].load(std::memory_order_relaxed);
+
+        return rv;
+    }
+
+    std::uint64_t get_count() const {
+        return this->count.load(std::memory_order_relaxed);
+    }
+
+    double get_sum() const {
+        return this->sum_ns.load(std::memory_order_relaxed) / 1e9;
+    }
+
+    /// @brief Estimates the given quantile (e.g. 0.99) in seconds by linear interpolation within its bucket;
+    ///        0 if there are no observations. Values in the +Inf bucket are reported as the largest bound.
+    double quantile(double q) const {
+        const auto buckets = this->get_buckets();
+        std::uint64_t total{0};
+
+        for (const auto n : buckets)
+            total += n;
+
+        if (total == 0)
+            return 0.0;
+
+        const double rank = q * total;
+        std::uint64_t cumulative{0};
+
+        for (std::size_t i = 0; i < BOUNDS.size(); i++) {
+            if (cumulative + buckets[i] >= rank and buckets[i] > 0) {
+                const double lower = i > 0 ? BOUNDS[i - 1] : 0.0;
+                return lower + (BOUNDS[i] - lower) * (rank - cumulative) / buckets[i];
+            }
+            cumulative += buckets[i];
+        }
+
+        return BOUNDS.back();
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, BOUNDS.size() + 1> buckets{};
+    std::atomic<std::uint64_t> sum_ns{0};
+    std::atomic<std::uint64_t> count{0};
+};
+
+/// @brief Registry of the metrics of one side of the satellite link.
+///
+///        Looking up a metric takes a lock, so hot paths look it up once (e.g. when binding a function
+///        or per variable during init) and keep the reference, which stays valid for the lifetime of
+///        the registry; updating a metric is lock-free.
+class Metrics {
+public:
+    /// @brief 'prefix' is prepended to all metric names, e.g. "satellite_agent_".
+    explicit Metrics(std::string prefix) : prefix(std::move(prefix)) {
+    }
+
+    Counter& counter(const std::string& name, const std::string& help, const MetricLabels& labels = {}) {
+        return this->get(this->counters, name, help, labels);
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help, const MetricLabels& labels = {}) {
+        return this->get(this->gauges, name, help, labels);
+    }
+
+    /// @brief The name should end with the unit, i.e. '_seconds'.
+    Histogram& histogram(const std::string& name, const std::string& help, const MetricLabels& labels = {}) {
+        return this->get(this->histograms, name, help, labels);
+    }
+
+    /// @brief Renders all metrics in the OpenMetrics text format; 'eof' terminates the exposition, leave
+    ///        it out to append the exposition of another registry (with a different prefix).
+    std::string to_openmetrics(bool eof = true) const {
+        std::scoped_lock lock(this->guard);
+        std::string rv;
+
+        for (const auto& [name, family] : this->counters) {
+            this->header(rv, name, "counter", family.help);
+            for (const auto& [labels, counter] : family.metrics)
+                this->sample(rv, name + "_total", labels, std::to_string(counter->get()));
+        }
+
+        for (const auto& [name, family] : this->gauges) {
+            this->header(rv, name, "gauge", family.help);
+            for (const auto& [labels, gauge] : family.metrics)
+                this->sample(rv, name, labels, format_number(gauge->get()));
+        }
+
+        for (const auto& [name, family] : this->histograms) {
+            this->header(rv, name, "histogram", family.help);
+            for (const auto& [labels, histogram] : family.metrics) {
+                const auto buckets = histogram->get_buckets();
+                std::uint64_t cumulative{0};
+
+                for (std::size_t i = 0; i < buckets.size(); i++) {
+                    auto bucket_labels = labels;
+                    cumulative += buckets[i];
+                    bucket_labels.emplace_back("le", i < Histogram::BOUNDS.size()
+                                                         ? format_number(Histogram::BOUNDS[i])
+                                                         : std::string("+Inf"));
+                    this->sample(rv, name + "_bucket", bucket_labels, std::to_string(cumulative));
+                }
+
+                // a concurrent observation may already be in the buckets but not yet in the count
+                this->sample(rv, name + "_count", labels, std::to_string(cumulative));
+                this->sample(rv, name + "_sum", labels, format_number(histogram->get_sum()));
+            }
+        }
+
+        if (eof)
+            rv += "# EOF\n";
+
+        return rv;
+    }
+
+    /// @brief Writes the OpenMetrics exposition to the given file; it is replaced atomically, so that
+    ///        a reader (e.g. the textfile collector of a node exporter) never sees a partial file.
+    bool write_file(const std::string& path) const {
+        const std::string tmp_path = path + ".tmp";
+
+        {
+            std::ofstream file(tmp_path, std::ios::trunc);
+            file << this->to_openmetrics();
+            if (not file.good())
+                return false;
+        }
+
+        return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    template <typename T> struct Family {
+        std::string help;
+        std::map<MetricLabels, std::unique_ptr<T>> metrics;
+    };
+
+    template <typename T>
+    T& get(std::map<std::string, Family<T>>& families, const std::string& name, const std::string& help,
+           const MetricLabels& labels) {
+        std::scoped_lock lock(this->guard);
+
+        auto& family = families[this->prefix + name];
+        if (family.help.empty())
+            family.help = help;
+
+        auto& metric = family.metrics[labels];
+        if (not metric)
+            metric = std::make_unique<T>();
+
+        return *metric;
+    }
+
+    static std::string format_number(double value) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return buffer;
+    }
+
+    static void header(std::string& out, const std::string& name, const char* type, const std::string& help) {
+        out += "# TYPE " + name + " " + type + "\n";
+        out += "# HELP " + name + " " + help + "\n";
+    }
+
+    static void sample(std::string& out, const std::string& name, const MetricLabels& labels,
+                       const std::string& value) {
+        out += name;
+
+        if (not labels.empty()) {
+            out += '{';
+            for (std::size_t i = 0; i < labels.size(); i++) {
+                if (i > 0)
+                    out += ',';
+                out += labels[i].first + "=\"";
+                for (const char c : labels[i].second) {
+                    if (c == '\\' or c == '"')
+                        out += '\\';
+                    if (c == '\n')
+                        out += "\\n";
+                    else
+                        out += c;
+                }
+                out += '"';
+            }
+            out += '}';
+        }
+
+        out += ' ' + value + '\n';
+    }
+
+    const std::string prefix;
+
+    mutable std::mutex guard;
+    std::map<std::string, Family<Counter>> counters;
+    std::map<std::string, Family<Gauge>> gauges;
+    std::map<std::string, Family<Histogram>> histograms;
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_METRICS_HPP
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_MPSC_QUEUE_HPP
+#define SATELLITE_LINK_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace satellite_link {
+
+/// @brief Bounded, preallocated multi-producer/single-consumer queue.
+///
+/// Producers never lock nor allocate: an item is moved into a preallocated cell which is
+/// claimed with a single compare-and-swap (based on Dmitry Vyukov's bounded queue).
+/// Only one thread at a time may call 'pop'; it is up to the caller to ensure this.
+template <typename T, std::size_t Capacity> class MpscQueue {
+    static_assert(Capacity >= 2 and (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    MpscQueue() : cells(new Cell[Capacity]) {
+        for (std::size_t i = 0; i < Capacity; ++i)
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /// @brief Appends an item, safe to be called concurrently from any thread.
+    /// @return False if the queue is full; the item is dropped then.
+    bool push(T&& item) {
+        Cell* cell;
+        std::size_t pos = this->enqueue_pos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell = &this->cells[pos & (Capacity - 1)];
+            const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0) {
+                if (this->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = this->enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->item = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        // sequentially consistent on purpose, see 'empty'
+        this->count.fetch_add(1);
+
+        return true;
+    }
+
+    /// @brief Removes the oldest item, must only be called by one thread at a time.
+    /// @return False if the queue is empty.
+    bool pop(T& item) {
+        Cell* cell = &this->cells[this->dequeue_pos & (Capacity - 1)];
+        const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+        if (static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(this->dequeue_pos + 1) < 0)
+            return false;
+
+        item = std::move(cell->item);
+        cell->sequence.store(this->dequeue_pos + Capacity, std::memory_order_release);
+        this->dequeue_pos++;
+
+        this->count.fetch_sub(1);
+
+        return true;
+    }
+
+    /// @brief Returns true if no item is queued. The check is sequentially consistent with 'push',
+    ///        so that a consumer announcing its intent to sleep via another sequentially consistent
+    ///        atomic variable cannot miss an item pushed concurrently.
+    bool empty() const {
+        return this->count.load() == 0;
+    }
+
+    static constexpr std::size_t capacity() {
+        return Capacity;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T item;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(64) std::size_t dequeue_pos{0};
+    alignas(64) std::atomic<std::size_t> count{0};
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_MPSC_QUEUE_HPP
@@ -0,0 +1,456 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_PACKED_HPP
+#define SATELLITE_LINK_PACKED_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <satellite_link/blob.hpp>
+
+namespace satellite_link {
+
+/// @brief Version of the packed layouts, written as first byte of each packed value.
+constexpr std::uint8_t PACKED_FORMAT_VERSION{1};
+
+/// @brief Representations of a blob field, see 'PackedWriter::put_blob'.
+enum class PackedBlob : std::uint8_t {
+    /// @brief the original string, since it is not in canonical base64
+    Text = 0,
+    /// @brief the decoded bytes
+    Inline = 1,
+    /// @brief a reference to the decoded bytes, transferred over the blob channel
+    Ref = 2,
+};
+
+/// @brief Thrown when a packed value cannot be decoded.
+class PackedFormatError : public std::runtime_error {
+public:
+    explicit PackedFormatError(const std::string& what) : std::runtime_error("Malformed packed value: " + what) {
+    }
+};
+
+namespace detail {
+
+template <typename T> struct is_optional : std::false_type {};
+template <typename T> struct is_optional<std::optional<T>> : std::true_type {};
+
+template <typename T> bool is_present(const T& field) {
+    if constexpr (is_optional<T>::value)
+        return field.has_value();
+    else
+        return true;
+}
+
+template <typename T> const auto& value_of(const T& field) {
+    if constexpr (is_optional<T>::value)
+        return field.value();
+    else
+        return field;
+}
+
+template <typename T> auto& emplace(T& field) {
+    if constexpr (is_optional<T>::value)
+        return field.emplace();
+    else
+        return field;
+}
+
+template <typename T> void reset(T& field, const char* name) {
+    if constexpr (is_optional<T>::value)
+        field.reset();
+    else
+        throw PackedFormatError(std::string("required field '") + name + "' is missing");
+}
+
+} // namespace detail
+
+/// @brief Appends values in the packed format to a byte buffer: numbers are stored with fixed width
+///        in little endian byte order, strings and counters as LEB128 varint followed by the bytes.
+class PackedWriter {
+public:
+    explicit PackedWriter(std::vector<std::uint8_t>& buffer, BlobChannel* blobs = nullptr) :
+        buffer(buffer), blobs(blobs) {
+    }
+
+    void put_u8(std::uint8_t value) {
+        this->buffer.push_back(value);
+    }
+
+    void put_varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            this->buffer.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        this->buffer.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    void put(bool value) {
+        this->put_u8(value ? 1 : 0);
+    }
+
+    template <typename T> std::enable_if_t<std::is_arithmetic_v<T> and not std::is_same_v<T, bool>> put(T value) {
+        using Bits = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+        static_assert(sizeof(T) == 4 or sizeof(T) == 8, "only 32 and 64 bit numbers are supported");
+
+        Bits bits;
+        std::memcpy(&bits, &value, sizeof(T));
+
+        for (std::size_t i = 0; i < sizeof(T); i++)
+            this->buffer.push_back(static_cast<std::uint8_t>(bits >> (8 * i)));
+    }
+
+    void put(const std::string& value) {
+        this->put_varint(value.size());
+        this->buffer.insert(this->buffer.end(), value.begin(), value.end());
+    }
+
+    void put(const std::vector<std::uint8_t>& value) {
+        this->put_varint(value.size());
+        this->buffer.insert(this->buffer.end(), value.begin(), value.end());
+    }
+
+    /// @brief Writes a mask telling which of the given (up to 8) fields are present, followed by
+    ///        the present ones; mandatory fields are always present.
+    template <typename... Fields> void put_fields(const Fields&... fields) {
+        static_assert(sizeof...(Fields) <= 8, "the presence mask holds at most 8 fields");
+
+        std::uint8_t mask{0};
+        std::uint8_t bit{1};
+        ((mask |= detail::is_present(fields) ? bit : 0, bit <<= 1), ...);
+
+        this->put_u8(mask);
+        ((detail::is_present(fields) ? this->put(detail::value_of(fields)) : void()), ...);
+    }
+
+    /// @brief Writes a base64 encoded string (e.g. an EXI stream) as its decoded bytes, which saves a
+    ///        quarter of the size and lets the reader skip the JSON string handling. Blobs larger than
+    ///        'BLOB_INLINE_MAX_SIZE' are handed over to the blob channel, if there is one, and only the
+    ///        reference is written.
+    void put_blob(const std::string& base64) {
+        const auto size = base64_decoded_size(base64);
+
+        if (size.has_value() and size.value() > BLOB_INLINE_MAX_SIZE and this->blobs != nullptr) {
+            std::vector<std::uint8_t> bytes(size.value());
+
+            if (base64_decode(base64, bytes.data())) {
+                if (const auto ref = this->blobs->send(bytes); ref.has_value()) {
+                    this->put_u8(static_cast<std::uint8_t>(PackedBlob::Ref));
+                    this->put_varint(ref->id);
+                    this->put_varint(ref->size);
+                } else {
+                    this->put_u8(static_cast<std::uint8_t>(PackedBlob::Inline));
+                    this->put(bytes);
+                }
+                return;
+            }
+        } else if (size.has_value()) {
+            // decode right into the buffer, behind the kind and the size
+            const auto start = this->buffer.size();
+
+            this->put_u8(static_cast<std::uint8_t>(PackedBlob::Inline));
+            this->put_varint(size.value());
+
+            const auto data = this->buffer.size();
+            this->buffer.resize(data + size.value());
+
+            if (base64_decode(base64, this->buffer.data() + data))
+                return;
+
+            this->buffer.resize(start);
+        }
+
+        this->put_u8(static_cast<std::uint8_t>(PackedBlob::Text));
+        this->put(base64);
+    }
+
+private:
+    std::vector<std::uint8_t>& buffer;
+    BlobChannel* blobs;
+};
+
+/// @brief Reads values written by 'PackedWriter'; throws 'PackedFormatError' when reading beyond the end.
+class PackedReader {
+public:
+    PackedReader(const std::uint8_t* data, std::size_t size, BlobChannel* blobs = nullptr) :
+        pos(data), end(data + size), blobs(blobs) {
+    }
+
+    explicit PackedReader(const std::vector<std::uint8_t>& buffer, BlobChannel* blobs = nullptr) :
+        PackedReader(buffer.data(), buffer.size(), blobs) {
+    }
+
+    std::uint8_t get_u8() {
+        this->require(1);
+        return *this->pos++;
+    }
+
+    std::uint64_t get_varint() {
+        std::uint64_t value{0};
+
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            const std::uint8_t byte = this->get_u8();
+
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+
+        throw PackedFormatError("varint too long");
+    }
+
+    void get(bool& value) {
+        value = this->get_u8() != 0;
+    }
+
+    template <typename T> std::enable_if_t<std::is_arithmetic_v<T> and not std::is_same_v<T, bool>> get(T& value) {
+        using Bits = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+
+        this->require(sizeof(T));
+
+        Bits bits{0};
+        for (std::size_t i = 0; i < sizeof(T); i++)
+            bits |= static_cast<Bits>(this->pos[i]) << (8 * i);
+        this->pos += sizeof(T);
+
+        std::memcpy(&value, &bits, sizeof(T));
+    }
+
+    void get(std::string& value) {
+        const auto size = this->get_size();
+
+        value.assign(reinterpret_cast<const char*>(this->pos), size);
+        this->pos += size;
+    }
+
+    void get(std::vector<std::uint8_t>& value) {
+        const auto size = this->get_size();
+
+        value.assign(this->pos, this->pos + size);
+        this->pos += size;
+    }
+
+    /// @brief Counterpart of 'PackedWriter::put_fields'; the names are only used for error messages.
+    template <typename... Fields> void get_fields(const std::pair<const char*, Fields&>... fields) {
+        const std::uint8_t mask = this->get_u8();
+        std::uint8_t bit{1};
+
+        ((mask & bit ? this->get(detail::emplace(fields.second)) : detail::reset(fields.second, fields.first),
+          bit <<= 1),
+         ...);
+    }
+
+    /// @brief Counterpart of 'PackedWriter::put_blob': inline bytes are encoded right from the read
+    ///        buffer into 'base64', referenced ones are fetched from the blob channel first.
+    void get_blob(std::string& base64) {
+        switch (static_cast<PackedBlob>(this->get_u8())) {
+        case PackedBlob::Text:
+            this->get(base64);
+            return;
+
+        case PackedBlob::Inline: {
+            const auto size = this->get_size();
+
+            base64_encode(this->pos, size, base64);
+            this->pos += size;
+            return;
+        }
+
+        case PackedBlob::Ref: {
+            BlobRef ref;
+            ref.id = this->get_varint();
+            ref.size = this->get_varint();
+
+            if (this->blobs == nullptr)
+                throw PackedFormatError("blob reference without blob channel");
+
+            const auto bytes = this->blobs->receive(ref);
+            if (bytes.size() != ref.size)
+                throw PackedFormatError("blob size mismatch");
+
+            base64_encode(bytes.data(), bytes.size(), base64);
+            return;
+        }
+        }
+
+        throw PackedFormatError("unknown blob representation");
+    }
+
+    bool at_end() const {
+        return this->pos == this->end;
+    }
+
+private:
+    void require(std::size_t size) const {
+        if (static_cast<std::size_t>(this->end - this->pos) < size)
+            throw PackedFormatError("unexpected end of data");
+    }
+
+    std::size_t get_size() {
+        const auto size = this->get_varint();
+
+        this->require(size);
+        return static_cast<std::size_t>(size);
+    }
+
+    const std::uint8_t* pos;
+    const std::uint8_t* end;
+    BlobChannel* blobs;
+};
+
+/// @brief Named reference to a field, to be passed to 'PackedReader::get_fields'.
+template <typename T> std::pair<const char*, T&> field(const char* name, T& value) {
+    return {name, value};
+}
+
+/// @brief Converts a RFC 3339 timestamp in the canonical form 'YYYY-MM-DDTHH:MM:SS.sssZ', as produced by
+///        EVerest, to milliseconds since the epoch. Returns nothing for any other form, so that the caller
+///        can fall back to transport the string as is (and the original text survives the round-trip).
+inline std::optional<std::uint64_t> timestamp_to_ms(const std::string& timestamp) {
+    constexpr char layout[] = "dddd-dd-ddTdd:dd:dd.dddZ";
+
+    if (timestamp.size() != sizeof(layout) - 1)
+        return std::nullopt;
+
+    for (std::size_t i = 0; i < timestamp.size(); i++) {
+        const char c = timestamp[i];
+        if (layout[i] == 'd' ? (c < '0' or c > '9') : c != layout[i])
+            return std::nullopt;
+    }
+
+    const auto number = [&timestamp](std::size_t pos, std::size_t len) {
+        std::int64_t v{0};
+        for (std::size_t i = pos; i < pos + len; i++)
+            v = v * 10 + (timestamp[i] - '0');
+        return v;
+    };
+
+    const std::int64_t y = number(0, 4);
+    const std::int64_t m = number(5, 2);
+    const std::int64_t d = number(8, 2);
+    const std::int64_t hh = number(11, 2);
+    const std::int64_t mm = number(14, 2);
+    const std::int64_t ss = number(17, 2);
+    const std::int64_t ms = number(20, 3);
+
+    const bool leap = y % 4 == 0 and (y % 100 != 0 or y % 400 == 0);
+    const std::int64_t month_days =
+        m == 2 ? (leap ? 29 : 28) : (m == 4 or m == 6 or m == 9 or m == 11 ? 30 : 31);
+
+    // anything which would not format back to the same text is rejected
+    if (y < 1970 or m < 1 or m > 12 or d < 1 or d > month_days or hh > 23 or mm > 59 or ss > 59)
+        return std::nullopt;
+
+    // days since the epoch of the civil date, see http://howardhinnant.github.io/date_algorithms.html
+    const std::int64_t yy = m <= 2 ? y - 1 : y;
+    const std::int64_t era = yy / 400;
+    const std::int64_t yoe = yy - era * 400;
+    const std::int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const std::int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const std::int64_t days = era * 146097 + doe - 719468;
+
+    return static_cast<std::uint64_t>(((days * 24 + hh) * 60 + mm) * 60 + ss) * 1000 + ms;
+}
+
+/// @brief Formats milliseconds since the epoch as RFC 3339 timestamp 'YYYY-MM-DDTHH:MM:SS.sssZ'.
+inline std::string ms_to_timestamp(std::uint64_t timestamp_ms) {
+    const std::int64_t ms = timestamp_ms % 1000;
+    const std::int64_t secs = timestamp_ms / 1000;
+    const std::int64_t days = secs / 86400;
+    const std::int64_t sod = secs % 86400;
+
+    // civil date of the days since the epoch, see http://howardhinnant.github.io/date_algorithms.html
+    const std::int64_t z = days + 719468;
+    const std::int64_t era = z / 146097;
+    const std::int64_t doe = z - era * 146097;
+    const std::int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const std::int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const std::int64_t mp = (5 * doy + 2) / 153;
+    const std::int64_t d = doy - (153 * mp + 2) / 5 + 1;
+    const std::int64_t m = mp < 10 ? mp + 3 : mp - 9;
+    const std::int64_t y = yoe + era * 400 + (m <= 2 ? 1 : 0);
+
+    std::string rv("0000-00-00T00:00:00.000Z");
+
+    const auto put = [&rv](std::size_t pos, std::size_t len, std::int64_t v) {
+        for (std::size_t i = pos + len; i > pos; i--, v /= 10)
+            rv[i - 1] = static_cast<char>('0' + v % 10);
+    };
+
+    put(0, 4, y);
+    put(5, 2, m);
+    put(8, 2, d);
+    put(11, 2, sod / 3600);
+    put(14, 2, sod / 60 % 60);
+    put(17, 2, sod % 60);
+    put(20, 3, ms);
+
+    return rv;
+}
+
+/// @brief Fixed binary layout of a forwarded variable type, as alternative to JSON for hot variables.
+///        A specialization sets 'available' and provides:
+///        - 'pack(const T&, PackedWriter&)'
+///        - 'unpack(PackedReader&) -> T', which throws 'PackedFormatError' on malformed input
+template <typename T> struct Packed {
+    static constexpr bool available{false};
+};
+
+/// @brief Packs the given value into 'buffer', prefixed with the format version.
+template <typename T> void pack_value(const T& value, std::vector<std::uint8_t>& buffer, BlobChannel* blobs) {
+    PackedWriter writer(buffer, blobs);
+
+    buffer.reserve(64);
+    writer.put_u8(PACKED_FORMAT_VERSION);
+    Packed<T>::pack(value, writer);
+}
+
+/// @brief Counterpart of 'pack_value'; reads directly from the given bytes.
+template <typename T> T unpack_value(const std::uint8_t* data, std::size_t size, BlobChannel* blobs) {
+    PackedReader reader(data, size, blobs);
+
+    if (reader.get_u8() != PACKED_FORMAT_VERSION)
+        throw PackedFormatError("unsupported version");
+
+    return Packed<T>::unpack(reader);
+}
+
+/// @brief Converts the value of a forwarded variable for the event list: when 'packed' is set and the
+///        type has a packed layout, then it is stored as binary (transported as msgpack bin), otherwise
+///        it is converted to JSON as usual.
+template <typename T>
+nlohmann::json to_forwarded_value(const T& value, bool packed, BlobChannel* blobs = nullptr) {
+    if constexpr (Packed<T>::available) {
+        if (packed) {
+            nlohmann::json::binary_t::container_type buffer;
+            pack_value(value, buffer, blobs);
+
+            return nlohmann::json::binary(std::move(buffer));
+        }
+    }
+
+    return value;
+}
+
+/// @brief Counterpart of 'to_forwarded_value', accepts both representations.
+template <typename T> T from_forwarded_value(const nlohmann::json& value, BlobChannel* blobs = nullptr) {
+    if constexpr (Packed<T>::available) {
+        if (value.is_binary()) {
+            const auto& buffer = value.get_binary();
+            return unpack_value<T>(buffer.data(), buffer.size(), blobs);
+        }
+    }
+
+    return value.get<T>();
+}
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_PACKED_HPP
@@ -0,0 +1,320 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_PACKED_TYPES_HPP
+#define SATELLITE_LINK_PACKED_TYPES_HPP
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <nlohmann/json.hpp>
+#include <satellite_link/packed.hpp>
+
+#include <generated/types/evse_board_support.hpp>
+#include <generated/types/iso15118.hpp>
+#include <generated/types/powermeter.hpp>
+
+namespace satellite_link {
+
+/// @brief Layout:
+///        - u8: flags, bit 0 is 'relais_on'
+///        - presence mask and temperature, fan rpm, 12V and -12V supply voltage
+template <> struct Packed<types::evse_board_support::Telemetry> {
+    static constexpr bool available{true};
+
+    using Telemetry = types::evse_board_support::Telemetry;
+
+    static void pack(const Telemetry& v, PackedWriter& w) {
+        w.put_u8(v.relais_on ? 0x01 : 0x00);
+        w.put_fields(v.evse_temperature_C, v.fan_rpm, v.supply_voltage_12V, v.supply_voltage_minus_12V);
+    }
+
+    static Telemetry unpack(PackedReader& r) {
+        Telemetry v;
+
+        v.relais_on = (r.get_u8() & 0x01) != 0;
+        r.get_fields(field("evse_temperature_C", v.evse_temperature_C), field("fan_rpm", v.fan_rpm),
+                     field("supply_voltage_12V", v.supply_voltage_12V),
+                     field("supply_voltage_minus_12V", v.supply_voltage_minus_12V));
+
+        return v;
+    }
+};
+
+namespace detail {
+
+// The signed meter values and similar members are rarely set, and their presence differs between
+// EVerest releases. So they are not part of the fixed layout but transported as MessagePack map
+// (the "tail"), and each one is only touched when the Powermeter type of this release has it.
+#define SATELLITE_LINK_POWERMETER_TAIL_MEMBER(member)                                                                  \
+    struct powermeter_tail_##member {                                                                                  \
+        template <typename T, typename = void> struct exists : std::false_type {};                                    \
+        template <typename T>                                                                                          \
+        struct exists<T, std::void_t<decltype(std::declval<T&>().member)>> : std::true_type {};                        \
+                                                                                                                       \
+        template <typename T> static void pack(const T& value, nlohmann::json& tail) {                                 \
+            if constexpr (exists<T>::value) {                                                                          \
+                if (value.member.has_value())                                                                          \
+                    tail[#member] = value.member.value();                                                              \
+            }                                                                                                          \
+        }                                                                                                              \
+                                                                                                                       \
+        template <typename T> static void unpack(const nlohmann::json& tail, T& value) {                               \
+            if constexpr (exists<T>::value) {                                                                          \
+                if (const auto it = tail.find(#member); it != tail.end())                                              \
+                    value.member = it->template get<typename decltype(value.member)::value_type>();                    \
+            }                                                                                                          \
+        }                                                                                                              \
+    };
+
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(energy_Wh_import_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(energy_Wh_export_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(power_W_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(voltage_V_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(VAR_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(current_A_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(frequency_Hz_signed)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(signed_meter_value)
+SATELLITE_LINK_POWERMETER_TAIL_MEMBER(temperatures)
+
+#undef SATELLITE_LINK_POWERMETER_TAIL_MEMBER
+
+template <typename... Members> struct powermeter_tail {
+    template <typename T> static void pack(const T& value, nlohmann::json& tail) {
+        (Members::pack(value, tail), ...);
+    }
+
+    template <typename T> static void unpack(const nlohmann::json& tail, T& value) {
+        (Members::unpack(tail, value), ...);
+    }
+};
+
+using PowermeterTail =
+    powermeter_tail<powermeter_tail_energy_Wh_import_signed, powermeter_tail_energy_Wh_export_signed,
+                    powermeter_tail_power_W_signed, powermeter_tail_voltage_V_signed, powermeter_tail_VAR_signed,
+                    powermeter_tail_current_A_signed, powermeter_tail_frequency_Hz_signed,
+                    powermeter_tail_signed_meter_value, powermeter_tail_temperatures>;
+
+} // namespace detail
+
+/// @brief Layout:
+///        - varint: flags, see below
+///        - timestamp, either as varint milliseconds since the epoch or as string
+///        - meter id (string)
+///        - for each present measurand: presence mask of its phases followed by their values
+///        - tail (MessagePack encoded map) with the rarely used members, see above
+template <> struct Packed<types::powermeter::Powermeter> {
+    static constexpr bool available{true};
+
+    using Powermeter = types::powermeter::Powermeter;
+
+    /// @brief Bits of the leading flags.
+    static constexpr std::uint64_t TIMESTAMP_MS{1 << 0};
+    static constexpr std::uint64_t TIMESTAMP_STRING{1 << 1};
+    static constexpr std::uint64_t METER_ID{1 << 2};
+    static constexpr std::uint64_t PHASE_SEQ_ERROR{1 << 3};
+    static constexpr std::uint64_t PHASE_SEQ_ERROR_VALUE{1 << 4};
+    static constexpr std::uint64_t ENERGY_WH_IMPORT{1 << 5};
+    static constexpr std::uint64_t ENERGY_WH_EXPORT{1 << 6};
+    static constexpr std::uint64_t POWER_W{1 << 7};
+    static constexpr std::uint64_t VOLTAGE_V{1 << 8};
+    static constexpr std::uint64_t VAR{1 << 9};
+    static constexpr std::uint64_t CURRENT_A{1 << 10};
+    static constexpr std::uint64_t FREQUENCY_HZ{1 << 11};
+    static constexpr std::uint64_t TAIL{1 << 12};
+
+    static void pack(const Powermeter& v, PackedWriter& w) {
+        const auto timestamp_ms = timestamp_to_ms(v.timestamp);
+
+        // stays null (and does not allocate) when none of the tail members is set
+        nlohmann::json tail;
+        detail::PowermeterTail::pack(v, tail);
+
+        std::uint64_t flags = timestamp_ms.has_value() ? TIMESTAMP_MS : TIMESTAMP_STRING;
+        flags |= detail::is_present(v.meter_id) ? METER_ID : 0;
+        flags |= detail::is_present(v.phase_seq_error) ? PHASE_SEQ_ERROR : 0;
+        flags |= detail::is_present(v.phase_seq_error) and detail::value_of(v.phase_seq_error)
+                     ? PHASE_SEQ_ERROR_VALUE
+                     : 0;
+        flags |= detail::is_present(v.energy_Wh_import) ? ENERGY_WH_IMPORT : 0;
+        flags |= detail::is_present(v.energy_Wh_export) ? ENERGY_WH_EXPORT : 0;
+        flags |= detail::is_present(v.power_W) ? POWER_W : 0;
+        flags |= detail::is_present(v.voltage_V) ? VOLTAGE_V : 0;
+        flags |= detail::is_present(v.VAR) ? VAR : 0;
+        flags |= detail::is_present(v.current_A) ? CURRENT_A : 0;
+        flags |= detail::is_present(v.frequency_Hz) ? FREQUENCY_HZ : 0;
+        flags |= tail.is_null() ? 0 : TAIL;
+
+        w.put_varint(flags);
+
+        if (timestamp_ms.has_value())
+            w.put_varint(timestamp_ms.value());
+        else
+            w.put(v.timestamp);
+
+        if (flags & METER_ID)
+            w.put(detail::value_of(v.meter_id));
+
+        if (flags & ENERGY_WH_IMPORT) {
+            const auto& e = detail::value_of(v.energy_Wh_import);
+            w.put_fields(e.total, e.L1, e.L2, e.L3);
+        }
+        if (flags & ENERGY_WH_EXPORT) {
+            const auto& e = detail::value_of(v.energy_Wh_export);
+            w.put_fields(e.total, e.L1, e.L2, e.L3);
+        }
+        if (flags & POWER_W) {
+            const auto& p = detail::value_of(v.power_W);
+            w.put_fields(p.total, p.L1, p.L2, p.L3);
+        }
+        if (flags & VOLTAGE_V) {
+            const auto& u = detail::value_of(v.voltage_V);
+            w.put_fields(u.DC, u.L1, u.L2, u.L3);
+        }
+        if (flags & VAR) {
+            const auto& q = detail::value_of(v.VAR);
+            w.put_fields(q.total, q.VARphA, q.VARphB, q.VARphC);
+        }
+        if (flags & CURRENT_A) {
+            const auto& i = detail::value_of(v.current_A);
+            w.put_fields(i.DC, i.L1, i.L2, i.L3, i.N);
+        }
+        if (flags & FREQUENCY_HZ) {
+            const auto& f = detail::value_of(v.frequency_Hz);
+            w.put_fields(f.L1, f.L2, f.L3);
+        }
+
+        if (flags & TAIL) {
+            nlohmann::json::binary_t::container_type buffer;
+            nlohmann::json::to_msgpack(tail, buffer);
+            w.put(buffer);
+        }
+    }
+
+    static Powermeter unpack(PackedReader& r) {
+        Powermeter v;
+
+        const auto flags = r.get_varint();
+
+        if (flags & TIMESTAMP_MS)
+            v.timestamp = ms_to_timestamp(r.get_varint());
+        else if (flags & TIMESTAMP_STRING)
+            r.get(v.timestamp);
+        else
+            throw PackedFormatError("timestamp is missing");
+
+        if (flags & METER_ID)
+            r.get(detail::emplace(v.meter_id));
+        if (flags & PHASE_SEQ_ERROR)
+            detail::emplace(v.phase_seq_error) = (flags & PHASE_SEQ_ERROR_VALUE) != 0;
+
+        // throws if the imported energy is mandatory in this release
+        if (flags & ENERGY_WH_IMPORT) {
+            auto& e = detail::emplace(v.energy_Wh_import);
+            r.get_fields(field("total", e.total), field("L1", e.L1), field("L2", e.L2), field("L3", e.L3));
+        } else {
+            detail::reset(v.energy_Wh_import, "energy_Wh_import");
+        }
+        if (flags & ENERGY_WH_EXPORT) {
+            auto& e = detail::emplace(v.energy_Wh_export);
+            r.get_fields(field("total", e.total), field("L1", e.L1), field("L2", e.L2), field("L3", e.L3));
+        }
+        if (flags & POWER_W) {
+            auto& p = detail::emplace(v.power_W);
+            r.get_fields(field("total", p.total), field("L1", p.L1), field("L2", p.L2), field("L3", p.L3));
+        }
+        if (flags & VOLTAGE_V) {
+            auto& u = detail::emplace(v.voltage_V);
+            r.get_fields(field("DC", u.DC), field("L1", u.L1), field("L2", u.L2), field("L3", u.L3));
+        }
+        if (flags & VAR) {
+            auto& q = detail::emplace(v.VAR);
+            r.get_fields(field("total", q.total), field("VARphA", q.VARphA), field("VARphB", q.VARphB),
+                         field("VARphC", q.VARphC));
+        }
+        if (flags & CURRENT_A) {
+            auto& i = detail::emplace(v.current_A);
+            r.get_fields(field("DC", i.DC), field("L1", i.L1), field("L2", i.L2), field("L3", i.L3),
+                         field("N", i.N));
+        }
+        if (flags & FREQUENCY_HZ) {
+            auto& f = detail::emplace(v.frequency_Hz);
+            r.get_fields(field("L1", f.L1), field("L2", f.L2), field("L3", f.L3));
+        }
+
+        if (flags & TAIL) {
+            nlohmann::json::binary_t::container_type buffer;
+            r.get(buffer);
+            detail::PowermeterTail::unpack(nlohmann::json::from_msgpack(buffer), v);
+        }
+
+        return v;
+    }
+};
+
+/// @brief Layout:
+///        - certificate action (string)
+///        - ISO 15118 schema version (string)
+///        - EXI request as blob
+template <> struct Packed<types::iso15118::RequestExiStreamSchema> {
+    static constexpr bool available{true};
+
+    using RequestExiStreamSchema = types::iso15118::RequestExiStreamSchema;
+
+    static void pack(const RequestExiStreamSchema& v, PackedWriter& w) {
+        w.put(types::iso15118::certificate_action_enum_to_string(v.certificate_action));
+        w.put(v.iso15118_schema_version);
+        w.put_blob(v.exi_request);
+    }
+
+    static RequestExiStreamSchema unpack(PackedReader& r) {
+        RequestExiStreamSchema v;
+        std::string certificate_action;
+
+        r.get(certificate_action);
+        v.certificate_action = types::iso15118::string_to_certificate_action_enum(certificate_action);
+        r.get(v.iso15118_schema_version);
+        r.get_blob(v.exi_request);
+
+        return v;
+    }
+};
+
+/// @brief Layout:
+///        - status (string)
+///        - certificate action (string)
+///        - u8: 1 if the EXI response is present, followed by it as blob
+template <> struct Packed<types::iso15118::ResponseExiStreamStatus> {
+    static constexpr bool available{true};
+
+    using ResponseExiStreamStatus = types::iso15118::ResponseExiStreamStatus;
+
+    static void pack(const ResponseExiStreamStatus& v, PackedWriter& w) {
+        w.put(types::iso15118::status_to_string(v.status));
+        w.put(types::iso15118::certificate_action_enum_to_string(v.certificate_action));
+        w.put(v.exi_response.has_value());
+        if (v.exi_response.has_value())
+            w.put_blob(v.exi_response.value());
+    }
+
+    static ResponseExiStreamStatus unpack(PackedReader& r) {
+        ResponseExiStreamStatus v;
+        std::string s;
+
+        r.get(s);
+        v.status = types::iso15118::string_to_status(s);
+        r.get(s);
+        v.certificate_action = types::iso15118::string_to_certificate_action_enum(s);
+
+        bool exi_response{false};
+        r.get(exi_response);
+        if (exi_response)
+            r.get_blob(v.exi_response.emplace());
+
+        return v;
+    }
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_PACKED_TYPES_HPP
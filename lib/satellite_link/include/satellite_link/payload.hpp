@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_PAYLOAD_HPP
+#define SATELLITE_LINK_PAYLOAD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <rpc/msgpack.hpp>
+#include <nlohmann/json.hpp>
+#include <satellite_link/compression.hpp>
+
+namespace satellite_link {
+
+/// @brief Encodings which can be used for structured payloads on the satellite RPC link.
+enum class PayloadEncoding {
+    /// @brief JSON text, transported as msgpack string (legacy behavior)
+    Json,
+    /// @brief MessagePack, transported as msgpack binary; avoids JSON text formatting and parsing
+    MsgPack,
+};
+
+inline std::string payload_encoding_to_string(PayloadEncoding encoding) {
+    switch (encoding) {
+    case PayloadEncoding::Json:
+        return "json";
+    case PayloadEncoding::MsgPack:
+        return "msgpack";
+    }
+
+    throw std::out_of_range("No known string conversion for provided enum of type PayloadEncoding");
+}
+
+inline PayloadEncoding string_to_payload_encoding(const std::string& s) {
+    if (s == "json")
+        return PayloadEncoding::Json;
+    if (s == "msgpack")
+        return PayloadEncoding::MsgPack;
+
+    throw std::out_of_range("Provided string " + s + " could not be converted to enum of type PayloadEncoding");
+}
+
+/// @brief A structured value in its wire representation, ready to be passed as argument
+///        or return value of an RPC call. The type of the msgpack object used on the wire
+///        tells the receiver how to decode it, so only the sender has to know the encoding.
+struct Payload {
+    /// @brief The encoded bytes.
+    std::string data;
+    /// @brief True when 'data' holds MessagePack (sent as msgpack bin), false for JSON text (sent as msgpack str).
+    bool binary{false};
+    /// @brief When not 'None', then 'data' holds the compressed bytes, and it is sent as msgpack ext
+    ///        with the codec as type; the body starts with 'binary' (u8) and 'uncompressed_size' (u32 LE).
+    Compression compression{Compression::None};
+    /// @brief Size of the encoded value before compression.
+    std::uint32_t uncompressed_size{0};
+};
+
+/// @brief Size of the header in front of the compressed bytes in the msgpack ext body.
+constexpr std::uint32_t COMPRESSED_PAYLOAD_HEADER_SIZE{5};
+
+namespace detail {
+
+inline void put_compressed_payload_header(char* header, const Payload& payload) {
+    header[0] = payload.binary ? 1 : 0;
+    for (int i = 0; i < 4; i++)
+        header[1 + i] = static_cast<char>(payload.uncompressed_size >> (8 * i));
+}
+
+} // namespace detail
+
+/// @brief Encodes the given value using the given encoding.
+inline Payload encode(const nlohmann::json& value, PayloadEncoding encoding) {
+    Payload rv;
+
+    if (encoding == PayloadEncoding::MsgPack) {
+        nlohmann::json::to_msgpack(value, rv.data);
+        rv.binary = true;
+    } else {
+        rv.data = value.dump();
+    }
+
+    return rv;
+}
+
+/// @brief Compresses the payload with the given codec if it is at least 'threshold' bytes large;
+///        it is left as is if it is smaller or does not shrink.
+inline void compress(Payload& payload, Compression compression, std::size_t threshold) {
+    std::string compressed;
+
+    if (payload.compression != Compression::None or payload.data.size() < threshold or
+        not compress(compression, payload.data, compressed))
+        return;
+
+    payload.uncompressed_size = static_cast<std::uint32_t>(payload.data.size());
+    payload.data = std::move(compressed);
+    payload.compression = compression;
+}
+
+namespace detail {
+
+/// @brief Calls 'f(first, last, binary)' with the encoded bytes of a received payload, decompressing it
+///        if needed; 'binary' tells whether the bytes are MessagePack or JSON text.
+template <typename F> auto with_encoded_bytes(const RPCLIB_MSGPACK::object& o, F&& f) {
+    switch (o.type) {
+    case RPCLIB_MSGPACK::type::STR:
+        return f(o.via.str.ptr, o.via.str.ptr + o.via.str.size, false);
+    case RPCLIB_MSGPACK::type::BIN:
+        return f(o.via.bin.ptr, o.via.bin.ptr + o.via.bin.size, true);
+    case RPCLIB_MSGPACK::type::EXT: {
+        const auto* body = reinterpret_cast<const unsigned char*>(o.via.ext.data());
+
+        if (o.via.ext.size < COMPRESSED_PAYLOAD_HEADER_SIZE)
+            throw RPCLIB_MSGPACK::type_error();
+
+        const bool binary = body[0] != 0;
+        const std::size_t size = body[1] | body[2] << 8 | body[3] << 16 | static_cast<std::size_t>(body[4]) << 24;
+        const std::string data = decompress(static_cast<Compression>(o.via.ext.type()),
+                                            o.via.ext.data() + COMPRESSED_PAYLOAD_HEADER_SIZE,
+                                            o.via.ext.size - COMPRESSED_PAYLOAD_HEADER_SIZE, size);
+
+        return f(data.data(), data.data() + data.size(), binary);
+    }
+    default:
+        throw RPCLIB_MSGPACK::type_error();
+    }
+}
+
+} // namespace detail
+
+/// @brief Decodes a value received as RPC argument or return value. Both encodings are accepted,
+///        compressed or not.
+inline nlohmann::json decode(const RPCLIB_MSGPACK::object& o) {
+    return detail::with_encoded_bytes(o, [](const char* first, const char* last, bool binary) {
+        return binary ? nlohmann::json::from_msgpack(first, last) : nlohmann::json::parse(first, last);
+    });
+}
+
+/// @brief Like 'decode', but feeds the value into the given SAX handler instead of building it as a whole.
+///        Throws std::runtime_error in case of a parse error.
+template <typename SAX> void decode(const RPCLIB_MSGPACK::object& o, SAX& sax) {
+    const bool ok = detail::with_encoded_bytes(o, [&sax](const char* first, const char* last, bool binary) {
+        return nlohmann::json::sax_parse(first, last, &sax,
+                                         binary ? nlohmann::json::input_format_t::msgpack
+                                                : nlohmann::json::input_format_t::json);
+    });
+
+    if (not ok)
+        throw std::runtime_error("Could not parse payload");
+}
+
+/// @brief Size of a value received as RPC argument or return value as it was transferred, i.e. after
+///        compression; 0 if it is not a payload.
+inline std::size_t wire_size(const RPCLIB_MSGPACK::object& o) {
+    switch (o.type) {
+    case RPCLIB_MSGPACK::type::STR:
+        return o.via.str.size;
+    case RPCLIB_MSGPACK::type::BIN:
+        return o.via.bin.size;
+    case RPCLIB_MSGPACK::type::EXT:
+        return o.via.ext.size;
+    default:
+        return 0;
+    }
+}
+
+} // namespace satellite_link
+
+namespace RPCLIB_MSGPACK {
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+namespace adaptor {
+
+// used when a Payload is passed as argument of an RPC call
+template <> struct pack<satellite_link::Payload> {
+    template <typename Stream>
+    packer<Stream>& operator()(packer<Stream>& o, const satellite_link::Payload& v) const {
+        const auto size = static_cast<uint32_t>(v.data.size());
+
+        if (v.compression != satellite_link::Compression::None) {
+            char header[satellite_link::COMPRESSED_PAYLOAD_HEADER_SIZE];
+            satellite_link::detail::put_compressed_payload_header(header, v);
+
+            o.pack_ext(sizeof(header) + size, static_cast<int8_t>(v.compression));
+            o.pack_ext_body(header, sizeof(header));
+            o.pack_ext_body(v.data.data(), size);
+        } else if (v.binary) {
+            o.pack_bin(size);
+            o.pack_bin_body(v.data.data(), size);
+        } else {
+            o.pack_str(size);
+            o.pack_str_body(v.data.data(), size);
+        }
+
+        return o;
+    }
+};
+
+// used when a Payload is returned by an RPC handler
+template <> struct object_with_zone<satellite_link::Payload> {
+    void operator()(RPCLIB_MSGPACK::object::with_zone& o, const satellite_link::Payload& v) const {
+        const auto size = static_cast<uint32_t>(v.data.size());
+
+        if (v.compression != satellite_link::Compression::None) {
+            // the ext object starts with the type, followed by the body
+            const uint32_t body_size = satellite_link::COMPRESSED_PAYLOAD_HEADER_SIZE + size;
+            char* ptr = static_cast<char*>(o.zone.allocate_align(1 + body_size));
+
+            ptr[0] = static_cast<char>(v.compression);
+            satellite_link::detail::put_compressed_payload_header(ptr + 1, v);
+            std::memcpy(ptr + 1 + satellite_link::COMPRESSED_PAYLOAD_HEADER_SIZE, v.data.data(), size);
+
+            o.type = RPCLIB_MSGPACK::type::EXT;
+            o.via.ext.ptr = ptr;
+            o.via.ext.size = body_size;
+            return;
+        }
+
+        char* ptr = static_cast<char*>(o.zone.allocate_align(size));
+
+        std::memcpy(ptr, v.data.data(), size);
+
+        if (v.binary) {
+            o.type = RPCLIB_MSGPACK::type::BIN;
+            o.via.bin.ptr = ptr;
+            o.via.bin.size = size;
+        } else {
+            o.type = RPCLIB_MSGPACK::type::STR;
+            o.via.str.ptr = ptr;
+            o.via.str.size = size;
+        }
+    }
+};
+
+} // namespace adaptor
+} // MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS)
+} // namespace RPCLIB_MSGPACK
+
+#endif // SATELLITE_LINK_PAYLOAD_HPP
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_PROTOCOL_HPP
+#define SATELLITE_LINK_PROTOCOL_HPP
+
+namespace satellite_link {
+
+/// @brief Version of the RPC protocol between SatelliteController and SatelliteAgent, exchanged in
+///        'link_setup'; both sides refuse the link if it differs. It must be increased with each
+///        incompatible change of the signatures or semantics of the RPC functions.
+///
+///        1: the original protocol, without 'link_setup' and with "retrieve_vars_and_errors"
+///           taking no arguments
+///        2: - "link_setup" negotiates the encodings and checks the protocol version and the tunnel tables;
+///             a new SatelliteController restarts the delta encoding and the numbering of notifications
+///           - "retrieve_vars_and_errors" takes 'max_wait_ms' (long-poll) and 'ack' (acknowledgement), and
+///             each returned item carries a sequence number ('seq'); the variables list may contain a
+///             "dropped" item with the count of events the agent had to drop
+///           - commands take a TraceContext as first argument, notifications their sequence number before it
+///           - "heartbeat" keeps the agent's watchdog alive and measures round trip time and clock offset
+///           - "store_blob_chunk" and "retrieve_blob_chunk" transfer blobs too large to be sent inline
+constexpr int PROTOCOL_VERSION{2};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_PROTOCOL_HPP
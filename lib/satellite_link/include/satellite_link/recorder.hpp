@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_RECORDER_HPP
+#define SATELLITE_LINK_RECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <rpc/msgpack.hpp>
+
+namespace satellite_link {
+
+/// @brief First bytes of a traffic recording; the last one is the version of the format.
+constexpr char RECORDING_MAGIC[8]{'S', 'L', 'R', 'E', 'C', '\0', '\0', '\1'};
+/// @brief Upper limit for the size of a recording, no further records are written beyond.
+constexpr std::size_t RECORDING_MAX_SIZE{256 * 1024 * 1024};
+/// @brief Interval in which the recording is flushed, so that it is usable if the process is killed.
+constexpr std::chrono::seconds RECORDING_FLUSH_INTERVAL{1};
+
+/// @brief Types of the records of a traffic recording. The values are written to the file, so they
+///        must not change.
+enum class RecordType : std::uint8_t {
+    /// @brief [type, version, side, wall clock time in µs], the first record of each recording
+    Header = 0,
+    /// @brief [type, time, id, method, args], a call of the SatelliteController awaiting a result
+    Call = 1,
+    /// @brief [type, time, id, method, args], a call without result (rpclib's 'send')
+    Notification = 2,
+    /// @brief [type, time, id, result], the result of the call with the same id
+    Result = 3,
+    /// @brief [type, time, id, message], the call with the same id failed or timed out
+    Error = 4,
+};
+
+/// @brief Records all traffic of one side of the satellite link to an append-only file: each call with
+///        its arguments, and its result or error, with the time in microseconds since the start of the
+///        recording. The records are MessagePack arrays (see 'RecordType'), and the arguments and results
+///        are kept as they are on the wire, e.g. batches of variables stay compressed. So a recording is
+///        compact, and it can drive either side of the link again (see benchmarks/replay_tool.cpp).
+///
+///        All methods are cheap no-ops while the recorder is disabled; calls get id 0 then.
+class TrafficRecorder {
+public:
+    /// @brief Opens the given file and enables the recorder; 'side' names the recording module.
+    ///        Returns false if the file cannot be opened.
+    bool open(const std::string& path, const std::string& side) {
+        std::scoped_lock lock(this->guard);
+
+        this->file.open(path, std::ios::binary | std::ios::trunc);
+        if (not this->file.good())
+            return false;
+
+        this->start = std::chrono::steady_clock::now();
+        this->last_flush = this->start;
+        this->file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+        this->written = sizeof(RECORDING_MAGIC);
+
+        RPCLIB_MSGPACK::sbuffer buffer;
+        RPCLIB_MSGPACK::packer<RPCLIB_MSGPACK::sbuffer> packer(buffer);
+        packer.pack_array(4);
+        packer.pack(static_cast<std::uint8_t>(RecordType::Header));
+        packer.pack(static_cast<std::uint8_t>(RECORDING_MAGIC[7]));
+        packer.pack(side);
+        packer.pack(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count());
+        this->write(buffer);
+        this->file.flush();
+        this->enabled = true;
+
+        return true;
+    }
+
+    bool is_enabled() const {
+        return this->enabled.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Records a call with the given arguments (as they are passed to rpclib); returns the id to
+    ///        record its result or error with.
+    template <typename... Args> std::uint64_t call(const std::string& method, const Args&... args) {
+        return this->record_call(RecordType::Call, method, args...);
+    }
+
+    /// @brief Records a call without result.
+    template <typename... Args> void notification(const std::string& method, const Args&... args) {
+        this->record_call(RecordType::Notification, method, args...);
+    }
+
+    /// @brief Records the result of the call with the given id, as received or as returned to rpclib.
+    template <typename T> void result(std::uint64_t id, const T& value) {
+        if (id == 0 or not this->is_enabled())
+            return;
+
+        this->record(RecordType::Result, id, [&value](auto& packer) { packer.pack(value); });
+    }
+
+    /// @brief Records the result of a call with the given id which has no result (a void function).
+    void result(std::uint64_t id) {
+        if (id == 0 or not this->is_enabled())
+            return;
+
+        this->record(RecordType::Result, id, [](auto& packer) { packer.pack_nil(); });
+    }
+
+    /// @brief Records that the call with the given id failed or timed out.
+    void error(std::uint64_t id, const std::string& message) {
+        if (id == 0 or not this->is_enabled())
+            return;
+
+        this->record(RecordType::Error, id, [&message](auto& packer) { packer.pack(message); });
+    }
+
+private:
+    template <typename... Args>
+    std::uint64_t record_call(RecordType type, const std::string& method, const Args&... args) {
+        if (not this->is_enabled())
+            return 0;
+
+        const std::uint64_t id = this->next_id++;
+        this->record(type, id, [&method, &args...](auto& packer) {
+            packer.pack(method);
+            packer.pack(std::forward_as_tuple(args...));
+        });
+
+        return id;
+    }
+
+    /// @brief Writes a record of the given type; 'pack_body' packs its elements following the id.
+    template <typename F> void record(RecordType type, std::uint64_t id, F&& pack_body) {
+        // packed before taking the lock, so that concurrent calls only wait for the write
+        const auto time_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - this->start)
+                .count();
+        const bool call = type == RecordType::Call or type == RecordType::Notification;
+
+        RPCLIB_MSGPACK::sbuffer buffer;
+        RPCLIB_MSGPACK::packer<RPCLIB_MSGPACK::sbuffer> packer(buffer);
+        packer.pack_array(call ? 5 : 4);
+        packer.pack(static_cast<std::uint8_t>(type));
+        packer.pack(time_us);
+        packer.pack(id);
+        pack_body(packer);
+
+        std::scoped_lock lock(this->guard);
+        this->write(buffer);
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - this->last_flush >= RECORDING_FLUSH_INTERVAL) {
+            this->file.flush();
+            this->last_flush = now;
+        }
+    }
+
+    /// @brief Appends a record to the file; expects 'guard' to be held.
+    void write(const RPCLIB_MSGPACK::sbuffer& buffer) {
+        if (this->written + buffer.size() > RECORDING_MAX_SIZE) {
+            this->enabled = false;
+            this->file.flush();
+            return;
+        }
+
+        this->file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        this->written += buffer.size();
+    }
+
+    std::atomic_bool enabled{false};
+    std::atomic<std::uint64_t> next_id{1};
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex guard;
+    std::ofstream file;
+    std::size_t written{0};
+    std::chrono::steady_clock::time_point last_flush;
+};
+
+/// @brief A record read from a traffic recording.
+struct Record {
+    RecordType type{RecordType::Header};
+    /// @brief Time in microseconds since the start of the recording.
+    std::int64_t time_us{0};
+    std::uint64_t id{0};
+    /// @brief For calls and notifications the called method, for the header the recording side.
+    std::string method;
+    /// @brief The whole record, which owns the memory of 'body'.
+    RPCLIB_MSGPACK::object_handle handle;
+
+    /// @brief The arguments of a call or notification (an array), the result of a call, or the message
+    ///        of an error.
+    const RPCLIB_MSGPACK::object& body() const {
+        const auto& record = this->handle.get().via.array;
+        return record.ptr[record.size - 1];
+    }
+};
+
+/// @brief Reads the records of a traffic recording one after another.
+class RecordingReader {
+public:
+    /// @brief Opens the given recording; throws std::runtime_error if it cannot be opened or is not a
+    ///        recording of a supported version.
+    explicit RecordingReader(const std::string& path) : file(path, std::ios::binary) {
+        char magic[sizeof(RECORDING_MAGIC)];
+
+        if (not this->file.read(magic, sizeof(magic)))
+            throw std::runtime_error("Cannot read " + path);
+        if (std::memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0)
+            throw std::runtime_error(path + " is not a traffic recording of a supported version");
+    }
+
+    /// @brief Returns the next record, or nothing at the end of the recording. A truncated last record
+    ///        (e.g. since the process was killed) is treated as end; throws std::runtime_error if a
+    ///        record is malformed.
+    std::optional<Record> next() {
+        RPCLIB_MSGPACK::object_handle handle;
+
+        while (not this->unpacker.next(handle)) {
+            if (this->file.eof())
+                return std::nullopt;
+
+            this->unpacker.reserve_buffer(READ_SIZE);
+            this->file.read(this->unpacker.buffer(), READ_SIZE);
+            this->unpacker.buffer_consumed(static_cast<std::size_t>(this->file.gcount()));
+        }
+
+        const auto& o = handle.get();
+        if (o.type != RPCLIB_MSGPACK::type::ARRAY or o.via.array.size < 4)
+            throw std::runtime_error("Malformed record");
+
+        Record record;
+        const auto* items = o.via.array.ptr;
+        record.type = static_cast<RecordType>(items[0].as<std::uint8_t>());
+
+        if (record.type == RecordType::Header) {
+            record.method = items[2].as<std::string>();
+        } else {
+            record.time_us = items[1].as<std::int64_t>();
+            record.id = items[2].as<std::uint64_t>();
+
+            if (record.type == RecordType::Call or record.type == RecordType::Notification) {
+                if (o.via.array.size != 5 or items[4].type != RPCLIB_MSGPACK::type::ARRAY)
+                    throw std::runtime_error("Malformed call record");
+                record.method = items[3].as<std::string>();
+            }
+        }
+
+        record.handle = std::move(handle);
+
+        return record;
+    }
+
+private:
+    static constexpr std::size_t READ_SIZE{64 * 1024};
+
+    std::ifstream file;
+    RPCLIB_MSGPACK::unpacker unpacker;
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_RECORDER_HPP
@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_TRACE_HPP
+#define SATELLITE_LINK_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <nlohmann/json.hpp>
+#include <rpc/msgpack.hpp>
+
+namespace satellite_link {
+
+/// @brief Upper limit for the size of a trace file, no further spans are written beyond.
+constexpr std::size_t TRACE_FILE_MAX_SIZE{64 * 1024 * 1024};
+/// @brief Interval in which the trace file is flushed, so that it can be inspected while running.
+constexpr std::chrono::seconds TRACE_FLUSH_INTERVAL{1};
+
+/// @brief Identifies a span of a trace; passed over the link along with commands, notifications and
+///        forwarded variables and errors, so that the spans of both sides can be correlated.
+///        A trace id of 0 means that there is no trace (e.g. since tracing is disabled on the sender).
+struct TraceContext {
+    std::uint64_t trace_id{0};
+    std::uint64_t span_id{0};
+
+    bool valid() const {
+        return this->trace_id != 0;
+    }
+
+    /// @brief Representation within the JSON items of a batch: [trace_id, span_id].
+    nlohmann::json to_json() const {
+        return nlohmann::json::array({this->trace_id, this->span_id});
+    }
+
+    /// @brief Reads the representation written by 'to_json'; anything else yields an invalid context.
+    static TraceContext from_json(const nlohmann::json& j) {
+        if (not j.is_array() or j.size() != 2 or not j[0].is_number_unsigned() or not j[1].is_number_unsigned())
+            return {};
+
+        return {j[0].get<std::uint64_t>(), j[1].get<std::uint64_t>()};
+    }
+};
+
+/// @brief Writes spans as Chrome trace events (JSON array format), which can be opened with Perfetto
+///        or chrome://tracing. Spans are written as async events, so that overlapping spans (e.g.
+///        concurrent commands) are displayed correctly. The closing bracket of the array is optional
+///        in this format, so the file is valid after each flush, even if the process is killed.
+///
+///        The timestamps are taken from the wall clock, so that the files of both sides of the link can
+///        be merged; the SatelliteController records the measured clock offset of the SatelliteAgent
+///        as counter, which tells how to shift the timestamps of the SatelliteAgent's file.
+class Tracer {
+public:
+    using Clock = std::chrono::system_clock;
+
+    /// @brief Opens the given file and enables the tracer; returns false if the file cannot be opened.
+    bool open(const std::string& path, const std::string& process_name) {
+        std::scoped_lock lock(this->guard);
+
+        this->file.open(path, std::ios::trunc);
+        if (not this->file.good())
+            return false;
+
+        std::random_device random;
+        this->next_id = (static_cast<std::uint64_t>(random()) << 32) | random();
+
+        this->file << "[\n";
+        this->write(nlohmann::json{{"name", "process_name"},
+                                   {"ph", "M"},
+                                   {"pid", PID},
+                                   {"args", {{"name", process_name}}}});
+        this->file.flush();
+        this->last_flush = std::chrono::steady_clock::now();
+        this->enabled = true;
+
+        return true;
+    }
+
+    bool is_enabled() const {
+        return this->enabled.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Returns the context of a new span: a child of the given one if it is valid, otherwise the
+    ///        root of a new trace. Returns an invalid context if tracing is disabled.
+    TraceContext start(const TraceContext& parent = {}) {
+        if (not this->is_enabled())
+            return {};
+
+        return {parent.valid() ? parent.trace_id : this->new_id(), this->new_id()};
+    }
+
+    /// @brief Records the given span; nothing happens if 'span' is invalid.
+    void record(const std::string& name, const char* category, const TraceContext& span,
+                const TraceContext& parent, Clock::time_point start, Clock::time_point end) {
+        if (not span.valid() or not this->is_enabled())
+            return;
+
+        nlohmann::json args{{"trace_id", to_hex(span.trace_id)}, {"span_id", to_hex(span.span_id)}};
+        if (parent.valid())
+            args["parent_id"] = to_hex(parent.span_id);
+
+        const auto id = to_hex(span.span_id);
+
+        std::scoped_lock lock(this->guard);
+        this->write({{"name", name}, {"cat", category}, {"ph", "b"}, {"id", id}, {"pid", PID},
+                     {"ts", to_us(start)}, {"args", std::move(args)}});
+        this->write({{"name", name}, {"cat", category}, {"ph", "e"}, {"id", id}, {"pid", PID},
+                     {"ts", to_us(end)}});
+        this->flush_if_due();
+    }
+
+    /// @brief Records the current value of a counter, e.g. the clock offset of the peer.
+    void counter(const std::string& name, double value) {
+        if (not this->is_enabled())
+            return;
+
+        std::scoped_lock lock(this->guard);
+        this->write({{"name", name}, {"ph", "C"}, {"pid", PID}, {"ts", to_us(Clock::now())},
+                     {"args", {{"value", value}}}});
+        this->flush_if_due();
+    }
+
+private:
+    /// @brief Each side writes its own file, so they all use the same process id; it is named by a
+    ///        metadata event.
+    static constexpr int PID{1};
+
+    static std::int64_t to_us(Clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+    }
+
+    static std::string to_hex(std::uint64_t id) {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(id));
+        return buffer;
+    }
+
+    /// @brief Returns a new, practically unique id; the counter is scrambled with SplitMix64, so that
+    ///        the ids of both sides don't collide.
+    std::uint64_t new_id() {
+        std::uint64_t z = this->next_id.fetch_add(0x9e3779b97f4a7c15, std::memory_order_relaxed);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        z ^= z >> 31;
+
+        return z != 0 ? z : 1;
+    }
+
+    /// @brief Appends an event to the file; expects 'guard' to be held.
+    void write(const nlohmann::json& event) {
+        const std::string line = event.dump() + ",\n";
+
+        if (this->written + line.size() > TRACE_FILE_MAX_SIZE) {
+            this->enabled = false;
+            this->file.flush();
+            return;
+        }
+
+        this->file << line;
+        this->written += line.size();
+    }
+
+    /// @brief Flushes the file once per interval; expects 'guard' to be held.
+    void flush_if_due() {
+        const auto now = std::chrono::steady_clock::now();
+
+        if (now - this->last_flush >= TRACE_FLUSH_INTERVAL) {
+            this->file.flush();
+            this->last_flush = now;
+        }
+    }
+
+    std::atomic_bool enabled{false};
+    std::atomic<std::uint64_t> next_id{0};
+
+    std::mutex guard;
+    std::ofstream file;
+    std::size_t written{0};
+    std::chrono::steady_clock::time_point last_flush;
+};
+
+/// @brief Scoped span: it is started on construction and recorded when it goes out of scope.
+class Span {
+public:
+    Span(Tracer& tracer, const char* name, const char* category, const TraceContext& parent = {}) :
+        tracer(tracer), parent(parent), span(tracer.start(parent)), name(span.valid() ? name : ""),
+        category(category), start_time(Tracer::Clock::now()) {
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span() {
+        this->tracer.record(this->name, this->category, this->span, this->parent, this->start_time,
+                            Tracer::Clock::now());
+    }
+
+    /// @brief The context to pass to the peer, so that its spans become children of this one.
+    const TraceContext& context() const {
+        return this->span;
+    }
+
+private:
+    Tracer& tracer;
+    const TraceContext parent;
+    const TraceContext span;
+    const std::string name;
+    const char* category;
+    const Tracer::Clock::time_point start_time;
+};
+
+} // namespace satellite_link
+
+namespace RPCLIB_MSGPACK {
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+namespace adaptor {
+
+// passed as nil if there is no trace, so that it costs a single byte then
+template <> struct pack<satellite_link::TraceContext> {
+    template <typename Stream>
+    packer<Stream>& operator()(packer<Stream>& o, const satellite_link::TraceContext& v) const {
+        if (not v.valid()) {
+            o.pack_nil();
+            return o;
+        }
+
+        o.pack_array(2);
+        o.pack(v.trace_id);
+        o.pack(v.span_id);
+
+        return o;
+    }
+};
+
+template <> struct convert<satellite_link::TraceContext> {
+    const RPCLIB_MSGPACK::object& operator()(const RPCLIB_MSGPACK::object& o,
+                                             satellite_link::TraceContext& v) const {
+        v = {};
+
+        if (o.type == RPCLIB_MSGPACK::type::NIL)
+            return o;
+        if (o.type != RPCLIB_MSGPACK::type::ARRAY or o.via.array.size != 2)
+            throw RPCLIB_MSGPACK::type_error();
+
+        v.trace_id = o.via.array.ptr[0].as<std::uint64_t>();
+        v.span_id = o.via.array.ptr[1].as<std::uint64_t>();
+
+        return o;
+    }
+};
+
+} // namespace adaptor
+} // MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS)
+} // namespace RPCLIB_MSGPACK
+
+#endif // SATELLITE_LINK_TRACE_HPP
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_VAR_QUEUE_HPP
+#define SATELLITE_LINK_VAR_QUEUE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <satellite_link/mpsc_queue.hpp>
+#include <satellite_link/vars.hpp>
+
+namespace satellite_link {
+
+/// @brief A published value of a forwarded variable, waiting for its delivery.
+struct VarEvent {
+    AgentVar var{AgentVar::AuthTokenProviderProvidedToken};
+    /// @brief Stamp in order of publication, used to forward events and states in the original order.
+    std::uint64_t order{0};
+    /// @brief When the value was published in EVerest.
+    std::chrono::steady_clock::time_point published;
+    AgentVarValue value;
+};
+
+/// @brief Holds the latest, not yet forwarded value of a variable of kind 'VarKind::State'.
+///        Lock-free: the publishing thread swaps in the new event, replacing a pending one, and the
+///        draining thread swaps it out, so neither of them ever waits for the other.
+class VarSlot {
+public:
+    VarSlot() = default;
+    VarSlot(const VarSlot&) = delete;
+    VarSlot& operator=(const VarSlot&) = delete;
+
+    ~VarSlot() {
+        delete this->pending.load();
+    }
+
+    /// @brief Stores the given event, dropping the pending one (if any).
+    void put(std::unique_ptr<VarEvent> event) {
+        std::unique_ptr<VarEvent> replaced(this->pending.exchange(event.release(), std::memory_order_acq_rel));
+    }
+
+    /// @brief Takes the pending event, or returns null if there is none.
+    std::unique_ptr<VarEvent> take() {
+        return std::unique_ptr<VarEvent>(this->pending.exchange(nullptr, std::memory_order_acq_rel));
+    }
+
+private:
+    std::atomic<VarEvent*> pending{nullptr};
+};
+
+/// @brief Queues the published values of the forwarded variables until a long-poll of the controller
+///        drains them: discrete events go into a lock-free queue, states into one slot per variable which
+///        only keeps the latest value, so state updates never pile up while the controller does not query.
+///        Publishing never locks; the given mutex is only taken to wake up a waiting long-poll, and must be
+///        held by the (single) thread which waits for and drains the queue.
+class VarQueue {
+public:
+    /// @brief Maximum count of discrete events which can be queued until they are drained.
+    static constexpr std::size_t CAPACITY{1024};
+
+    explicit VarQueue(std::mutex& guard) : guard(guard) {
+    }
+
+    VarQueue(const VarQueue&) = delete;
+    VarQueue& operator=(const VarQueue&) = delete;
+
+    /// @brief Queues a published value, safe to be called concurrently from any thread.
+    /// @return False if the value is an event and the queue is full; the event is dropped then and counted,
+    ///         so that the controller can be told about the loss (see 'take_dropped').
+    bool push(AgentVar var, AgentVarValue value) {
+        const auto order = this->order.fetch_add(1, std::memory_order_relaxed);
+        const auto published = std::chrono::steady_clock::now();
+
+        // state variables just overwrite a possibly pending value
+        if (var_info(var).kind == VarKind::State) {
+            this->slots[static_cast<std::size_t>(var)].put(
+                std::make_unique<VarEvent>(VarEvent{var, order, published, std::move(value)}));
+
+            if (var_info(var).priority != VarPriority::Bulk) {
+                this->slots_pending = true;
+                this->wake();
+                return true;
+            }
+
+            // bulk updates only wake a long-poll when the batching window starts, so that it can
+            // take the window into account; later updates are just picked up on delivery
+            std::chrono::steady_clock::rep none{0};
+            const auto since = published.time_since_epoch().count();
+
+            if (this->bulk_pending_since.compare_exchange_strong(none, since))
+                this->wake();
+            return true;
+        }
+
+        if (not this->events.push({var, order, published, std::move(value)})) {
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        this->wake();
+        return true;
+    }
+
+    /// @brief Waits until there is something to deliver, 'deadline' passed or 'stop_waiting' returns true;
+    ///        'lock' must hold the mutex given on construction. Anything but bulk updates ends the wait
+    ///        immediately, bulk updates when their batching window expired.
+    template <typename Predicate>
+    void wait(std::unique_lock<std::mutex>& lock, std::chrono::steady_clock::time_point deadline,
+              std::chrono::steady_clock::duration bulk_window, Predicate stop_waiting) {
+        this->waiting = true;
+
+        while (this->events.empty() and not this->slots_pending and not stop_waiting()) {
+            auto until = deadline;
+            const auto bulk_since = this->bulk_pending_since.load();
+
+            if (bulk_since != 0) {
+                const std::chrono::steady_clock::time_point since{std::chrono::steady_clock::duration(bulk_since)};
+                until = std::min(until, since + bulk_window);
+            }
+
+            if (this->cv_changed.wait_until(lock, until) == std::cv_status::timeout)
+                break;
+        }
+
+        this->waiting = false;
+    }
+
+    /// @brief Wakes up a waiting long-poll, e.g. after something else to deliver was queued.
+    void wake() {
+        // a long-poll announces itself via 'waiting' before it checks for queued items; both sides
+        // use sequentially consistent atomics, so either the long-poll sees our item or we see the
+        // long-poll - in the latter case we must synchronize with it via the mutex to ensure that it
+        // actually sleeps on the condition variable before we notify it
+        if (this->waiting) {
+            std::scoped_lock lock(this->guard);
+        }
+
+        this->cv_changed.notify_all();
+    }
+
+    /// @brief Takes all queued values, the critical ones first and each priority in order of publication;
+    ///        expects the mutex given on construction to be held. Without 'take_events', the discrete events
+    ///        are left in the queue (e.g. while the receiver is congested) and only the states are taken.
+    std::vector<VarEvent> drain(bool take_events = true) {
+        std::vector<VarEvent> drained;
+        VarEvent event;
+
+        while (take_events and this->events.pop(event))
+            drained.push_back(std::move(event));
+
+        // reset the flags before looking at the slots: a concurrent update re-sets them
+        // and is then either picked up now or on the next call
+        const bool slots_pending = this->slots_pending.exchange(false);
+        const bool bulk_pending = this->bulk_pending_since.exchange(0) != 0;
+
+        if (slots_pending or bulk_pending) {
+            for (auto& slot : this->slots) {
+                if (auto pending = slot.take())
+                    drained.push_back(std::move(*pending));
+            }
+        }
+
+        std::sort(drained.begin(), drained.end(), [](const VarEvent& a, const VarEvent& b) {
+            const auto a_priority = var_info(a.var).priority;
+            const auto b_priority = var_info(b.var).priority;
+
+            return a_priority != b_priority ? a_priority < b_priority : a.order < b.order;
+        });
+
+        return drained;
+    }
+
+    /// @brief Returns the count of events dropped since the last call because the queue was full.
+    std::uint64_t take_dropped() {
+        return this->dropped.exchange(0);
+    }
+
+private:
+    std::mutex& guard;
+    MpscQueue<VarEvent, CAPACITY> events;
+    std::array<VarSlot, agent_var_infos.size()> slots;
+    /// @brief Set when at least one slot of a critical or normal variable received a new value.
+    std::atomic_bool slots_pending{false};
+    /// @brief Time (in steady clock ticks) when the first not yet drained bulk update was stored in
+    ///        a slot, or 0 if there is none.
+    std::atomic<std::chrono::steady_clock::rep> bulk_pending_since{0};
+    /// @brief Count of events dropped since the last 'take_dropped'.
+    std::atomic<std::uint64_t> dropped{0};
+    /// @brief Source for the 'order' stamps of queued events and slots.
+    std::atomic<std::uint64_t> order{0};
+    /// @brief Set while a long-poll is waiting on 'cv_changed', so that producers only need to take
+    ///        the mutex when there is somebody to wake up.
+    std::atomic_bool waiting{false};
+    std::condition_variable cv_changed;
+};
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_VAR_QUEUE_HPP
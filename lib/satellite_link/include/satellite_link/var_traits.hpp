@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_VAR_TRAITS_HPP
+#define SATELLITE_LINK_VAR_TRAITS_HPP
+
+#include <memory>
+#include <vector>
+
+namespace satellite_link {
+
+/// @brief How updates of a forwarded variable are queued.
+enum class VarKind {
+    /// @brief The variable reflects a state, only its latest value is of interest, so a pending
+    ///        value is overwritten by a newer one.
+    State,
+    /// @brief Each published value is a discrete event which must be forwarded in order.
+    Event,
+};
+
+/// @brief Delivery priority of a forwarded variable; lower values are delivered first.
+enum class VarPriority {
+    /// @brief Session and safety relevant, wakes up the controller immediately and is delivered first.
+    Critical,
+    /// @brief Wakes up the controller immediately.
+    Normal,
+    /// @brief High-rate measurements, may be held back for a short batching window.
+    Bulk,
+};
+
+/// @brief Properties of a forwarded variable.
+struct VarInfo {
+    /// @brief Id of the connection/implementation, which is usually the interface name.
+    const char* interface;
+    const char* var;
+    VarKind kind;
+    VarPriority priority;
+    /// @brief Whether changes may be forwarded as JSON Patch against the previously forwarded value.
+    bool delta;
+};
+
+/// @brief Compile-time properties of the forwarded variable 'Var', specialized by the generated code:
+///        - 'type': the C++ type of the variable's value
+///        - 'subscribe(module, callback)': subscribes to the variable on the first connection of the
+///          module's requirement, if any
+///        - 'publish(module, value)': publishes the variable on the module's implementation
+template <auto Var> struct var_traits;
+
+/// @brief Returns the interface of a mandatory requirement.
+template <typename T> T* first_connection(const std::unique_ptr<T>& r) {
+    return r.get();
+}
+
+/// @brief Returns the first connected interface of an optional requirement, or nullptr if there is none.
+template <typename T> T* first_connection(const std::vector<std::unique_ptr<T>>& r) {
+    return r.empty() ? nullptr : r.front().get();
+}
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_VAR_TRAITS_HPP
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_VARS_HPP
+#define SATELLITE_LINK_VARS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <satellite_link/generated/vars.hpp>
+#include <satellite_link/var_traits.hpp>
+
+namespace satellite_link {
+
+// The enums 'AgentVar' and 'ControllerVar', their properties and their 'var_traits' are generated
+// from tunnel.yaml; new variables must only be appended there, since the position is the wire tag.
+// Both sides must be built from the same tunnel.yaml, 'link_setup' compares 'TUNNEL_TABLES_HASH'.
+
+inline const VarInfo& var_info(AgentVar var) {
+    return agent_var_infos[static_cast<std::size_t>(var)];
+}
+
+inline const VarInfo& var_info(ControllerVar var) {
+    return controller_var_infos[static_cast<std::size_t>(var)];
+}
+
+/// @brief Returns the wire tag of the given variable.
+template <typename Var> constexpr unsigned int to_tag(Var var) {
+    return static_cast<unsigned int>(var);
+}
+
+/// @brief Returns the variable forwarded by the SatelliteAgent for the given wire tag,
+///        or nothing if the tag is unknown (e.g. when the peer is newer than we are).
+inline std::optional<AgentVar> agent_var_from_tag(std::uint64_t tag) {
+    if (tag >= agent_var_infos.size())
+        return std::nullopt;
+
+    return static_cast<AgentVar>(tag);
+}
+
+/// @brief Returns the variable forwarded by the SatelliteController for the given wire tag,
+///        or nothing if the tag is unknown (e.g. when the peer is newer than we are).
+inline std::optional<ControllerVar> controller_var_from_tag(std::uint64_t tag) {
+    if (tag >= controller_var_infos.size())
+        return std::nullopt;
+
+    return static_cast<ControllerVar>(tag);
+}
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_VARS_HPP
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#ifndef SATELLITE_LINK_ZSTD_DICTIONARY_HPP
+#define SATELLITE_LINK_ZSTD_DICTIONARY_HPP
+
+namespace satellite_link {
+
+/// @brief Raw content dictionary for the Zstandard compression of variables and errors batches
+///        (version 1, 'Compression::ZstdDict1').
+///
+///        It consists of the keys and values which occur in nearly each batch, with the most frequent
+///        ones last since they are matched with the shortest offsets. Both sides must use exactly the
+///        same dictionary, so it must never be changed: add a new version along with a new
+///        'Compression' value instead.
+constexpr char ZSTD_DICTIONARY[] =
+    R"({"action":"clear","error":{"type":"","sub_type":"","message":"","description":"","origin":)"
+    R"({"module_id":"","implementation_id":"","evse":1,"connector":1},"severity":"High","state":"Active",)"
+    R"("timestamp":"","uuid":"","vendor_id":""}})"
+    R"({"action":"raise","error":{"type":"evse_manager/","severity":"Medium","state":"ClearedByModule")"
+    R"({"schedule_import":[{"timestamp":"","limits_to_root":{"ac_max_phase_count":3,"ac_max_current_A":)"
+    R"(,"total_power_W":},"limits_to_leaf":{"ac_max_phase_count":3,"ac_max_current_A":}}],)"
+    R"("schedule_export":[],"children":[],"node_type":"Evse","uuid":"evse1","evse_state":"Charging",)"
+    R"("priority_request":false,"energy_usage_root":{"timestamp":"","energy_Wh_import":{"total":}}})"
+    R"({"uuid":"","timestamp":"","connector_id":1,"event":"SessionStarted","session_started":)"
+    R"({"reason":"EVConnected","meter_value":{}},"transaction_started":{"id_tag":{"id_token":)"
+    R"({"value":"","type":"ISO14443"},"authorization_type":"RFID"}},"transaction_finished":)"
+    R"({"reason":"EVDisconnected"},"charging_state_changed_event":{"state":"Charging"}})"
+    R"({"max_current":,"nr_of_phases_available":3,"uuid":""})"
+    R"({"op":"replace","path":"/"},{"op":"add","path":"/"},{"op":"remove","path":"/"})"
+    R"({"meter_id":"","phase_seq_error":false,"timestamp":"","energy_Wh_import":{"total":,"L1":,"L2":,"L3":},)"
+    R"("energy_Wh_export":{"total":},"power_W":{"total":,"L1":,"L2":,"L3":},"voltage_V":{"L1":,"L2":,"L3":},)"
+    R"("current_A":{"L1":,"L2":,"L3":,"N":},"frequency_Hz":{"L1":}})"
+    R"({"evse_temperature_C":,"fan_rpm":,"supply_voltage_12V":,"supply_voltage_minus_12V":,"relais_on":true})"
+    R"({"errors":[],"vars":[{"seq":,"tag":,"value":},{"seq":,"tag":,"base":,"delta":[]}]})";
+
+} // namespace satellite_link
+
+#endif // SATELLITE_LINK_ZSTD_DICTIONARY_HPP
@@ -1,18 +1,29 @@
 // SPDX-License-Identifier: GPL-3.0-only
 // Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <exception>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
 #include "configuration.h"
 #include "SatelliteAgent.hpp"
 #include <rpc/server.h>
+#include <rpc/this_handler.h>
 #include <rpc/this_server.h>
 #include <rpc/this_session.h>
 #include <nlohmann/json.hpp>
+#include <satellite_link/payload.hpp>
+#include <satellite_link/protocol.hpp>
 #include <utils/error/error_json.hpp>
 
 using namespace std::chrono_literals;
@@ -20,6 +31,25 @@ using nlohmann::json;
 
 namespace module {
 
+/// @brief Upper limit for the time a long-poll call of "retrieve_vars_and_errors" is held open;
+///        must be well below the observer timeout in 'ready' (without heartbeat).
+static constexpr int LONG_POLL_MAX_WAIT_MS{30000};
+
+/// @brief Time the observer in 'ready' waits for a call of the SatelliteController, unless the
+///        heartbeat told otherwise.
+static constexpr std::chrono::seconds OBSERVER_TIMEOUT{60};
+
+/// @brief Helper to return the wall clock time in microseconds since the epoch.
+static std::int64_t system_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+/// @brief Helper to return the given time of the monotonic clock in microseconds since its (arbitrary) epoch.
+static std::int64_t steady_time_us(std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now()) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
 void SatelliteAgent::init() {
     invoke_init(*p_auth);
     invoke_init(*p_system);
@@ -29,6 +59,15 @@ void SatelliteAgent::init() {
     // to queue received error events
     this->error_event_list = json::array();
 
+    if (not this->config.trace_file.empty() and not this->tracer.open(this->config.trace_file, "SatelliteAgent"))
+        EVLOG_warning << "Could not open trace file '" << this->config.trace_file << "', tracing is disabled.";
+
+    // opened before the functions are bound, they are only wrapped for recording if it is enabled
+    if (not this->config.traffic_record_file.empty() and
+        not this->recorder.open(this->config.traffic_record_file, "SatelliteAgent"))
+        EVLOG_warning << "Could not open traffic record file '" << this->config.traffic_record_file
+                      << "', recording is disabled.";
+
     //
     // register global error reception to allow forwarding to remote peer
     //
@@ -44,123 +83,29 @@ void SatelliteAgent::init() {
 
     subscribe_global_all_errors(error_callback, error_cleared_callback);
 
-    // queues received events
-    this->event_list = json::array();
-
-    //
-    // register all callbacks for our desired variables
-    //
-    if (not this->r_auth_token_provider.empty()) {
-        this->r_auth_token_provider[0]->subscribe_provided_token([&](types::authorization::ProvidedIdToken value) {
-            this->add_to_event_list("auth_token_provider", "provided_token", value);
-        });
-    }
-
-    this->r_energy->subscribe_energy_flow_request([&](types::energy::EnergyFlowRequest value) {
-        this->add_to_event_list("energy", "energy_flow_request", value);
-    });
-
-    this->r_evse_manager->subscribe_session_event([&](types::evse_manager::SessionEvent value) {
-        this->add_to_event_list("evse_manager", "session_event", value);
-    });
-
-    this->r_evse_manager->subscribe_limits([&](types::evse_manager::Limits value) {
-        this->add_to_event_list("evse_manager", "limits", value);
-    });
-
-    this->r_evse_manager->subscribe_ev_info([&](types::evse_manager::EVInfo value) {
-        this->add_to_event_list("evse_manager", "ev_info", value);
-    });
-
-    this->r_evse_manager->subscribe_car_manufacturer([&](types::evse_manager::CarManufacturer value) {
-        this->add_to_event_list("evse_manager", "car_manufacturer", types::evse_manager::car_manufacturer_to_string(value));
-    });
-
-    this->r_evse_manager->subscribe_telemetry([&](types::evse_board_support::Telemetry value) {
-        this->add_to_event_list("evse_manager", "telemetry", value);
-    });
-
-    this->r_evse_manager->subscribe_powermeter([&](types::powermeter::Powermeter value) {
-        this->add_to_event_list("evse_manager", "powermeter", value);
-    });
-
-    this->r_evse_manager->subscribe_powermeter_public_key_ocmf([&](std::string value) {
-        this->add_to_event_list("evse_manager", "powermeter_public_key_ocmf", value);
-    });
-
-    this->r_evse_manager->subscribe_evse_id([&](std::string value) {
-        this->add_to_event_list("evse_manager", "evse_id", value);
-    });
-
-    this->r_evse_manager->subscribe_hw_capabilities([&](types::evse_board_support::HardwareCapabilities value) {
-        this->add_to_event_list("evse_manager", "hw_capabilities", value);
-    });
-
-    this->r_evse_manager->subscribe_enforced_limits([&](types::energy::EnforcedLimits value) {
-        this->add_to_event_list("evse_manager", "enforced_limits", value);
-    });
+    // metrics per forwarded variable, set up before the subscriptions use them
+    for (std::size_t i = 0; i < satellite_link::agent_var_infos.size(); i++) {
+        const auto& info = satellite_link::agent_var_infos[i];
+        const satellite_link::MetricLabels labels{{"interface", info.interface}, {"var", info.var}};
 
-    this->r_evse_manager->subscribe_waiting_for_external_ready([&](bool value) {
-        this->add_to_event_list("evse_manager", "waiting_for_external_ready", value);
-    });
-
-    this->r_evse_manager->subscribe_ready([&](bool value) {
-        this->add_to_event_list("evse_manager", "ready", value);
-    });
-
-    this->r_evse_manager->subscribe_selected_protocol([&](std::string value) {
-        this->add_to_event_list("evse_manager", "selected_protocol", value);
-    });
-
-    this->r_evse_manager->subscribe_supported_energy_transfer_modes([&](std::vector<types::iso15118::EnergyTransferMode> value) {
-        this->add_to_event_list("evse_manager", "supported_energy_transfer_modes", value);
-    });
-
-    if (not this->r_dc_external_derate.empty()) {
-        this->r_dc_external_derate[0]->subscribe_plug_temperature_C([&](double value) {
-            this->add_to_event_list("dc_external_derate", "plug_temperature_C", value);
-        });
+        this->vars_forwarded[i] =
+            &this->metrics.counter("vars_forwarded", "Values forwarded to the SatelliteController", labels);
+        this->var_queue_delay[i] = &this->metrics.histogram(
+            "var_queue_delay_seconds", "Time from the publication of a value in EVerest until its delivery", labels);
     }
 
-    if (not this->r_iso15118_extensions.empty()) {
-        this->r_iso15118_extensions[0]->subscribe_iso15118_certificate_request([&](types::iso15118::RequestExiStreamSchema value) {
-            this->add_to_event_list("iso15118_extensions", "iso15118_certificate_request", value);
-        });
-
-        this->r_iso15118_extensions[0]->subscribe_charging_needs([&](types::iso15118::ChargingNeeds value) {
-            this->add_to_event_list("iso15118_extensions", "charging_needs", value);
-        });
-
-        this->r_iso15118_extensions[0]->subscribe_ev_info([&](types::iso15118::EvInformation value) {
-            this->add_to_event_list("iso15118_extensions", "ev_info", value);
-        });
-
-        this->r_iso15118_extensions[0]->subscribe_service_renegotiation_supported([&](bool value) {
-            this->add_to_event_list("iso15118_extensions", "service_renegotiation_supported", value);
-        });
-    }
-
-    if (not this->r_rfid_token_provider.empty()) {
-        this->r_rfid_token_provider[0]->subscribe_provided_token([&](types::authorization::ProvidedIdToken value) {
-            this->add_to_event_list("rfid_token_provider", "provided_token", value);
-        });
-    }
-
-    if (not this->r_system.empty()) {
-        this->r_system[0]->subscribe_firmware_update_status([&](types::system::FirmwareUpdateStatus value) {
-            this->add_to_event_list("system", "firmware_update_status", value);
-        });
-
-        this->r_system[0]->subscribe_log_status([&](types::system::LogStatus value) {
-            this->add_to_event_list("system", "log_status", value);
-        });
-    }
+    //
+    // register all callbacks for our desired variables, the subscriptions are generated from tunnel.yaml
+    // (variables of optional requirements are only subscribed if the requirement is connected)
+    //
+    satellite_link::for_each_agent_var([this](auto var) {
+        using Var = satellite_link::var_traits<decltype(var)::value>;
 
-    if (not this->r_uk_random_delay.empty()) {
-        this->r_uk_random_delay[0]->subscribe_countdown([&](types::uk_random_delay::CountDown value) {
-            this->add_to_event_list("uk_random_delay", "countdown", value);
+        Var::subscribe(*this, [this, var](typename Var::type value) {
+            this->add_to_event_list(
+                var, satellite_link::AgentVarValue(std::in_place_type<typename Var::type>, std::move(value)));
         });
-    }
+    });
 
     //
     // create RPC server
@@ -168,7 +113,7 @@ void SatelliteAgent::init() {
     this->rpc = std::make_unique<rpc::server>(this->config.port);
 
     // at this point we only register the callbacks for communication between SatelliteController and SatelliteAgent
-    this->rpc->bind("i_am_here", [&]() {
+    this->bind("i_am_here", [&]() {
         std::unique_lock<std::mutex> lock(this->lock_i_am_here_seen);
         bool rv{this->i_am_here_seen};
 
@@ -199,7 +144,87 @@ void SatelliteAgent::init() {
         return rv;
     });
 
-    this->rpc->bind("i_am_ready", [&]() {
+    // negotiates properties of the link, called by the controller after 'i_am_here';
+    // request and response are always JSON text so that both sides can always understand each other
+    this->bind("link_setup", [&](std::string& request) {
+        json options = json::parse(request);
+        auto encoding{satellite_link::PayloadEncoding::Json};
+
+        // the signatures of the RPC functions depend on the protocol version, so it must match exactly
+        const int protocol_version = options.value("protocol_version", 1);
+
+        if (protocol_version != satellite_link::PROTOCOL_VERSION) {
+            EVLOG_error << "SatelliteController speaks protocol version " << protocol_version << ", but we speak "
+                        << satellite_link::PROTOCOL_VERSION << ". Both sides must run the same release.";
+            rpc::this_handler().respond_error("unsupported protocol version " + std::to_string(protocol_version));
+            return std::string();
+        }
+
+        // the tags of the variables and the commands are generated from tunnel.yaml, so both sides must
+        // be built from the same revision of it
+        const auto tables_hash = options.value("tables_hash", std::uint64_t{0});
+
+        if (tables_hash != satellite_link::TUNNEL_TABLES_HASH) {
+            EVLOG_error << "SatelliteController was built from another tunnel.yaml than we are. Both sides must "
+                           "run the same release.";
+            rpc::this_handler().respond_error("tunnel.yaml mismatch");
+            return std::string();
+        }
+
+        try {
+            encoding = satellite_link::string_to_payload_encoding(options.at("payload_encoding"));
+        } catch (const std::exception& e) {
+            EVLOG_warning << "Unsupported payload encoding requested, falling back to JSON.";
+        }
+
+        // packed variables are embedded as binary, which only MessagePack can transport
+        const bool packed_vars =
+            encoding == satellite_link::PayloadEncoding::MsgPack and options.value("packed_vars", false);
+
+        this->payload_encoding = encoding;
+        this->packed_vars = packed_vars;
+        EVLOG_info << "Using payload encoding '" << satellite_link::payload_encoding_to_string(encoding) << "'"
+                   << (packed_vars ? " with packed variables." : ".");
+
+        // diffs are only worth it when full values are sent again from time to time
+        const bool delta_vars = this->config.delta_keyframe_interval > 0 and options.value("delta_vars", false);
+
+        {
+            std::scoped_lock lock(this->event_list_guard);
+            this->reset_delta_encoding(delta_vars);
+        }
+
+        // a new SatelliteController numbers its notifications from 1 again
+        this->reset_notifications();
+
+        // we use our configured codec if the controller can decompress it
+        auto compression = satellite_link::string_to_compression(this->config.compression);
+        const auto offered = options.value("compression", std::vector<std::string>{});
+
+        if (std::find(offered.begin(), offered.end(), satellite_link::compression_to_string(compression)) ==
+                offered.end() or
+            not satellite_link::compression_supported(compression)) {
+            if (compression != satellite_link::Compression::None)
+                EVLOG_warning << "Compression '" << this->config.compression
+                              << "' is not supported by both sides, sending uncompressed.";
+            compression = satellite_link::Compression::None;
+        }
+
+        this->compression = compression;
+        EVLOG_info << "Using compression '" << satellite_link::compression_to_string(compression) << "'.";
+
+        json rv{
+            {"protocol_version", satellite_link::PROTOCOL_VERSION},
+            {"tables_hash", satellite_link::TUNNEL_TABLES_HASH},
+            {"payload_encoding", satellite_link::payload_encoding_to_string(encoding)},
+            {"packed_vars", packed_vars},
+            {"delta_vars", delta_vars},
+            {"compression", satellite_link::compression_to_string(compression)},
+        };
+        return rv.dump();
+    });
+
+    this->bind("i_am_ready", [&]() {
         std::unique_lock<std::mutex> lock_ready_seen(this->lock_i_am_ready_seen);
 
         if (!this->i_am_ready_seen) {
@@ -219,11 +244,14 @@ void SatelliteAgent::init() {
         this->cv_i_am_ready_myself.wait(lock_ready_myself, [&]() { return this->i_am_ready_myself; });
     });
 
-    this->rpc->bind("exit", [&]() {
+    this->bind("exit", [&]() {
         EVLOG_info << "Remote SatelliteController exited. Terminating too...";
 
         this->disconnect_expected = true;
 
+        // release a possibly pending long-poll call
+        this->var_queue.wake();
+
         // gracefully shutdown the session and the server
         rpc::this_session().post_exit();
         rpc::this_server().stop();
@@ -238,15 +266,25 @@ void SatelliteAgent::init() {
     std::unique_lock<std::mutex> lock_here_seen(this->lock_i_am_here_seen);
     std::unique_lock<std::mutex> lock_ready_myself(this->lock_i_am_ready_myself);
 
-    // run the RPC server
-    this->rpc->async_run();
+    // all functions must be bound before the server runs, since binding is not thread-safe
+    this->init_rpc_binds();
+
+    // run the RPC server; commands are served by the configured count of workers, and
+    // additional workers are reserved for the event drain and the control calls, so that
+    // slow commands cannot delay them
+    this->rpc->async_run(this->config.rpc_worker_threads + RPC_RESERVED_WORKERS);
 
-    // we wait until the peer connected and plays our protocol before we register the
+    // we wait until the peer connected and plays our protocol before we enable the
     // real worker callbacks; this is to ensure that we cannot modify our internal state
     // by accidentally receiving a callback while we are not synced yet
     this->cv_i_am_here_seen.wait(lock_here_seen, [&]{ return this->i_am_here_seen; });
 
-    this->init_rpc_binds();
+    this->rpc_binds_enabled = true;
+
+    // start executing notifications, they may have been queued already
+    std::thread([this]() {
+        this->run_notifications();
+    }).detach();
 
     // notify the 'i_am_ready' RPC callback that it can return
     this->i_am_ready_myself = true;
@@ -262,12 +300,24 @@ void SatelliteAgent::ready() {
     invoke_ready(*p_auth);
     invoke_ready(*p_system);
 
+    if (not this->config.metrics_file.empty()) {
+        std::thread([this]() {
+            this->run_metrics_file();
+        }).detach();
+    }
+
     std::unique_lock<std::mutex> lock(this->event_list_guard);
 
-    // when the RPC callback 'retrieve_vars' is called regularly, then
+    // when the RPC callback 'retrieve_vars' (or 'heartbeat') is called regularly, then
     // we are woken up regularly, too -> we don't see a timeout here;
     // but when we see a timeout, then we should reset the system...
-    while (this->cv_retrieve_vars_seen.wait_for(lock, 60s) == std::cv_status::no_timeout);
+    const auto observer_timeout = [this]() -> std::chrono::milliseconds {
+        // with heartbeat, the SatelliteController tells how long it may be silent before we give up on it
+        const int heartbeat_timeout_ms = this->heartbeat_timeout_ms;
+        return heartbeat_timeout_ms > 0 ? std::chrono::milliseconds(heartbeat_timeout_ms) : OBSERVER_TIMEOUT;
+    };
+
+    while (this->cv_retrieve_vars_seen.wait_for(lock, observer_timeout()) == std::cv_status::no_timeout);
 
     // ...unless this is expected (in that case we assume somebody else cares about the reboot)
     if (not this->disconnect_expected) {
@@ -278,206 +328,280 @@ void SatelliteAgent::ready() {
     }
 }
 
-void SatelliteAgent::add_to_event_list(std::string interface, std::string var, json value) {
-        std::scoped_lock lock(this->event_list_guard);
+void SatelliteAgent::add_to_event_list(satellite_link::AgentVar var, satellite_link::AgentVarValue value) {
+    if (not this->var_queue.push(var, std::move(value))) {
+        // a backlog must not take the satellite down, so the events are dropped until the
+        // SatelliteController catches up again; it is told how many were lost with the next batch
+        this->events_dropped.inc();
 
-        // random check to prevent growing endlessly
-        if (this->event_list.size() > 1000) {
-            if (not this->event_list_size_warned) {
-                EVLOG_error << "Event list size exceeded 1000 items. Skipping appending more and triggering reset.";
-                this->event_list_size_warned = true;
+        if (not this->event_list_size_warned.exchange(true))
+            EVLOG_error << "Event queue exceeded " << satellite_link::VarQueue::CAPACITY
+                        << " items. Dropping events until the SatelliteController catches up.";
+    }
+}
 
-                // we must assume that we lost sync and trigger a reset
-                this->trigger_reset();
-            }
+std::vector<satellite_link::VarEvent> SatelliteAgent::drain_event_list(bool take_events) {
+    auto events = this->var_queue.drain(take_events);
+
+    // there is room again, so warn again when the queue runs full the next time
+    if (take_events and not events.empty() and this->event_list_size_warned.exchange(false))
+        EVLOG_warning << "Event queue drained, forwarding events again.";
+
+    return events;
+}
+
+json SatelliteAgent::make_var_item(std::uint64_t seq, const satellite_link::VarEvent& event, json value) {
+    const auto var = event.var;
+    // the publication time is taken from the monotonic clock, whose offset the controller estimates
+    // with the heartbeat
+    json item = satellite_link::make_var_item(seq, var, event.published);
+
+    if (not this->delta_vars or not satellite_link::var_info(var).delta or value.is_binary()) {
+        item["value"] = std::move(value);
+        return item;
+    }
+
+    auto& baseline = this->delta_baselines[static_cast<std::size_t>(var)];
+    json patch;
+
+    // after a couple of diffs the full value is sent again (keyframe), so that the controller
+    // recovers in case it missed a base; a base which is still pending is replaced by this item
+    // (see UnackedItems::add_var), so the controller may never receive it
+    if (not baseline.value.is_null() and baseline.deltas < this->config.delta_keyframe_interval and
+        not this->unacked.pending(var))
+        patch = json::diff(baseline.value, value);
+
+    // a diff which replaces the whole value is of no use
+    const bool replaces_all = patch.is_array() and patch.size() == 1 and patch[0].at("path") == "";
+
+    if (patch.is_array() and not replaces_all) {
+        item["base"] = baseline.seq;
+        item["delta"] = std::move(patch);
+        baseline.deltas++;
+    } else {
+        item["value"] = value;
+        baseline.deltas = 0;
+    }
+
+    baseline.value = std::move(value);
+    baseline.seq = seq;
+
+    return item;
+}
+
+void SatelliteAgent::reset_delta_encoding(bool enabled) {
+    // each variable has at most one pending item, which is the base of the next diff, so a pending
+    // diff gets the full value of its base
+    this->unacked.rewrite_vars([this](json& item) {
+        if (not item.contains("delta"))
             return;
-        }
 
-        json j = json::object({ {"interface", interface}, {"var", var}, {"value", value} });
+        const auto var = satellite_link::agent_var_from_tag(item.at("tag").get<std::uint64_t>());
+
+        item.erase("base");
+        item.erase("delta");
+        item["value"] = this->delta_baselines[static_cast<std::size_t>(var.value())].value;
+    });
+
+    this->delta_baselines = {};
+    this->delta_vars = enabled;
+}
+
+void SatelliteAgent::trace_forwarded(json& item, const std::string& name,
+                                     std::chrono::steady_clock::time_point since) {
+    const auto span = this->tracer.start();
+    const auto now = satellite_link::Tracer::Clock::now();
+    const auto elapsed = std::chrono::steady_clock::now() - since;
 
-        this->event_list.insert(this->event_list.end(), j);
+    this->tracer.record(name, "forward", span, {},
+                        now - std::chrono::duration_cast<satellite_link::Tracer::Clock::duration>(elapsed), now);
+    item["trace"] = span.to_json();
 }
 
 void SatelliteAgent::add_to_error_event_list(std::string action, const Everest::error::Error& error) {
+    {
         std::scoped_lock lock(this->error_event_list_guard);
 
-        json j{ {"action", action}, {"error", error} };
+        json j{{"action", action}, {"error", error}};
+
+        if (this->tracer.is_enabled())
+            this->trace_forwarded(j, "error " + action + " " + error.type, std::chrono::steady_clock::now());
 
         this->error_event_list.insert(this->error_event_list.end(), j);
+    }
+
+    this->error_event_list_pending = true;
+    this->var_queue.wake();
 }
 
 void SatelliteAgent::init_rpc_binds() {
+    // the descriptors of all tunnelled commands are generated from tunnel.yaml
+    namespace commands = satellite_link::commands;
 
-    this->rpc->bind("energy_enforce_limits", [&](std::string& value) {
-        this->r_energy->call_enforce_limits(json::parse(value));
+    this->bind_forwarded<commands::energy::enforce_limits>([&](const types::energy::EnforcedLimits& value) {
+        this->r_energy->call_enforce_limits(value);
     });
 
-    this->rpc->bind("evse_manager_get_evse", [&]() {
-        json j = this->r_evse_manager->call_get_evse();
-        return j.dump();
+    this->bind_forwarded<commands::evse_manager::get_evse>([&]() {
+        return this->r_evse_manager->call_get_evse();
     });
 
-    this->rpc->bind("evse_manager_enable_disable", [&](int& connector_id, std::string& cmd_source) {
-        return this->r_evse_manager->call_enable_disable(connector_id, json::parse(cmd_source));
-    });
+    this->bind_forwarded<commands::evse_manager::enable_disable>(
+        [&](int connector_id, const types::evse_manager::EnableDisableSource& cmd_source) {
+            return this->r_evse_manager->call_enable_disable(connector_id, cmd_source);
+        });
 
-    this->rpc->bind("evse_manager_authorize_response", [&](std::string& provided_token, std::string& validation_result) {
-        this->r_evse_manager->call_authorize_response(json::parse(provided_token), json::parse(validation_result));
-    });
+    this->bind_forwarded<commands::evse_manager::authorize_response>(
+        [&](const types::authorization::ProvidedIdToken& provided_token,
+            const types::authorization::ValidationResult& validation_result) {
+            this->r_evse_manager->call_authorize_response(provided_token, validation_result);
+        });
 
-    this->rpc->bind("evse_manager_withdraw_authorization", [&]() {
+    this->bind_forwarded<commands::evse_manager::withdraw_authorization>([&]() {
         this->r_evse_manager->call_withdraw_authorization();
     });
 
-    this->rpc->bind("evse_manager_reserve", [&](int& reservation_id) {
+    this->bind_forwarded<commands::evse_manager::reserve>([&](int reservation_id) {
         return this->r_evse_manager->call_reserve(reservation_id);
     });
 
-    this->rpc->bind("evse_manager_cancel_reservation", [&]() {
+    this->bind_forwarded<commands::evse_manager::cancel_reservation>([&]() {
         this->r_evse_manager->call_cancel_reservation();
     });
 
-    this->rpc->bind("evse_manager_pause_charging", [&]() {
+    this->bind_forwarded<commands::evse_manager::pause_charging>([&]() {
         return this->r_evse_manager->call_pause_charging();
     });
 
-    this->rpc->bind("evse_manager_resume_charging", [&]() {
+    this->bind_forwarded<commands::evse_manager::resume_charging>([&]() {
         return this->r_evse_manager->call_resume_charging();
     });
 
-    this->rpc->bind("evse_manager_stop_transaction", [&](std::string& request) {
-        return this->r_evse_manager->call_stop_transaction(json::parse(request));
-    });
+    this->bind_forwarded<commands::evse_manager::stop_transaction>(
+        [&](const types::evse_manager::StopTransactionRequest& request) {
+            return this->r_evse_manager->call_stop_transaction(request);
+        });
 
-    this->rpc->bind("evse_manager_force_unlock", [&](int& connector_id) {
+    this->bind_forwarded<commands::evse_manager::force_unlock>([&](int connector_id) {
         return this->r_evse_manager->call_force_unlock(connector_id);
     });
 
-    this->rpc->bind("evse_manager_external_ready_to_start_charging", [&]() {
+    this->bind_forwarded<commands::evse_manager::external_ready_to_start_charging>([&]() {
         return this->r_evse_manager->call_external_ready_to_start_charging();
     });
 
-    this->rpc->bind("evse_manager_set_plug_and_charge_configuration", [&](std::string& plug_and_charge_configuration) {
-        this->r_evse_manager->call_set_plug_and_charge_configuration(json::parse(plug_and_charge_configuration));
-    });
-
-    this->rpc->bind("evse_manager_update_allowed_energy_transfer_modes", [&](std::string& allowed_energy_transfer_modes) {
-        json j = this->r_evse_manager->call_update_allowed_energy_transfer_modes(json::parse(allowed_energy_transfer_modes));
-        return j.dump();
-    });
+    this->bind_forwarded<commands::evse_manager::set_plug_and_charge_configuration>(
+        [&](const types::evse_manager::PlugAndChargeConfiguration& plug_and_charge_configuration) {
+            this->r_evse_manager->call_set_plug_and_charge_configuration(plug_and_charge_configuration);
+        });
 
-    this->rpc->bind("dc_external_derate_set_external_derating", [&](std::string& derate) {
-        if (this->r_dc_external_derate.empty())
-            return;
+    this->bind_forwarded<commands::evse_manager::update_allowed_energy_transfer_modes>(
+        [&](const std::vector<types::iso15118::EnergyTransferMode>& allowed_energy_transfer_modes) {
+            return this->r_evse_manager->call_update_allowed_energy_transfer_modes(allowed_energy_transfer_modes);
+        });
 
-        this->r_dc_external_derate[0]->call_set_external_derating(json::parse(derate));
-    });
+    this->bind_forwarded<commands::dc_external_derate::set_external_derating>(
+        [&](const types::dc_external_derate::ExternalDerating& derate) {
+            if (this->r_dc_external_derate.empty())
+                return;
 
-    this->rpc->bind("display_message_set_display_message", [&](std::string& request) {
-        if (this->r_display_message.empty()) {
-            types::display_message::SetDisplayMessageResponse rv;
-            rv.status = types::display_message::DisplayMessageStatusEnum::Rejected;
-            json j = rv;
-            return j.dump();
-        }
+            this->r_dc_external_derate[0]->call_set_external_derating(derate);
+        });
 
-        json j = this->r_display_message[0]->call_set_display_message(json::parse(request));
-        return j.dump();
-    });
+    this->bind_forwarded<commands::display_message::set_display_message>(
+        [&](const std::vector<types::display_message::DisplayMessage>& request) {
+            if (this->r_display_message.empty()) {
+                types::display_message::SetDisplayMessageResponse rv;
+                rv.status = types::display_message::DisplayMessageStatusEnum::Rejected;
+                return rv;
+            }
 
-    this->rpc->bind("display_message_get_display_messages", [&](std::string& request) {
-        if (this->r_display_message.empty()) {
-            json j = {};
-            return j.dump();
-        }
+            return this->r_display_message[0]->call_set_display_message(request);
+        });
 
-        json j = this->r_display_message[0]->call_get_display_messages(json::parse(request));
-        return j.dump();
-    });
+    this->bind_forwarded<commands::display_message::get_display_messages>(
+        [&](const types::display_message::GetDisplayMessageRequest& request) {
+            if (this->r_display_message.empty())
+                return types::display_message::GetDisplayMessageResponse{};
 
-    this->rpc->bind("display_message_clear_display_message", [&](std::string& request) {
-        if (this->r_display_message.empty()) {
-            types::display_message::ClearDisplayMessageResponse rv;
-            rv.status = types::display_message::ClearMessageResponseEnum::Unknown;
-            json j = rv;
-            return j.dump();
-        }
+            return this->r_display_message[0]->call_get_display_messages(request);
+        });
 
-        json j = this->r_display_message[0]->call_clear_display_message(json::parse(request));
-        return j.dump();
-    });
+    this->bind_forwarded<commands::display_message::clear_display_message>(
+        [&](const types::display_message::ClearDisplayMessageRequest& request) {
+            if (this->r_display_message.empty()) {
+                types::display_message::ClearDisplayMessageResponse rv;
+                rv.status = types::display_message::ClearMessageResponseEnum::Unknown;
+                return rv;
+            }
 
-    this->rpc->bind("iso15118_extensions_set_get_certificate_response", [&](std::string& certificate_response) {
-        if (this->r_iso15118_extensions.empty())
-            return;
+            return this->r_display_message[0]->call_clear_display_message(request);
+        });
 
-        this->r_iso15118_extensions[0]->call_set_get_certificate_response(json::parse(certificate_response));
-    });
+    this->bind_forwarded<commands::iso15118_extensions::set_get_certificate_response>(
+        [&](const types::iso15118::ResponseExiStreamStatus& certificate_response) {
+            if (this->r_iso15118_extensions.empty())
+                return;
 
-    this->rpc->bind("ocpp_data_transfer_data_transfer", [&](std::string& request) {
-        json j;
+            this->r_iso15118_extensions[0]->call_set_get_certificate_response(certificate_response);
+        });
 
-        if (not this->r_ocpp_data_transfer.empty()) {
-            j = this->r_ocpp_data_transfer[0]->call_data_transfer(json::parse(request));
-        } else {
-            types::ocpp::DataTransferResponse rv;
-            rv.status = types::ocpp::DataTransferStatus::Rejected;
-            j = rv;
-        }
+    this->bind_forwarded<commands::ocpp_data_transfer::data_transfer>(
+        [&](const types::ocpp::DataTransferRequest& request) {
+            if (this->r_ocpp_data_transfer.empty()) {
+                types::ocpp::DataTransferResponse rv;
+                rv.status = types::ocpp::DataTransferStatus::Rejected;
+                return rv;
+            }
 
-        return j.dump();
-    });
+            return this->r_ocpp_data_transfer[0]->call_data_transfer(request);
+        });
 
-    this->rpc->bind("system_update_firmware", [&](std::string& firmware_update_request) {
-        types::system::UpdateFirmwareResponse rv;
+    this->bind_forwarded<commands::system::update_firmware>(
+        [&](const types::system::FirmwareUpdateRequest& firmware_update_request) {
+            if (this->r_system.empty())
+                return types::system::UpdateFirmwareResponse::Rejected;
 
-        if (not this->r_system.empty()) {
             // we assume that the SatelliteController also performs a reset
             // in the near future so remember this
             this->disconnect_expected = true;
 
-            rv = this->r_system[0]->call_update_firmware(json::parse(firmware_update_request));
-        } else {
-            rv = types::system::UpdateFirmwareResponse::Rejected;
-        }
-
-        return types::system::update_firmware_response_to_string(rv);
-    });
+            return this->r_system[0]->call_update_firmware(firmware_update_request);
+        });
 
-    this->rpc->bind("system_allow_firmware_installation", [&]() {
+    this->bind_forwarded<commands::system::allow_firmware_installation>([&]() {
         if (this->r_system.empty())
             return;
 
         this->r_system[0]->call_allow_firmware_installation();
     });
 
-    this->rpc->bind("system_upload_logs", [&](std::string& upload_logs_request) {
-        json j;
-
-        if (not this->r_system.empty()) {
-            j = this->r_system[0]->call_upload_logs(json::parse(upload_logs_request));
-        } else {
-            // undefined behavior
-            j = {};
-        }
+    this->bind_forwarded<commands::system::upload_logs>(
+        [&](const types::system::UploadLogsRequest& upload_logs_request) {
+            if (this->r_system.empty()) {
+                types::system::UploadLogsResponse rv;
+                rv.upload_logs_status = types::system::UploadLogsStatus::Rejected;
+                return rv;
+            }
 
-        return j.dump();
-    });
+            return this->r_system[0]->call_upload_logs(upload_logs_request);
+        });
 
-    this->rpc->bind("sytem_is_reset_allowed", [&](std::string& type) {
+    this->bind_forwarded<commands::system::is_reset_allowed>([&](const types::system::ResetType& type) {
         if (this->r_system.empty())
             return false;
 
-        return this->r_system[0]->call_is_reset_allowed(types::system::string_to_reset_type(type));
+        return this->r_system[0]->call_is_reset_allowed(type);
     });
 
-    this->rpc->bind("sytem_reset", [&](std::string& type, bool& scheduled) {
+    this->bind_forwarded<commands::system::reset>([&](const types::system::ResetType& type, bool scheduled) {
         if (this->r_system.empty())
             return;
 
-        EVLOG_info << "Got reset request: " << type << " reset (" << (scheduled ? "" : "not ") << "scheduled).";
+        EVLOG_info << "Got reset request: " << types::system::reset_type_to_string(type) << " reset ("
+                   << (scheduled ? "" : "not ") << "scheduled).";
 
-        this->r_system[0]->call_reset(types::system::string_to_reset_type(type), scheduled);
+        this->r_system[0]->call_reset(type, scheduled);
 
         // gracefully shutdown the session and the server now to prevent re-connects
         EVLOG_info << "Terminating RPC session and server now.";
@@ -485,85 +609,214 @@ void SatelliteAgent::init_rpc_binds() {
         rpc::this_server().stop();
     });
 
-    this->rpc->bind("system_set_system_time", [&](std::string& timestamp) {
+    this->bind_forwarded<commands::system::set_system_time>([&](const std::string& timestamp) {
         if (this->r_system.empty())
             return false;
 
         return this->r_system[0]->call_set_system_time(timestamp);
     });
 
-    this->rpc->bind("system_get_boot_reason", [&]() {
-        types::system::BootReason rv;
-
-        if (not this->r_system.empty()) {
-            rv = this->r_system[0]->call_get_boot_reason();
-        } else {
+    this->bind_forwarded<commands::system::get_boot_reason>([&]() {
+        if (this->r_system.empty()) {
             // undefined behavior
-            rv = types::system::BootReason::Unknown;
+            return types::system::BootReason::Unknown;
         }
 
-        return types::system::boot_reason_to_string(rv);
+        return this->r_system[0]->call_get_boot_reason();
     });
 
-    this->rpc->bind("uk_random_delay_enable", [&]() {
+    this->bind_forwarded<commands::uk_random_delay::enable>([&]() {
         if (this->r_uk_random_delay.empty())
             return;
 
         this->r_uk_random_delay[0]->call_enable();
     });
 
-    this->rpc->bind("uk_random_delay_disable", [&]() {
+    this->bind_forwarded<commands::uk_random_delay::disable>([&]() {
         if (this->r_uk_random_delay.empty())
             return;
 
         this->r_uk_random_delay[0]->call_disable();
     });
 
-    this->rpc->bind("uk_random_delay_cancel", [&]() {
+    this->bind_forwarded<commands::uk_random_delay::cancel>([&]() {
         if (this->r_uk_random_delay.empty())
             return;
 
         this->r_uk_random_delay[0]->call_cancel();
     });
 
-    this->rpc->bind("uk_random_delay_set_duration_s", [&](int& value) {
+    this->bind_forwarded<commands::uk_random_delay::set_duration_s>([&](int value) {
         if (this->r_uk_random_delay.empty())
             return;
 
         this->r_uk_random_delay[0]->call_set_duration_s(value);
     });
 
-    this->rpc->bind("push_var", [&](std::string& json_s) {
-        json event = json::parse(json_s);
+    this->bind_notification("push_var", [&](const json& event) {
+        const auto var = satellite_link::controller_var_from_tag(event.at("tag").get<std::uint64_t>());
+
+        if (not var.has_value()) {
+            EVLOG_warning << "Ignoring unknown variable with tag " << event.at("tag") << ".";
+            return;
+        }
+
+        satellite_link::visit_var(var.value(), [&](auto id) {
+            using Var = satellite_link::var_traits<decltype(id)::value>;
+
+            Var::publish(*this, event.at("value").get<typename Var::type>());
+        });
+    });
+
+    // answers with the time of reception and of transmission, so that the SatelliteController can measure
+    // the round trip time and the offset of our clock (NTP-style); both times are given for the wall clock
+    // and for the monotonic clock, which stamps the forwarded variables; 'timeout_ms' is the time after
+    // which the SatelliteController is considered dead when it stops sending heartbeats
+    this->bind("heartbeat", [&](int& timeout_ms) {
+        const std::int64_t received_us = system_time_us();
+        const std::int64_t received_steady_us = steady_time_us();
 
-        if (event["interface"] == "auth") {
-            if (event["var"] == "token_validation_status")
-                this->p_auth->publish_token_validation_status(event["value"]);
+        if (not this->rpc_binds_enabled) {
+            rpc::this_handler().respond_error("not ready");
+            return std::vector<std::int64_t>{};
         }
-        if (event["interface"] == "system") {
-            if (event["var"] == "firmware_update_status")
-                this->p_system->publish_firmware_update_status(event["value"]);
-            else if (event["var"] == "log_status")
-                this->p_system->publish_log_status(event["value"]);
+
+        this->heartbeat_timeout_ms = std::max(timeout_ms, 0);
+        this->cv_retrieve_vars_seen.notify_all();
+
+        return std::vector<std::int64_t>{received_us, system_time_us(), received_steady_us, steady_time_us()};
+    });
+
+    // the metrics of the link in the OpenMetrics text format, the SatelliteController passes them on
+    this->bind("get_statistics", [&]() {
+        if (not this->rpc_binds_enabled) {
+            rpc::this_handler().respond_error("not ready");
+            return std::string();
+        }
+
+        return this->metrics.to_openmetrics();
+    });
+
+    // blobs too large to be sent inline are fetched by the SatelliteController chunk by chunk, so that
+    // each call stays small and other calls on the connection are served in between
+    this->bind("retrieve_blob_chunk", [&](std::uint64_t& id, std::uint64_t& offset) {
+        if (not this->rpc_binds_enabled) {
+            rpc::this_handler().respond_error("not ready");
+            return std::vector<std::uint8_t>{};
+        }
+
+        auto chunk = this->blob_channel.outgoing.chunk(id, offset);
+
+        if (not chunk.has_value()) {
+            rpc::this_handler().respond_error("unknown blob " + std::to_string(id));
+            return std::vector<std::uint8_t>{};
+        }
+
+        return std::move(chunk.value());
+    });
+
+    // the SatelliteController uploads its large blobs the same way before the call referencing them
+    this->bind("store_blob_chunk", [&](std::uint64_t& id, std::uint64_t& offset, std::uint64_t& size,
+                                       RPCLIB_MSGPACK::object& chunk) {
+        if (not this->rpc_binds_enabled) {
+            rpc::this_handler().respond_error("not ready");
+            return false;
         }
+
+        if (chunk.type != RPCLIB_MSGPACK::type::BIN)
+            return false;
+
+        return this->blob_channel.incoming.add_chunk(
+            id, offset, size, reinterpret_cast<const std::uint8_t*>(chunk.via.bin.ptr), chunk.via.bin.size);
     });
 
-    this->rpc->bind("retrieve_vars_and_errors", [&]() {
-        std::string rv;
+    // when 'max_wait_ms' is greater than zero, then the call is held open until at least one event
+    // or error is available or the given time elapsed (long-poll), otherwise it returns immediately;
+    // each variable and error carries a sequence number and is delivered again and again until the
+    // SatelliteController acknowledges it by passing the highest sequence number it received as 'ack'
+    this->bind("retrieve_vars_and_errors", [&](int& max_wait_ms, std::uint64_t& ack) {
+        satellite_link::Payload rv;
+
+        if (not this->rpc_binds_enabled) {
+            rpc::this_handler().respond_error("not ready");
+            return rv;
+        }
 
-        // using a scoped lock with both mutexes to access & reset the lists
         {
-            std::scoped_lock lock(this->event_list_guard, this->error_event_list_guard);
+            // this lock also ensures that only one thread at a time drains the event queue
+            std::unique_lock<std::mutex> lock(this->event_list_guard);
+
+            // forget everything the SatelliteController confirmed to have received; whatever is left
+            // was lost on the way, so deliver it again without waiting
+            const bool redeliver = this->unacked.acknowledge(ack);
 
-            json j{
-                {"vars", this->event_list},
-                {"errors", this->error_event_list},
-            };
+            if (redeliver)
+                this->redeliveries.inc();
 
-            rv = j.dump();
+            if (max_wait_ms > 0 and not redeliver) {
+                const auto max_wait = std::chrono::milliseconds(std::min(max_wait_ms, LONG_POLL_MAX_WAIT_MS));
+                const auto bulk_window = std::chrono::milliseconds(this->config.bulk_batching_window_ms);
+
+                this->var_queue.wait(lock, std::chrono::steady_clock::now() + max_wait, bulk_window, [this]() {
+                    return this->error_event_list_pending or this->disconnect_expected;
+                });
+            }
 
-            this->event_list = json::array();
-            this->error_event_list = json::array();
+            // serialize the queued events now, this is the only place where this happens
+            const bool packed_vars = this->packed_vars;
+            const auto start = std::chrono::steady_clock::now();
+            // while too many items wait for their acknowledgement, the events are left in the event queue,
+            // which drops and counts further ones once it runs full; states just replace their pending item
+            const bool take_events = not this->unacked.full();
+            // the events were dropped after those still queued had been published
+            const auto dropped = take_events ? this->var_queue.take_dropped() : 0;
+
+            for (auto& event : this->drain_event_list(take_events)) {
+                const auto index = static_cast<std::size_t>(event.var);
+                // the blobs are held until the item is acknowledged, since it may be delivered again
+                satellite_link::HoldingBlobChannel blobs(this->blob_channel.outgoing);
+                json value;
+
+                this->vars_forwarded[index]->inc();
+                this->var_queue_delay[index]->observe(start - event.published);
+
+                std::visit([&value, &blobs, packed_vars](const auto& v) {
+                    value = satellite_link::to_forwarded_value(v, packed_vars, &blobs);
+                }, event.value);
+
+                auto item = this->make_var_item(this->unacked.next_seq(), event, std::move(value));
+
+                if (this->tracer.is_enabled()) {
+                    const auto& info = satellite_link::var_info(event.var);
+                    this->trace_forwarded(item, std::string(info.interface) + "/" + info.var, event.published);
+                }
+
+                this->unacked.add_var(std::move(item), blobs.take_held());
+            }
+
+            if (dropped > 0)
+                this->unacked.add_var(satellite_link::make_dropped_item(this->unacked.next_seq(), dropped));
+
+            json errors = json::array();
+
+            {
+                std::scoped_lock error_lock(this->error_event_list_guard);
+
+                std::swap(errors, this->error_event_list);
+                this->error_event_list_pending = false;
+            }
+
+            for (auto& error : errors)
+                this->unacked.add_error(std::move(error));
+
+            this->errors_forwarded.inc(errors.size());
+
+            rv = satellite_link::encode(this->unacked.batch(), this->payload_encoding);
+            satellite_link::compress(rv, this->compression, this->config.compression_threshold_bytes);
+
+            this->batch_build_duration.observe(std::chrono::steady_clock::now() - start);
+            this->batch_items.set(this->unacked.size());
+            this->sent_bytes.inc(rv.data.size());
         }
 
         this->cv_retrieve_vars_seen.notify_all();
@@ -572,6 +825,118 @@ void SatelliteAgent::init_rpc_binds() {
     });
 }
 
+void SatelliteAgent::enqueue_notification(std::uint64_t seq, const std::string& name, std::function<void()> task) {
+    {
+        std::scoped_lock lock(this->notification_guard);
+
+        if (seq < this->next_notification_seq or this->notifications.count(seq) != 0) {
+            EVLOG_warning << "Ignoring duplicate notification '" << name << "' (#" << seq << ").";
+            return;
+        }
+
+        if (seq > this->next_notification_seq and this->notifications.count(seq - 1) == 0)
+            this->notifications_reordered.inc();
+
+        this->notifications.emplace(seq, QueuedNotification{name, std::move(task)});
+    }
+
+    this->cv_notification_queued.notify_all();
+}
+
+void SatelliteAgent::reset_notifications() {
+    std::scoped_lock lock(this->notification_guard);
+
+    // whatever is still queued waits for a predecessor which the previous SatelliteController
+    // never sent, since its connection is gone
+    if (not this->notifications.empty())
+        EVLOG_warning << "Discarding " << this->notifications.size()
+                      << " notification(s) of the previous SatelliteController.";
+
+    this->notifications.clear();
+    this->next_notification_seq = 1;
+}
+
+void SatelliteAgent::run_notifications() {
+    std::unique_lock<std::mutex> lock(this->notification_guard);
+
+    const auto in_sequence = [this]() {
+        return not this->notifications.empty() and this->notifications.begin()->first == this->next_notification_seq;
+    };
+
+    for (;;) {
+        // wait for the next notification in sequence: the link is a single TCP connection, so no
+        // notification gets lost, but several RPC workers receive them and may hand them over out of
+        // order; a missing one is never skipped, since it may be a command which must be executed
+        if (not this->cv_notification_queued.wait_for(lock, NOTIFICATION_GAP_WARNING_TIMEOUT, in_sequence)) {
+            if (not this->notifications.empty())
+                EVLOG_warning << "Waiting for notification #" << this->next_notification_seq << ", "
+                              << this->notifications.size() << " later one(s) held back.";
+
+            this->cv_notification_queued.wait(lock, in_sequence);
+        }
+
+        auto it = this->notifications.begin();
+
+        this->next_notification_seq = it->first + 1;
+        QueuedNotification notification = std::move(it->second);
+        this->notifications.erase(it);
+
+        lock.unlock();
+
+        if (not notification.task) {
+            EVLOG_error << "Dropped malformed notification '" << notification.name << "'.";
+        } else {
+            try {
+                notification.task();
+            } catch (const std::exception& e) {
+                EVLOG_error << "Notification '" << notification.name << "' failed: " << e.what();
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+bool SatelliteAgent::acquire_command_worker(const std::string& name) {
+    if (not this->rpc_binds_enabled) {
+        rpc::this_handler().respond_error("not ready");
+        return false;
+    }
+
+    // admission control: never let commands occupy the reserved workers
+    if (++this->commands_in_flight > this->config.rpc_worker_threads) {
+        this->commands_in_flight--;
+
+        EVLOG_warning << "All " << this->config.rpc_worker_threads << " command workers are busy, rejecting '"
+                      << name << "'.";
+        this->commands_rejected.inc();
+        rpc::this_handler().respond_error("busy");
+        return false;
+    }
+
+    return true;
+}
+
+void SatelliteAgent::release_command_worker() {
+    this->commands_in_flight--;
+}
+
+void SatelliteAgent::run_metrics_file() {
+    const auto interval = std::chrono::milliseconds(this->config.metrics_file_interval_ms);
+    bool warned{false};
+
+    for (;;) {
+        std::this_thread::sleep_for(interval);
+
+        if (this->metrics.write_file(this->config.metrics_file)) {
+            warned = false;
+        } else if (not warned) {
+            EVLOG_warning << "Could not write metrics to '" << this->config.metrics_file << "'.";
+            warned = true;
+        }
+    }
+}
+
 void SatelliteAgent::trigger_reset() {
     if (not this->r_system.empty()) {
         this->r_system[0]->call_reset(types::system::ResetType::Soft, false);
@@ -27,13 +27,36 @@
 
 // ev@4bf81b14-a215-475c-a1d3-0a484ae48918:v1
 // insert your custom include headers here
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <nlohmann/json.hpp>
 #include <rpc/server.h>
+#include <satellite_link/blob.hpp>
+#include <satellite_link/codec.hpp>
+#include <satellite_link/delivery.hpp>
+#include <satellite_link/generated/commands.hpp>
+#include <satellite_link/metrics.hpp>
+#include <satellite_link/packed_types.hpp>
+#include <satellite_link/payload.hpp>
+#include <satellite_link/recorder.hpp>
+#include <satellite_link/trace.hpp>
+#include <satellite_link/var_queue.hpp>
+#include <satellite_link/vars.hpp>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 using json = nlohmann::json;
 // ev@4bf81b14-a215-475c-a1d3-0a484ae48918:v1
@@ -42,6 +65,15 @@ namespace module {
 
 struct Conf {
     int port;
+    int bulk_batching_window_ms;
+    int rpc_worker_threads;
+    int delta_keyframe_interval;
+    std::string compression;
+    int compression_threshold_bytes;
+    std::string metrics_file;
+    int metrics_file_interval_ms;
+    std::string trace_file;
+    std::string traffic_record_file;
 };
 
 class SatelliteAgent : public Everest::ModuleBase {
@@ -128,35 +160,324 @@ private:
     /// @brief Mutex used for locks to protect the condition variable 'cv_i_am_ready_myself'.
     std::mutex lock_i_am_ready_myself;
 
-    /// @brief Accumulates all events which needs to be passed to the SatelliteController
-    ///        until it calls the RPC call "retrieve_vars". This call empties it, and then
-    ///        next events are accumulated again.
-    json event_list;
-    /// @brief A flag indicating whether the event list grewed up to a threshold which
-    ///        triggers a warning and initiates a reboot.
-    bool event_list_size_warned{false};
-    /// @brief Condition variable to signal a call to RPC function "retrieve_vars" to
+    /// @brief A flag indicating whether the event queue ran full and further events are dropped;
+    ///        warned about once until the queue is drained again.
+    std::atomic_bool event_list_size_warned{false};
+    /// @brief Condition variable to signal a call to RPC function "retrieve_vars" (or "heartbeat") to
     ///        the observer functionality in 'ready'. This observer is used detect
     ///        when periodic calls to this function are overdue.
     std::condition_variable cv_retrieve_vars_seen;
-    /// @brief Mutex used for locks to protect the condition variable 'cv_retrieve_vars_seen'.
+    /// @brief Timeout of the observer in 'ready' as requested by the heartbeat of the SatelliteController;
+    ///        0 as long as there is no heartbeat.
+    std::atomic_int heartbeat_timeout_ms{0};
+    /// @brief Mutex used for locks to protect the condition variable 'cv_retrieve_vars_seen' and to wait
+    ///        for 'var_queue'; it also ensures that only one thread drains 'var_queue'.
     std::mutex event_list_guard;
+    /// @brief Accumulates all variables which need to be passed to the SatelliteController until it calls
+    ///        the RPC function "retrieve_vars_and_errors"; subscription callbacks push into it without
+    ///        locking, and the values are serialized only when it is drained. Wakes up a pending long-poll
+    ///        call of "retrieve_vars_and_errors" as soon as new events, states or errors were queued.
+    satellite_link::VarQueue var_queue{this->event_list_guard};
+    /// @brief Set when the error event list received new items.
+    std::atomic_bool error_event_list_pending{false};
+
+    /// @brief Variables and errors already delivered, but not yet acknowledged by the SatelliteController;
+    ///        they are delivered again until they are acknowledged, and keep the blobs they reference in
+    ///        'blob_channel' until then. Protected by 'event_list_guard'.
+    satellite_link::UnackedItems unacked{&this->blob_channel.outgoing};
+
+    /// @brief Whether changes of delta encoded variables are forwarded as diff, negotiated via 'link_setup';
+    ///        protected by 'event_list_guard'.
+    bool delta_vars{false};
+    /// @brief The last forwarded value of a delta encoded variable, the base of the next diff.
+    struct DeltaBaseline {
+        /// @brief Null until the variable was forwarded (again) after the link setup.
+        json value;
+        /// @brief Sequence number with which 'value' was delivered.
+        std::uint64_t seq{0};
+        /// @brief Count of diffs forwarded since the last full value.
+        int deltas{0};
+    };
+    /// @brief Base of the next diff for each delta encoded variable; protected by 'event_list_guard'.
+    std::array<DeltaBaseline, satellite_link::agent_var_infos.size()> delta_baselines;
 
     std::atomic_bool disconnect_expected{false};
 
-    /// @brief Accumulates all error events which need to be passed to the
-    ///        SatelliteController until it calls the RPC call "retrieve_errors".
-    ///        This call empties it, and then next errors are accumulated again.
+    /// @brief Encoding of structured payloads sent to the SatelliteController, negotiated via 'link_setup'.
+    std::atomic<satellite_link::PayloadEncoding> payload_encoding{satellite_link::PayloadEncoding::Json};
+
+    /// @brief Whether variables with a packed layout are forwarded in it instead of JSON, negotiated via 'link_setup'.
+    std::atomic_bool packed_vars{false};
+
+    /// @brief Codec for large batches of variables and errors, negotiated via 'link_setup'.
+    std::atomic<satellite_link::Compression> compression{satellite_link::Compression::None};
+
+    /// @brief Blob channel of the agent: outgoing blobs are kept until the SatelliteController fetches
+    ///        them with "retrieve_blob_chunk", incoming ones are uploaded with "store_blob_chunk".
+    class StoredBlobChannel : public satellite_link::BlobChannel {
+    public:
+        std::optional<satellite_link::BlobRef> send(std::vector<std::uint8_t>& bytes) override {
+            return this->outgoing.put(std::move(bytes));
+        }
+
+        std::vector<std::uint8_t> receive(const satellite_link::BlobRef& ref) override {
+            return this->incoming.take(ref);
+        }
+
+        satellite_link::BlobStore outgoing;
+        satellite_link::BlobAssembler incoming;
+    };
+
+    /// @brief Transfers the blobs of variables and commands which are too large to be sent inline.
+    StoredBlobChannel blob_channel;
+
+    /// @brief Metrics of the link, returned by the RPC function "get_statistics" and written to 'metrics_file'.
+    satellite_link::Metrics metrics{"satellite_agent_"};
+    /// @brief Per forwarded variable: count of forwarded values, and time from publication in EVerest
+    ///        until delivery to the SatelliteController; set up in 'init' before subscribing.
+    std::array<satellite_link::Counter*, satellite_link::agent_var_infos.size()> vars_forwarded{};
+    std::array<satellite_link::Histogram*, satellite_link::agent_var_infos.size()> var_queue_delay{};
+    // metrics of the hot paths, looked up once
+    satellite_link::Counter& errors_forwarded{
+        this->metrics.counter("errors_forwarded", "Errors raised or cleared, forwarded to the SatelliteController")};
+    satellite_link::Counter& redeliveries{this->metrics.counter(
+        "redeliveries", "Batches which repeat variables or errors not acknowledged by the SatelliteController")};
+    satellite_link::Counter& sent_bytes{
+        this->metrics.counter("sent_bytes", "Size of the batches of variables and errors")};
+    satellite_link::Gauge& batch_items{this->metrics.gauge(
+        "batch_items", "Count of variables and errors in the last batch, including not yet acknowledged ones")};
+    satellite_link::Histogram& batch_build_duration{this->metrics.histogram(
+        "batch_build_duration_seconds", "Time to serialize a batch of variables and errors (without long-poll)")};
+    satellite_link::Counter& commands_rejected{
+        this->metrics.counter("commands_rejected", "Commands rejected since all command workers were busy")};
+    satellite_link::Counter& events_dropped{
+        this->metrics.counter("events_dropped", "Events dropped since the event queue was full")};
+    satellite_link::Counter& notifications_reordered{this->metrics.counter(
+        "notifications_reordered", "Notifications received before their predecessor and held back until it arrived")};
+
+    /// @brief Writes 'metrics' to 'metrics_file' periodically, runs forever.
+    void run_metrics_file();
+
+    /// @brief Writes the spans of this side of the link to 'trace_file', if configured.
+    satellite_link::Tracer tracer;
+
+    /// @brief Records all traffic of the link to 'traffic_record_file', if configured.
+    satellite_link::TrafficRecorder recorder;
+
+    /// @brief Helper to record the span of a variable or error forwarded to the SatelliteController, from
+    ///        'since' until now, and to pass its context along with the item.
+    void trace_forwarded(json& item, const std::string& name, std::chrono::steady_clock::time_point since);
+
+    /// @brief Accumulates all error events which need to be passed to the SatelliteController until it
+    ///        calls the RPC function "retrieve_vars_and_errors", which empties it.
     json error_event_list;
-    /// @brief Mutex used for locks to protect the `errors_raised_list` and `errors_cleared_list`.
+    /// @brief Mutex used for locks to protect 'error_event_list'.
     std::mutex error_event_list_guard;
 
-    /// @brief Helper to add an item to the event list.
-    void add_to_event_list(std::string interface, std::string var, json value);
+    /// @brief Helper to add an item to the event queue or to update the slot of a state variable.
+    void add_to_event_list(satellite_link::AgentVar var, satellite_link::AgentVarValue value);
+
+    /// @brief Helper to collect all queued events (unless 'take_events' is false) and pending state updates,
+    ///        ordered by priority and then by publication order.
+    std::vector<satellite_link::VarEvent> drain_event_list(bool take_events);
+
+    /// @brief Helper to create the item of the variables list for a drained event, either with the full
+    ///        value or with a diff against the last forwarded value; expects 'event_list_guard' to be held.
+    json make_var_item(std::uint64_t seq, const satellite_link::VarEvent& event, json value);
+
+    /// @brief Helper to restart delta encoding for a new SatelliteController, which does not know any of
+    ///        the bases: pending diffs are replaced by full values; expects 'event_list_guard' to be held.
+    void reset_delta_encoding(bool enabled);
 
     /// @brief Helper to add an item to the error event list.
     void add_to_error_event_list(std::string action, const Everest::error::Error& error);
 
+    /// @brief Count of RPC workers which never serve commands, but are reserved for the event drain
+    ///        (a possibly parked long-poll of "retrieve_vars_and_errors") and the control calls.
+    static constexpr int RPC_RESERVED_WORKERS{2};
+    /// @brief Count of command handlers currently running.
+    std::atomic_int commands_in_flight{0};
+    /// @brief Set once the peer is synced, before that the functors of 'init_rpc_binds' reject all calls.
+    std::atomic_bool rpc_binds_enabled{false};
+
+    /// @brief Helper to bind a function on the RPC server; if 'traffic_record_file' is configured, each call
+    ///        is recorded with its arguments and result, or the exception it throws. Note that an error
+    ///        responded via 'rpc::this_handler' is recorded as the placeholder result the function returns.
+    template <typename F> void bind(const std::string& name, F func) {
+        this->bind(name, std::move(func), &F::operator());
+    }
+
+    template <typename F, typename R, typename... Args>
+    void bind(const std::string& name, F func, R (F::*)(Args...) const) {
+        if (not this->recorder.is_enabled()) {
+            this->rpc->bind(name, std::move(func));
+            return;
+        }
+
+        this->rpc->bind(name, [this, name, func = std::move(func)](Args... args) -> R {
+            const auto record_id = this->recorder.call(name, args...);
+
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    func(args...);
+                    this->recorder.result(record_id);
+                } else {
+                    R rv = func(args...);
+                    this->recorder.result(record_id, rv);
+                    return rv;
+                }
+            } catch (const std::exception& e) {
+                this->recorder.error(record_id, e.what());
+                throw;
+            }
+        });
+    }
+
+    /// @brief Wire type of an argument of a tunnelled command: all arguments are received as msgpack
+    ///        objects and decoded with the 'satellite_link::Codec' of the handler's argument type.
+    template <typename T> using wire_arg_t = std::conditional_t<true, RPCLIB_MSGPACK::object, T>;
+
+    /// @brief Helper to bind the server skeleton of a tunnelled command: checks the handler against the
+    ///        command descriptor generated from the interface definition, and binds it as command or as
+    ///        notification, depending on the descriptor.
+    template <typename Cmd, typename F> void bind_forwarded(F func) {
+        this->bind_forwarded<Cmd>(std::move(func), &F::operator());
+    }
+
+    template <typename Cmd, typename F, typename R, typename... Args>
+    void bind_forwarded(F func, R (F::*)(Args...) const) {
+        static_assert(std::is_same_v<std::tuple<std::decay_t<Args>...>, typename Cmd::argument_types>,
+                      "handler arguments do not match the interface definition");
+        static_assert(std::is_same_v<R, typename Cmd::result_type>,
+                      "handler result does not match the interface definition");
+
+        if constexpr (Cmd::notification)
+            this->bind_notification(Cmd::name, std::move(func));
+        else
+            this->bind_command(Cmd::name, std::move(func));
+    }
+
+    /// @brief Helper to bind a command, i.e. a function which calls into EVerest and thus can take long.
+    ///        At most 'rpc_worker_threads' commands are served at a time, further calls are rejected
+    ///        with an error so that they cannot occupy the reserved workers.
+    template <typename F> void bind_command(const std::string& name, F func) {
+        this->bind_command(name, std::move(func), &F::operator());
+    }
+
+    template <typename F, typename R, typename... Args>
+    void bind_command(const std::string& name, F func, R (F::*)(Args...) const) {
+        using WireResult = satellite_link::wire_type_t<R>;
+
+        auto& duration = this->metrics.histogram("command_duration_seconds", "Time to execute a command",
+                                                 {{"command", name}});
+
+        this->bind(name, [this, name, &duration, func = std::move(func)](
+                             satellite_link::TraceContext& trace, wire_arg_t<Args>&... args) -> WireResult {
+            if (not this->acquire_command_worker(name)) {
+                if constexpr (std::is_void_v<R>)
+                    return;
+                else
+                    return WireResult{};
+            }
+
+            // a child of the SatelliteController's span of the call, if it traces as well
+            satellite_link::Span span(this->tracer, name.c_str(), "command", trace);
+
+            struct Release {
+                SatelliteAgent& agent;
+                satellite_link::Histogram& duration;
+                std::chrono::steady_clock::time_point start;
+                ~Release() {
+                    duration.observe(std::chrono::steady_clock::now() - start);
+                    agent.release_command_worker();
+                }
+            } release{*this, duration, std::chrono::steady_clock::now()};
+
+            // a decoding error is passed as error response to the caller by rpclib
+            std::tuple<std::decay_t<Args>...> held{
+                satellite_link::Codec<std::decay_t<Args>>::decode(args, &this->blob_channel)...};
+
+            if constexpr (std::is_void_v<R>)
+                std::apply(func, held);
+            else
+                return satellite_link::Codec<R>::encode(std::apply(func, held), this->payload_encoding,
+                                                        &this->blob_channel);
+        });
+    }
+
+    /// @brief Time after which a still missing notification is warned about; it is waited for nevertheless.
+    static constexpr std::chrono::seconds NOTIFICATION_GAP_WARNING_TIMEOUT{1};
+
+    /// @brief A received notification, waiting for its execution.
+    struct QueuedNotification {
+        std::string name;
+        /// @brief Empty if the notification could not be decoded.
+        std::function<void()> task;
+    };
+
+    /// @brief Received notifications, indexed by their sequence number; protected by 'notification_guard'.
+    std::map<std::uint64_t, QueuedNotification> notifications;
+    /// @brief Sequence number of the notification to execute next; protected by 'notification_guard'.
+    std::uint64_t next_notification_seq{1};
+    /// @brief Mutex used for locks to protect 'notifications' and 'next_notification_seq'.
+    std::mutex notification_guard;
+    /// @brief Condition variable to signal that a notification was queued.
+    std::condition_variable cv_notification_queued;
+
+    /// @brief Helper to bind a notification, i.e. a void command which the SatelliteController does not
+    ///        wait for. On the wire, a sequence number precedes the arguments, and all notifications are
+    ///        executed one after another in the order of these numbers, on a dedicated thread.
+    template <typename F> void bind_notification(const std::string& name, F func) {
+        this->bind_notification(name, std::move(func), &F::operator());
+    }
+
+    template <typename F, typename... Args>
+    void bind_notification(const std::string& name, F func, void (F::*)(Args...) const) {
+        auto& duration = this->metrics.histogram("command_duration_seconds", "Time to execute a command",
+                                                 {{"command", name}});
+
+        this->bind(name, [this, name, &duration, func = std::move(func)](
+                             std::uint64_t& seq, satellite_link::TraceContext& trace, wire_arg_t<Args>&... args) {
+            std::function<void()> task;
+
+            try {
+                // the received arguments are only valid during this call, so decode them now
+                auto held = std::make_shared<std::tuple<std::decay_t<Args>...>>(
+                    satellite_link::Codec<std::decay_t<Args>>::decode(args, &this->blob_channel)...);
+                // the span includes the time the notification waits for its turn
+                const auto span = this->tracer.start(trace);
+                const auto received = satellite_link::Tracer::Clock::now();
+
+                // runs later on the notification thread, so it must not refer to anything of this call
+                task = [this, name, func, held, &duration, trace, span, received]() {
+                    const auto start = std::chrono::steady_clock::now();
+                    std::apply(func, *held);
+                    duration.observe(std::chrono::steady_clock::now() - start);
+                    this->tracer.record(name, "notification", span, trace, received,
+                                        satellite_link::Tracer::Clock::now());
+                };
+            } catch (const std::exception&) {
+                // queue it anyway to keep the sequence intact
+            }
+
+            this->enqueue_notification(seq, name, std::move(task));
+        });
+    }
+
+    /// @brief Helper to queue a received notification for execution.
+    void enqueue_notification(std::uint64_t seq, const std::string& name, std::function<void()> task);
+    /// @brief Helper to restart the sequence of notifications for a new SatelliteController, which
+    ///        numbers them from 1 again; called by 'link_setup'.
+    void reset_notifications();
+    /// @brief Executes the queued notifications in order of their sequence numbers, runs forever.
+    void run_notifications();
+
+    /// @brief Helper to admit a command to a worker; responds with an error and returns false if
+    ///        the peer is not synced yet or all command workers are busy.
+    bool acquire_command_worker(const std::string& name);
+    /// @brief Helper to give back a worker acquired with 'acquire_command_worker'.
+    void release_command_worker();
+
     /// @brief Helper to register all 'real' RPC functors.
     void init_rpc_binds();
     /// @brief Helper to initiate a reset.
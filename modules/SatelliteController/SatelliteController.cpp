@@ -1,15 +1,30 @@
 // SPDX-License-Identifier: GPL-3.0-only
 // Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <deque>
+#include <exception>
+#include <future>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 #include "configuration.h"
 #include "SatelliteController.hpp"
 #include <rpc/client.h>
 #include <rpc/rpc_error.h>
 #include <nlohmann/json.hpp>
+#include <satellite_link/delivery.hpp>
+#include <satellite_link/payload.hpp>
+#include <satellite_link/protocol.hpp>
+#include <satellite_link/vars.hpp>
 #include <utils/error/error_json.hpp>
 
 using json = nlohmann::json;
@@ -17,10 +32,105 @@ using namespace std::chrono_literals;
 
 namespace module {
 
+/// @brief Delay before "retrieve_vars_and_errors" is called again after it failed, e.g. since the agent is not
+///        ready yet.
+static constexpr std::chrono::seconds RETRIEVE_RETRY_DELAY{1};
+
+/// @brief Count of received batches which may wait in addition to the one being dispatched.
+static constexpr std::size_t DISPATCH_MAX_PENDING_BATCHES{1};
+
+/// @brief Count of recent heartbeats the clock offset is estimated from.
+static constexpr std::size_t HEARTBEAT_FILTER_SIZE{8};
+
+/// @brief Minimum interval of publishing the measured round trip time and clock offset.
+static constexpr std::chrono::seconds HEARTBEAT_PUBLISH_INTERVAL{1};
+
+/// @brief Sub type of the CommunicationFault raised when the heartbeat is missed.
+static const std::string HEARTBEAT_ERROR_SUB_TYPE{"heartbeat"};
+
+/// @brief Minimum interval of warnings about the latency of the same variable.
+static constexpr std::chrono::seconds LATENCY_WARNING_INTERVAL{10};
+
+/// @brief Sub type of the CommunicationFault raised while the SatelliteAgent drops events.
+static const std::string EVENTS_DROPPED_ERROR_SUB_TYPE{"events_dropped"};
+
+/// @brief Helper to return the time of the monotonic clock in microseconds since its (arbitrary) epoch.
+static std::int64_t steady_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
 SatelliteController::~SatelliteController() {
-    // if still connected, tell the peer that we are quitting now
+    // if still connected, tell the peer that we are quitting now, but do not wait for a dead one
     if (this->rpc->get_connection_state() == rpc::client::connection_state::connected)
-        this->rpc->call("exit");
+        this->call(CallClass::Control, "exit");
+}
+
+std::chrono::milliseconds SatelliteController::call_timeout(CallClass call_class) const {
+    switch (call_class) {
+    case CallClass::Control:
+        return std::chrono::milliseconds(this->config.control_call_timeout_ms);
+    case CallClass::Default:
+        return std::chrono::milliseconds(this->config.call_timeout_ms);
+    case CallClass::Long:
+        return std::chrono::milliseconds(this->config.long_call_timeout_ms);
+    }
+
+    return std::chrono::milliseconds(this->config.call_timeout_ms);
+}
+
+void SatelliteController::log_malformed_result(const std::string& func_name, const std::exception& e) const {
+    EVLOG_error << "Result of '" << func_name << "' could not be decoded: " << e.what();
+}
+
+SatelliteController::CallMetrics SatelliteController::make_call_metrics(const std::string& func_name) {
+    CallMetrics rv;
+
+    rv.duration = &this->metrics.histogram("call_duration_seconds", "Time until the result of a call arrived",
+                                           {{"method", func_name}});
+    rv.timeouts = &this->metrics.counter("call_failures", "Calls which timed out or failed",
+                                         {{"method", func_name}, {"reason", "timeout"}});
+    rv.errors = &this->metrics.counter("call_failures", "Calls which timed out or failed",
+                                       {{"method", func_name}, {"reason", "error"}});
+
+    return rv;
+}
+
+std::optional<RPCLIB_MSGPACK::object_handle>
+SatelliteController::wait_for_call(CallClass call_class, const std::string& func_name,
+                                   std::future<RPCLIB_MSGPACK::object_handle> future, std::uint64_t record_id) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto timeout = this->call_timeout(call_class);
+
+    // all functions we call are known in advance, the registry is only a fallback
+    const auto it = this->call_metrics.find(func_name);
+    const auto metrics = it != this->call_metrics.end() ? it->second : this->make_call_metrics(func_name);
+
+    // note: when we give up, the result is just discarded once it arrives
+    if (future.wait_for(timeout) == std::future_status::timeout) {
+        EVLOG_error << "Call of '" << func_name << "' timed out after " << timeout.count() << " ms.";
+        metrics.timeouts->inc();
+        this->recorder.error(record_id, "timeout");
+        return std::nullopt;
+    }
+
+    try {
+        auto rv = future.get();
+        metrics.duration->observe(std::chrono::steady_clock::now() - start);
+        this->recorder.result(record_id, rv.get());
+        return rv;
+    } catch (const rpc::rpc_error& e) {
+        const auto& error = e.get_error().get();
+        const auto message = error.type == RPCLIB_MSGPACK::type::STR ? error.as<std::string>() : e.what();
+        EVLOG_error << "Call of '" << func_name << "' failed: " << message;
+        this->recorder.error(record_id, message);
+    } catch (const std::exception& e) {
+        EVLOG_error << "Call of '" << func_name << "' failed: " << e.what();
+        this->recorder.error(record_id, e.what());
+    }
+
+    metrics.errors->inc();
+    return std::nullopt;
 }
 
 void SatelliteController::init() {
@@ -38,35 +148,52 @@ void SatelliteController::init() {
 
     EVLOG_info << MODULE_DESCRIPTION << " (version: " << PROJECT_VERSION << ")";
 
+    if (not this->config.trace_file.empty() and not this->tracer.open(this->config.trace_file, "SatelliteController"))
+        EVLOG_warning << "Could not open trace file '" << this->config.trace_file << "', tracing is disabled.";
+
+    if (not this->config.traffic_record_file.empty() and
+        not this->recorder.open(this->config.traffic_record_file, "SatelliteController"))
+        EVLOG_warning << "Could not open traffic record file '" << this->config.traffic_record_file
+                      << "', recording is disabled.";
+
+    // metrics per function called on the agent: the tunnelled commands and our own functions
+    for (const auto* func_name : satellite_link::commands::wire_names)
+        this->call_metrics.emplace(func_name, this->make_call_metrics(func_name));
+    for (const auto* func_name : {"get_statistics", "store_blob_chunk", "retrieve_blob_chunk", "exit"})
+        this->call_metrics.emplace(func_name, this->make_call_metrics(func_name));
+
+    // metrics per variable received from the agent
+    for (std::size_t i = 0; i < satellite_link::agent_var_infos.size(); i++) {
+        const auto& info = satellite_link::agent_var_infos[i];
+        const satellite_link::MetricLabels labels{{"interface", info.interface}, {"var", info.var}};
+
+        this->vars_received[i] =
+            &this->metrics.counter("vars_received", "Values received from the SatelliteAgent", labels);
+        this->var_publish_duration[i] =
+            &this->metrics.histogram("var_publish_duration_seconds", "Time to publish a value in EVerest", labels);
+        this->var_latency[i] = &this->metrics.histogram(
+            "var_latency_seconds", "Time from the publication of a value on the SatelliteAgent until here", labels);
+        this->var_latency_max[i] =
+            &this->metrics.gauge("var_latency_max_seconds", "Highest value of 'var_latency_seconds'", labels);
+    }
+
     //
     // register all callbacks for our desired interfaces
     // note: the callbacks are supposed to be not called yet since we are still in init phase;
     //       otherwise dereferencing of rpc would occur and we would crash
     //       (per definition, rpc has to be set up and running once we go from 'init' to 'ready')
     //
-    this->r_auth->subscribe_token_validation_status([&](types::authorization::TokenValidationStatusMessage value) {
-        json j = json::object({ {"interface", "auth"},
-                                {"var", "token_validation_status"},
-                                {"value", value} });
-        this->rpc->call("push_var", j.dump());
-    });
+    satellite_link::for_each_controller_var([this](auto var) {
+        using Var = satellite_link::var_traits<decltype(var)::value>;
 
-    // the manifest allows system to be not linked to a real module
-    if (not this->r_system.empty()) {
-        this->r_system[0]->subscribe_firmware_update_status([&](types::system::FirmwareUpdateStatus value) {
-            json j = json::object({ {"interface", "system"},
-                                    {"var", "firmware_update_status"},
-                                    {"value", value} });
-            this->rpc->call("push_var", j.dump());
+        // the manifest allows e.g. system to be not linked to a real module, then nothing is subscribed
+        Var::subscribe(*this, [this, var](typename Var::type value) {
+            satellite_link::Span span(this->tracer, satellite_link::var_info(var.value).var, "forward");
+            json j = json::object({ {"tag", satellite_link::to_tag(var.value)}, {"value", value} });
+            this->notify(CallClass::Default, "push_var", span.context(),
+                         satellite_link::encode(j, this->payload_encoding));
         });
-
-        this->r_system[0]->subscribe_log_status([&](types::system::LogStatus value) {
-            json j = json::object({ {"interface", "system"},
-                                    {"var", "log_status"},
-                                    {"value", value} });
-            this->rpc->call("push_var", j.dump());
-        });
-    }
+    });
 
     //
     // we need a two step approach here to handle cases when satellite and ourself lost synchronization
@@ -74,6 +201,14 @@ void SatelliteController::init() {
     EVLOG_info << "Connecting to SatelliteAgent on " << this->config.hostname << ":" << this->config.port << "...";
     bool i_am_here_rv{true};
 
+    // the calls of the handshake are recorded as well, a replay needs them to set up the link
+    const auto handshake_call = [this](const std::string& func_name, const auto&... args) {
+        const auto record_id = this->recorder.call(func_name, args...);
+        auto rv = this->rpc->call(func_name, args...);
+        this->recorder.result(record_id, rv.get());
+        return rv;
+    };
+
     do {
         // assigning this variable should call the destructor of previous instance if already set -> closes connection
         try {
@@ -85,7 +220,7 @@ void SatelliteController::init() {
 
             // the 'i_am_here' call returns true in case the peer has seen us before (and is not in boot-up sync phase anymore)
             EVLOG_debug << "Signaling 'i_am_here'...";
-            i_am_here_rv = this->rpc->call("i_am_here").as<bool>();
+            i_am_here_rv = handshake_call("i_am_here").as<bool>();
             EVLOG_debug << "...got: " << i_am_here_rv;
 
         } catch (const rpc::system_error& e) {
@@ -99,12 +234,54 @@ void SatelliteController::init() {
     } while (i_am_here_rv);
 
     // once 'i_am_here' returned, we are allowed to call all other RPC callbacks as well
+    // negotiate the link properties first, request and response are always JSON text
+    // we can always decode packed variables and apply diffs, the agent decides whether it sends them
+    json link_options{
+        {"protocol_version", satellite_link::PROTOCOL_VERSION},
+        {"tables_hash", satellite_link::TUNNEL_TABLES_HASH},
+        {"payload_encoding", this->config.payload_encoding},
+        {"packed_vars", true},
+        {"delta_vars", true},
+        {"compression", satellite_link::supported_compressions()},
+    };
+    json link_setup = json::object();
+
+    try {
+        link_setup = json::parse(handshake_call("link_setup", link_options.dump()).as<std::string>());
+    } catch (const rpc::rpc_error& e) {
+        // an agent of protocol version 1 does not know 'link_setup' at all, others reject our version
+        // or our tunnel.yaml
+        const auto& error = e.get_error().get();
+        EVLOG_error << "SatelliteAgent on " << this->config.hostname << ":" << this->config.port
+                    << " refused the link setup: "
+                    << (error.type == RPCLIB_MSGPACK::type::STR ? error.as<std::string>() : e.what())
+                    << ". Both sides must run the same release, terminating.";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // the signatures of the RPC functions depend on the protocol version, and the tags of the variables
+    // and the commands on tunnel.yaml, so both must match exactly
+    if (link_setup.value("protocol_version", 1) != satellite_link::PROTOCOL_VERSION or
+        link_setup.value("tables_hash", std::uint64_t{0}) != satellite_link::TUNNEL_TABLES_HASH) {
+        EVLOG_error << "SatelliteAgent on " << this->config.hostname << ":" << this->config.port
+                    << " speaks protocol version " << link_setup.value("protocol_version", 1)
+                    << " or was built from another tunnel.yaml. Both sides must run the same release, terminating.";
+        std::exit(EXIT_FAILURE);
+    }
+
+    this->payload_encoding = satellite_link::string_to_payload_encoding(link_setup.at("payload_encoding"));
+    EVLOG_info << "Using payload encoding '" << satellite_link::payload_encoding_to_string(this->payload_encoding)
+               << "'" << (link_setup.value("packed_vars", false) ? " with packed variables" : "")
+               << (link_setup.value("delta_vars", false) ? " with delta encoded variables" : "")
+               << ", compression '" << link_setup.value("compression", "none") << "'.";
+
     // let's move from 'init' phase to 'ready' simultaneously with peer
     EVLOG_debug << "Signaling 'i_am_ready'...";
-    this->rpc->call("i_am_ready");
+    handshake_call("i_am_ready");
 
-    // clear the global timeout again, we want usual RPC calls to "hang" when connection is lost
-    this->rpc->clear_timeout();
+    // the global timeout stays set, but it only applies to the synchronous calls of the handshake: all later
+    // calls are asynchronous and wait for their results with their own deadlines (see 'call'), so that none
+    // of them hangs when the connection is lost
 }
 
 void SatelliteController::ready() {
@@ -120,122 +297,553 @@ void SatelliteController::ready() {
     invoke_ready(*p_system);
     invoke_ready(*p_uk_random_delay);
 
+    // publishing into EVerest happens on a separate thread, so that the next batch is already
+    // fetched while the previous one is dispatched
+    std::thread(&SatelliteController::run_dispatch, this).detach();
+
+    if (this->config.heartbeat_interval_ms > 0)
+        std::thread(&SatelliteController::run_heartbeat, this).detach();
+
+    if (not this->config.metrics_file.empty())
+        std::thread(&SatelliteController::run_metrics_file, this).detach();
+
+    // in long-poll mode the agent holds our call open until it has something to deliver,
+    // so we can re-issue it immediately; otherwise we poll periodically
+    const bool long_poll = this->config.long_poll_timeout_ms > 0;
+    const auto long_poll_timeout = std::chrono::milliseconds(this->config.long_poll_timeout_ms);
+
+    // tracks up to which sequence number we received all variables and errors and queued them for
+    // dispatch, acknowledged with each call; the agent keeps delivering everything above it, so a lost
+    // response does not lose events
+    satellite_link::ReceiveWindow window;
+
     while (this->rpc->get_connection_state() == rpc::client::connection_state::connected) {
         // we don't use a sync call here since we want to use our own timeout here
-        auto future = this->rpc->async_call("retrieve_vars_and_errors");
-        auto wait_result = future.wait_for(30s); // we need this large timeout at the moment due to OCPP GetDiagnostics upload
-        if (wait_result == std::future_status::timeout)
+        const auto record_id =
+            this->recorder.call("retrieve_vars_and_errors", this->config.long_poll_timeout_ms, window.ack());
+        auto future = this->rpc->async_call("retrieve_vars_and_errors", this->config.long_poll_timeout_ms,
+                                            window.ack());
+        // we need this large timeout at the moment due to OCPP GetDiagnostics upload
+        auto wait_result = future.wait_for(30s + long_poll_timeout);
+        if (wait_result == std::future_status::timeout) {
+            // the link is a single TCP connection, so the response is not lost but the connection is dead
+            // or the agent hangs; another call would only overlap with this one, so give up
+            this->retrieve_timeouts.inc();
+            this->recorder.error(record_id, "timeout");
             break;
+        }
 
-        json j = json::parse(future.get().as<std::string>());
+        RPCLIB_MSGPACK::object_handle response;
 
-        for (auto& event : j["vars"]) {
-            if (event["interface"] == "auth_token_provider") {
-                if (event["var"] == "provided_token") {
-                    this->p_auth_token_provider->publish_provided_token(event["value"]);
-                }
-            }
-            if (event["interface"] == "energy") {
-                if (event["var"] == "energy_flow_request")
-                   this->p_energy->publish_energy_flow_request(event["value"]);
-            }
-            if (event["interface"] == "evse_manager") {
-                if (event["var"] == "session_event")
-                    this->p_evse_manager->publish_session_event(event["value"]);
-                else if (event["var"] == "limits")
-                    this->p_evse_manager->publish_limits(event["value"]);
-                else if (event["var"] == "ev_info")
-                    this->p_evse_manager->publish_ev_info(event["value"]);
-                else if (event["var"] == "car_manufacturer")
-                    this->p_evse_manager->publish_car_manufacturer(types::evse_manager::string_to_car_manufacturer(event["value"]));
-                else if (event["var"] == "telemetry")
-                    this->p_evse_manager->publish_telemetry(event["value"]);
-                else if (event["var"] == "powermeter")
-                    this->p_evse_manager->publish_powermeter(event["value"]);
-                else if (event["var"] == "powermeter_public_key_ocmf")
-                    this->p_evse_manager->publish_powermeter_public_key_ocmf(event["value"]);
-                else if (event["var"] == "evse_id")
-                    this->p_evse_manager->publish_evse_id(event["value"]);
-                else if (event["var"] == "hw_capabilities")
-                   this->p_evse_manager->publish_hw_capabilities(event["value"]);
-                else if (event["var"] == "enforced_limits")
-                   this->p_evse_manager->publish_enforced_limits(event["value"]);
-                else if (event["var"] == "waiting_for_external_ready")
-                   this->p_evse_manager->publish_waiting_for_external_ready(event["value"]);
-                else if (event["var"] == "ready")
-                   this->p_evse_manager->publish_ready(event["value"]);
-                else if (event["var"] == "selected_protocol")
-                   this->p_evse_manager->publish_selected_protocol(event["value"]);
-                else if (event["var"] == "supported_energy_transfer_modes")
-                   this->p_evse_manager->publish_supported_energy_transfer_modes(event["value"]);
-            }
-            if (event["interface"] == "dc_external_derate") {
-                if (event["var"] == "plug_temperature_C")
-                   this->p_dc_external_derate->publish_plug_temperature_C(event["value"]);
-            }
-            if (event["interface"] == "iso15118_extensions") {
-                if (event["var"] == "iso15118_certificate_request")
-                   this->p_iso15118_extensions->publish_iso15118_certificate_request(event["value"]);
-                else if (event["var"] == "charging_needs")
-                    this->p_iso15118_extensions->publish_charging_needs(event["value"]);
-                else if (event["var"] == "ev_info")
-                    this->p_iso15118_extensions->publish_ev_info(event["value"]);
-                else if (event["var"] == "service_renegotiation_supported")
-                    this->p_iso15118_extensions->publish_service_renegotiation_supported(event["value"]);
-            }
-            if (event["interface"] == "rfid_token_provider") {
-                if (event["var"] == "provided_token") {
-                    types::authorization::ProvidedIdToken id_token = event["value"];
-
-                    // return either the mapping of the implementation or of the module
-                    auto mapping = this->p_rfid_token_provider->get_mapping();
-                    if (!mapping.has_value()) {
-                        mapping = this->info.mapping;
-                    }
-
-                    // prefer a set connector id, fallback to evse id (which is usually the same value)
-                    if (mapping.has_value()) {
-                        auto connector_id = mapping.value().connector.value_or(mapping.value().evse);
-
-                        // do not overwrite an existing list of connectors
-                        if (!id_token.connectors.has_value()) {
-                            id_token.connectors.emplace({connector_id});
-                        }
-                    }
-
-                    this->p_rfid_token_provider->publish_provided_token(id_token);
-                }
-            }
-            if (event["interface"] == "system") {
-                if (event["var"] == "firmware_update_status")
-                   this->p_system->publish_firmware_update_status(event["value"]);
-                else if (event["var"] == "log_status")
-                   this->p_system->publish_log_status(event["value"]);
-            }
-            if (event["interface"] == "uk_random_delay") {
-                if (event["var"] == "countdown")
-                   this->p_uk_random_delay->publish_countdown(event["value"]);
-            }
+        try {
+            response = future.get();
+        } catch (const rpc::rpc_error& e) {
+            const auto& error = e.get_error().get();
+            const auto message = error.type == RPCLIB_MSGPACK::type::STR ? error.as<std::string>() : e.what();
+            EVLOG_warning << "Querying variables and errors failed: " << message << ", retrying...";
+            this->recorder.error(record_id, message);
+            std::this_thread::sleep_for(RETRIEVE_RETRY_DELAY);
+            continue;
+        } catch (const std::exception& e) {
+            EVLOG_warning << "Querying variables and errors failed: " << e.what() << ", retrying...";
+            this->recorder.error(record_id, e.what());
+            std::this_thread::sleep_for(RETRIEVE_RETRY_DELAY);
+            continue;
         }
 
-        for (auto& event : j["errors"]) {
-            Everest::error::Error e{event["error"]};
+        this->recorder.result(record_id, response.get());
 
-            if (event["action"] == "raise")
-                this->p_satellite->raise_error(e);
-            if (event["action"] == "clear")
-                this->p_satellite->clear_error(e.type);
+        // the agent delivers everything above our acknowledgement again, so skip what we already received
+        window.start_batch();
+        std::vector<ReceivedItem> batch;
+
+        // errors are critical, so the agent sends them first, and it already sorted the variables so
+        // that critical ones come first as well; the batch keeps this order
+        satellite_link::BatchReader reader([&](satellite_link::BatchList list, json& event) {
+            const auto seq = event.at("seq").get<std::uint64_t>();
+
+            if (not window.receive(seq))
+                return;
+
+            batch.push_back({list, seq, std::move(event)});
+        });
+
+        const auto parse_start = std::chrono::steady_clock::now();
+
+        try {
+            satellite_link::decode(response.get(), reader);
+        } catch (const std::exception& e) {
+            EVLOG_warning << "Could not parse the variables and errors: "
+                          << (reader.error().empty() ? std::string(e.what()) : reader.error());
+
+            // only the unbroken run of sequence numbers is acknowledged, the rest is delivered again
+            const auto ack = window.abort_batch();
+
+            batch.erase(std::remove_if(batch.begin(), batch.end(),
+                                       [ack](const ReceivedItem& received) { return received.seq > ack; }),
+                        batch.end());
         }
 
-        std::this_thread::sleep_for(25ms);
+        this->batch_parse_duration.observe(std::chrono::steady_clock::now() - parse_start);
+        this->received_bytes.inc(satellite_link::wire_size(response.get()));
+
+        if (batch.empty()) {
+            if (not long_poll)
+                std::this_thread::sleep_for(25ms);
+            continue;
+        }
+
+        // double buffering: at most one batch waits while another one is being dispatched, so when
+        // dispatching falls behind we stop fetching (and acknowledging) instead of queueing up memory
+        std::unique_lock<std::mutex> lock(this->dispatch_queue_guard);
+        this->cv_dispatch_queue_changed.wait(
+            lock, [this] { return this->dispatch_queue.size() <= DISPATCH_MAX_PENDING_BATCHES; });
+        this->dispatch_queue.push_back(std::move(batch));
+        this->dispatch_queue_depth.set(this->dispatch_queue.size());
+        lock.unlock();
+        this->cv_dispatch_queue_changed.notify_all();
     }
 
     EVLOG_info << "Connection to SatelliteAgent on " << this->config.hostname << ":" << this->config.port << " lost. Terminating...";
 
+    {
+        std::lock_guard<std::mutex> lock(this->dispatch_queue_guard);
+        this->dispatch_stop = true;
+    }
+    this->cv_dispatch_queue_changed.notify_all();
+
     if (not this->disconnect_expected) {
         EVLOG_warning << "...and since this was not expected, we terminate the whole EVerest.";
         std::exit(1);
     }
 }
 
+void SatelliteController::run_dispatch() {
+    std::unique_lock<std::mutex> lock(this->dispatch_queue_guard);
+
+    while (true) {
+        this->cv_dispatch_queue_changed.wait(
+            lock, [this] { return not this->dispatch_queue.empty() or this->dispatch_stop; });
+
+        if (this->dispatch_queue.empty())
+            break;
+
+        // the batch stays in the queue while it is dispatched, so that the polling thread can fetch
+        // exactly one more batch in the meantime
+        auto& batch = this->dispatch_queue.front();
+        lock.unlock();
+
+        this->batch_reported_dropped = false;
+
+        for (auto& received : batch)
+            this->dispatch_item(received);
+
+        // the agent forwards events again
+        if (this->events_dropped_faulted and not this->batch_reported_dropped) {
+            EVLOG_info << "SatelliteAgent forwards all events again.";
+            this->p_satellite->clear_error("generic/CommunicationFault", EVENTS_DROPPED_ERROR_SUB_TYPE);
+            this->events_dropped_faulted = false;
+        }
+
+        lock.lock();
+        this->dispatch_queue.pop_front();
+        this->dispatch_queue_depth.set(this->dispatch_queue.size());
+        this->cv_dispatch_queue_changed.notify_all();
+    }
+}
+
+void SatelliteController::run_heartbeat() {
+    const auto interval = std::chrono::milliseconds(this->config.heartbeat_interval_ms);
+    // each heartbeat waits for its response on its own, so the heartbeats overlap when the round trip
+    // time exceeds the interval, and a slow link is not mistaken for a dead one
+    const auto timeout = std::chrono::milliseconds(this->config.heartbeat_timeout_ms);
+    // tells the agent when to give up on us
+    const int reset_timeout_ms = this->config.heartbeat_reset_timeout_ms;
+
+    const auto now_us = []() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    };
+
+    // round trip time and clock offset of the recent heartbeats; like the clock filter of NTP, the offset
+    // is taken from the one with the lowest round trip time since it suffered the least from queueing
+    struct Sample {
+        std::int64_t rtt_us;
+        std::int64_t offset_us;
+        std::optional<std::int64_t> steady_offset_us;
+    };
+    std::array<Sample, HEARTBEAT_FILTER_SIZE> samples{};
+    std::size_t sample_count{0};
+
+    // heartbeats sent, but neither answered nor timed out yet, in the order they were sent
+    struct Beat {
+        std::chrono::steady_clock::time_point sent;
+        std::int64_t t1;
+        std::int64_t t1_steady;
+        std::uint64_t record_id;
+        std::future<RPCLIB_MSGPACK::object_handle> future;
+    };
+    std::deque<Beat> beats;
+
+    int missed{0};
+    bool faulted{false};
+    auto next_beat = std::chrono::steady_clock::now();
+    auto next_publish = next_beat;
+
+    const auto count_missed = [&]() {
+        this->heartbeats_missed.inc();
+
+        if (++missed >= this->config.heartbeat_max_missed and not faulted) {
+            EVLOG_error << "SatelliteAgent on " << this->config.hostname << ":" << this->config.port << " missed "
+                        << missed << " heartbeats, marking it as faulted.";
+
+            auto error = this->p_satellite->error_factory->create_error(
+                "generic/CommunicationFault", HEARTBEAT_ERROR_SUB_TYPE, "SatelliteAgent does not respond",
+                Everest::error::Severity::High);
+            this->p_satellite->raise_error(error);
+            faulted = true;
+        }
+    };
+
+    while (this->rpc->get_connection_state() == rpc::client::connection_state::connected) {
+        const auto now = std::chrono::steady_clock::now();
+
+        if (now >= next_beat) {
+            const auto record_id = this->recorder.call("heartbeat", reset_timeout_ms);
+            beats.push_back({now, now_us(), steady_time_us(), record_id,
+                             this->rpc->async_call("heartbeat", reset_timeout_ms)});
+
+            // beats which could not be sent in time (e.g. after a suspend) are skipped, not caught up on
+            next_beat += interval;
+            if (next_beat < now)
+                next_beat = now + interval;
+        }
+
+        if (beats.empty()) {
+            std::this_thread::sleep_until(next_beat);
+            continue;
+        }
+
+        auto& beat = beats.front();
+        const auto deadline = beat.sent + timeout;
+
+        // a late response counts as missed, it is just discarded once it arrives
+        if (beat.future.wait_until(std::min(deadline, next_beat)) != std::future_status::ready) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                this->recorder.error(beat.record_id, "timeout");
+                beats.pop_front();
+                count_missed();
+            }
+            continue;
+        }
+
+        std::optional<std::vector<std::int64_t>> agent_times;
+
+        try {
+            const auto rv = beat.future.get();
+            this->recorder.result(beat.record_id, rv.get());
+            agent_times = rv.get().as<std::vector<std::int64_t>>();
+        } catch (const std::exception& e) {
+            EVLOG_debug << "Heartbeat failed: " << e.what();
+            this->recorder.error(beat.record_id, e.what());
+        }
+
+        const std::int64_t t4 = now_us();
+        const std::int64_t t4_steady = steady_time_us();
+        const std::int64_t t1 = beat.t1;
+        const std::int64_t t1_steady = beat.t1_steady;
+        const auto sent = beat.sent;
+        beats.pop_front();
+
+        if (not agent_times.has_value() or agent_times->size() < 2) {
+            count_missed();
+            continue;
+        }
+
+        missed = 0;
+        if (faulted) {
+            EVLOG_info << "SatelliteAgent on " << this->config.hostname << ":" << this->config.port
+                       << " responds to heartbeats again.";
+            this->p_satellite->clear_error("generic/CommunicationFault", HEARTBEAT_ERROR_SUB_TYPE);
+            faulted = false;
+        }
+
+        // NTP-style: t2 and t3 are the reception and transmission time of the agent
+        const std::int64_t t2 = agent_times->at(0);
+        const std::int64_t t3 = agent_times->at(1);
+
+        Sample sample{std::max<std::int64_t>((t4 - t1) - (t3 - t2), 0), ((t2 - t1) + (t3 - t4)) / 2, std::nullopt};
+
+        // the same for the monotonic clocks, which stamp the forwarded variables
+        if (agent_times->size() >= 4)
+            sample.steady_offset_us = ((agent_times->at(2) - t1_steady) + (agent_times->at(3) - t4_steady)) / 2;
+
+        samples[sample_count++ % samples.size()] = sample;
+
+        const auto best = std::min_element(samples.begin(), samples.begin() + std::min(sample_count, samples.size()),
+                                           [](const Sample& a, const Sample& b) { return a.rtt_us < b.rtt_us; });
+
+        this->round_trip_time_ms = sample.rtt_us / 1000.0;
+        this->clock_offset_ms = best->offset_us / 1000.0;
+
+        if (best->steady_offset_us.has_value()) {
+            this->agent_steady_offset_us = best->steady_offset_us.value();
+            this->agent_steady_offset_known = true;
+        }
+        this->round_trip_time.set(sample.rtt_us / 1e6);
+        this->clock_offset.set(best->offset_us / 1e6);
+
+        if (sent >= next_publish) {
+            this->p_satellite->publish_round_trip_time_ms(this->round_trip_time_ms);
+            this->p_satellite->publish_clock_offset_ms(this->clock_offset_ms);
+            // tells how to shift the timestamps of the agent's trace file to merge it with ours
+            this->tracer.counter("satellite_clock_offset_ms", this->clock_offset_ms);
+            next_publish = sent + HEARTBEAT_PUBLISH_INTERVAL;
+        }
+    }
+}
+
+void SatelliteController::run_metrics_file() {
+    const auto interval = std::chrono::milliseconds(this->config.metrics_file_interval_ms);
+    bool warned{false};
+
+    for (;;) {
+        std::this_thread::sleep_for(interval);
+
+        if (this->metrics.write_file(this->config.metrics_file)) {
+            warned = false;
+        } else if (not warned) {
+            EVLOG_warning << "Could not write metrics to '" << this->config.metrics_file << "'.";
+            warned = true;
+        }
+    }
+}
+
+void SatelliteController::dispatch_item(ReceivedItem& received) {
+    auto& event = received.item;
+    // our span becomes a child of the agent's span of the item, if it traces as well
+    const auto parent = event.contains("trace") ? satellite_link::TraceContext::from_json(event["trace"])
+                                                : satellite_link::TraceContext{};
+
+    if (received.list == satellite_link::BatchList::Errors) {
+        satellite_link::Span span(this->tracer, "error", "dispatch", parent);
+
+        this->errors_received.inc();
+
+        try {
+            Everest::error::Error e{event.at("error")};
+            const auto& action = event.at("action");
+
+            if (action == "raise")
+                this->p_satellite->raise_error(e);
+            if (action == "clear")
+                this->p_satellite->clear_error(e.type, e.sub_type);
+        } catch (const std::exception& e) {
+            // e.g. a malformed error
+            EVLOG_warning << "Could not dispatch error: " << e.what();
+        }
+        return;
+    }
+
+    // the agent's event queue ran full, so the events in between were lost
+    if (event.contains("dropped")) {
+        const auto dropped = event.at("dropped").get<std::uint64_t>();
+
+        EVLOG_error << "SatelliteAgent dropped " << dropped << " event(s) since its event queue was full.";
+        this->agent_events_dropped.inc(dropped);
+        this->batch_reported_dropped = true;
+
+        if (not this->events_dropped_faulted) {
+            auto error = this->p_satellite->error_factory->create_error(
+                "generic/CommunicationFault", EVENTS_DROPPED_ERROR_SUB_TYPE, "SatelliteAgent dropped events",
+                Everest::error::Severity::Medium);
+            this->p_satellite->raise_error(error);
+            this->events_dropped_faulted = true;
+        }
+        return;
+    }
+
+    const auto var = satellite_link::agent_var_from_tag(event.at("tag").get<std::uint64_t>());
+
+    if (not var.has_value()) {
+        EVLOG_warning << "Ignoring unknown variable with tag " << event.at("tag") << ".";
+        return;
+    }
+
+    std::optional<json> value = this->apply_var_item(var.value(), received.seq, event);
+
+    if (not value.has_value())
+        return;
+
+    const auto index = static_cast<std::size_t>(var.value());
+    const auto start = std::chrono::steady_clock::now();
+
+    this->vars_received[index]->inc();
+
+    try {
+        satellite_link::Span span(this->tracer, satellite_link::var_info(var.value()).var, "dispatch", parent);
+        this->publish_var(var.value(), value.value());
+        this->var_publish_duration[index]->observe(std::chrono::steady_clock::now() - start);
+
+        // the end-to-end latency includes publishing it here, so it is taken only now
+        if (event.contains("ts"))
+            this->track_var_latency(var.value(), event.at("ts").get<std::int64_t>());
+    } catch (const std::exception& e) {
+        // e.g. a malformed packed value or a blob which could not be fetched
+        EVLOG_warning << "Could not publish variable with tag " << event.at("tag") << ": " << e.what();
+    }
+}
+
+void SatelliteController::track_var_latency(satellite_link::AgentVar var, std::int64_t agent_published_us) {
+    // without heartbeat we don't know the offset of the agent's clock
+    if (not this->agent_steady_offset_known)
+        return;
+
+    const auto index = static_cast<std::size_t>(var);
+    const std::int64_t published_us = agent_published_us - this->agent_steady_offset_us;
+    // the estimated offset may be off by up to half of the round trip time, so don't go below zero
+    const std::int64_t latency_us = std::max<std::int64_t>(steady_time_us() - published_us, 0);
+
+    this->var_latency[index]->observe(std::chrono::microseconds(latency_us));
+    this->var_latency_max[index]->set_max(latency_us / 1e6);
+
+    if (this->config.max_var_latency_ms == 0 or latency_us <= this->config.max_var_latency_ms * 1000LL)
+        return;
+
+    const auto now = std::chrono::steady_clock::now();
+    auto& warned = this->var_latency_warned[index];
+    if (warned != std::chrono::steady_clock::time_point{} and now < warned + LATENCY_WARNING_INTERVAL)
+        return;
+
+    warned = now;
+    EVLOG_warning << "Variable '" << satellite_link::var_info(var).var << "' of interface '"
+                  << satellite_link::var_info(var).interface << "' is published " << latency_us / 1000
+                  << " ms after its source (p50 " << this->var_latency[index]->quantile(0.5) * 1000 << " ms, p99 "
+                  << this->var_latency[index]->quantile(0.99) * 1000 << " ms).";
+}
+
+std::optional<json> SatelliteController::apply_var_item(satellite_link::AgentVar var, std::uint64_t seq, json& item) {
+    auto& base = this->delta_bases[static_cast<std::size_t>(var)];
+    json value;
+
+    if (item.contains("delta")) {
+        // diffs are relative to the previous value the agent forwarded
+        if (base.value.is_null() or base.seq != item.at("base").get<std::uint64_t>()) {
+            EVLOG_warning << "Missing base of diff for variable '" << satellite_link::var_info(var).var
+                          << "', waiting for the next full value.";
+            return std::nullopt;
+        }
+
+        try {
+            value = base.value.patch(item.at("delta"));
+        } catch (const json::exception& e) {
+            EVLOG_warning << "Could not apply diff for variable '" << satellite_link::var_info(var).var
+                          << "', waiting for the next full value: " << e.what();
+            base = {};
+            return std::nullopt;
+        }
+    } else {
+        value = std::move(item.at("value"));
+    }
+
+    if (satellite_link::var_info(var).delta) {
+        base.seq = seq;
+        base.value = value;
+    }
+
+    return value;
+}
+
+void SatelliteController::publish_var(satellite_link::AgentVar var, const json& value) {
+    // the switch is compiled into a jump table, so this is an indexed call per variable
+    satellite_link::visit_var(var, [&](auto id) {
+        using Var = satellite_link::var_traits<decltype(id)::value>;
+        auto typed_value = satellite_link::from_forwarded_value<typename Var::type>(value, &this->blob_channel);
+
+        if constexpr (decltype(id)::value == satellite_link::AgentVar::RfidTokenProviderProvidedToken)
+            this->map_rfid_token(typed_value);
+
+        Var::publish(*this, typed_value);
+    });
+}
+
+std::optional<satellite_link::BlobRef>
+SatelliteController::RpcBlobChannel::send(std::vector<std::uint8_t>& bytes) {
+    const satellite_link::BlobRef ref{this->next_id++, bytes.size()};
+
+    // all chunks are on the way at the same time, so this takes a single round trip
+    std::vector<std::future<RPCLIB_MSGPACK::object_handle>> futures;
+    std::vector<std::uint64_t> record_ids;
+    for (std::size_t offset = 0; offset < bytes.size(); offset += satellite_link::BLOB_CHUNK_SIZE) {
+        const satellite_link::BlobChunk chunk{bytes.data() + offset,
+                                              std::min(satellite_link::BLOB_CHUNK_SIZE, bytes.size() - offset)};
+        record_ids.push_back(this->mod.recorder.call("store_blob_chunk", ref.id, offset, ref.size, chunk));
+        futures.push_back(this->mod.rpc->async_call("store_blob_chunk", ref.id, offset, ref.size, chunk));
+    }
+
+    bool stored{true};
+    for (std::size_t i = 0; i < futures.size(); i++) {
+        const auto rv = this->mod.wait_for_call(CallClass::Default, "store_blob_chunk", std::move(futures[i]),
+                                                record_ids[i]);
+        stored = stored and rv.has_value() and rv->get().as<bool>();
+    }
+
+    if (not stored) {
+        EVLOG_warning << "Could not upload blob of " << bytes.size() << " bytes, sending it inline.";
+        return std::nullopt;
+    }
+
+    return ref;
+}
+
+std::vector<std::uint8_t> SatelliteController::RpcBlobChannel::receive(const satellite_link::BlobRef& ref) {
+    if (ref.size > satellite_link::MAX_BLOB_SIZE)
+        throw std::runtime_error("Blob too large: " + std::to_string(ref.size) + " bytes");
+
+    std::vector<std::future<RPCLIB_MSGPACK::object_handle>> futures;
+    std::vector<std::uint64_t> record_ids;
+    for (std::uint64_t offset = 0; offset < ref.size; offset += satellite_link::BLOB_CHUNK_SIZE) {
+        record_ids.push_back(this->mod.recorder.call("retrieve_blob_chunk", ref.id, offset));
+        futures.push_back(this->mod.rpc->async_call("retrieve_blob_chunk", ref.id, offset));
+    }
+
+    std::vector<std::uint8_t> bytes;
+    bytes.reserve(ref.size);
+
+    for (std::size_t i = 0; i < futures.size(); i++) {
+        const auto rv = this->mod.wait_for_call(CallClass::Default, "retrieve_blob_chunk", std::move(futures[i]),
+                                                record_ids[i]);
+
+        if (not rv.has_value() or rv->get().type != RPCLIB_MSGPACK::type::BIN)
+            throw std::runtime_error("Could not fetch blob " + std::to_string(ref.id));
+
+        const auto& chunk = rv->get().via.bin;
+        bytes.insert(bytes.end(), chunk.ptr, chunk.ptr + chunk.size);
+    }
+
+    if (bytes.size() != ref.size)
+        throw std::runtime_error("Blob " + std::to_string(ref.id) + " has an unexpected size");
+
+    return bytes;
+}
+
+void SatelliteController::map_rfid_token(types::authorization::ProvidedIdToken& id_token) {
+    // return either the mapping of the implementation or of the module
+    auto mapping = this->p_rfid_token_provider->get_mapping();
+    if (!mapping.has_value()) {
+        mapping = this->info.mapping;
+    }
+
+    // prefer a set connector id, fallback to evse id (which is usually the same value)
+    if (mapping.has_value()) {
+        auto connector_id = mapping.value().connector.value_or(mapping.value().evse);
+
+        // do not overwrite an existing list of connectors
+        if (!id_token.connectors.has_value()) {
+            id_token.connectors.emplace({connector_id});
+        }
+    }
+}
+
 } // namespace module
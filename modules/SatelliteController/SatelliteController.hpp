@@ -28,9 +28,36 @@
 
 // ev@4bf81b14-a215-475c-a1d3-0a484ae48918:v1
 // insert your custom include headers here
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <nlohmann/json.hpp>
 #include <rpc/client.h>
+#include <satellite_link/batch_reader.hpp>
+#include <satellite_link/blob.hpp>
+#include <satellite_link/call_class.hpp>
+#include <satellite_link/codec.hpp>
+#include <satellite_link/packed_types.hpp>
+#include <satellite_link/generated/commands.hpp>
+#include <satellite_link/metrics.hpp>
+#include <satellite_link/payload.hpp>
+#include <satellite_link/recorder.hpp>
+#include <satellite_link/trace.hpp>
+#include <satellite_link/vars.hpp>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 // ev@4bf81b14-a215-475c-a1d3-0a484ae48918:v1
 
 namespace module {
@@ -38,6 +65,21 @@ namespace module {
 struct Conf {
     std::string hostname;
     int port;
+    int long_poll_timeout_ms;
+    std::string payload_encoding;
+    int control_call_timeout_ms;
+    int call_timeout_ms;
+    int long_call_timeout_ms;
+    bool confirm_notifications;
+    int heartbeat_interval_ms;
+    int heartbeat_timeout_ms;
+    int heartbeat_max_missed;
+    int heartbeat_reset_timeout_ms;
+    int max_var_latency_ms;
+    std::string metrics_file;
+    int metrics_file_interval_ms;
+    std::string trace_file;
+    std::string traffic_record_file;
 };
 
 class SatelliteController : public Everest::ModuleBase {
@@ -93,6 +135,108 @@ public:
 
     /// @brief Used to remember whether a (possible) disconnect in the future is expected.
     std::atomic_bool disconnect_expected{false};
+
+    /// @brief Encoding of structured payloads sent to the SatelliteAgent, negotiated during 'init'.
+    satellite_link::PayloadEncoding payload_encoding{satellite_link::PayloadEncoding::Json};
+
+    /// @brief Classes of calls to the SatelliteAgent, each of them with its own configurable deadline.
+    using CallClass = satellite_link::CallClass;
+
+    /// @brief Writes the spans of this side of the link to 'trace_file', if configured.
+    satellite_link::Tracer tracer;
+
+    /// @brief Records all traffic of the link to 'traffic_record_file', if configured.
+    satellite_link::TrafficRecorder recorder;
+
+    /// @brief Calls the given function of the SatelliteAgent and waits for the result until
+    ///        the deadline of the given call class expired.
+    /// @return The result, or nothing if the call timed out or failed; the caller has to map
+    ///         this to a failure result of the command.
+    template <typename... Args>
+    std::optional<RPCLIB_MSGPACK::object_handle> call(CallClass call_class, const std::string& func_name,
+                                                      Args&&... args) {
+        const auto record_id = this->recorder.call(func_name, args...);
+
+        return this->wait_for_call(call_class, func_name,
+                                   this->rpc->async_call(func_name, std::forward<Args>(args)...), record_id);
+    }
+
+    /// @brief Sends a notification to the given function of the SatelliteAgent, i.e. calls a void command
+    ///        without waiting for its completion; the agent executes notifications in the order they were
+    ///        sent. In 'confirm_notifications' mode, this waits until the agent confirmed the reception.
+    ///        The agent's span of the notification becomes a child of the given one.
+    template <typename... Args>
+    void notify(CallClass call_class, const std::string& func_name, const satellite_link::TraceContext& trace,
+                Args&&... args) {
+        if (this->config.confirm_notifications) {
+            this->notify_confirmed(call_class, func_name, trace, std::forward<Args>(args)...);
+            return;
+        }
+
+        const std::uint64_t seq = this->next_notification_seq++;
+        this->recorder.notification(func_name, seq, trace, args...);
+        this->rpc->send(func_name, seq, trace, std::forward<Args>(args)...);
+    }
+
+    /// @brief Sends a notification like 'notify', but always waits until the SatelliteAgent confirmed
+    ///        its reception (regardless of 'confirm_notifications').
+    /// @return True if the reception was confirmed within the deadline of the given call class.
+    template <typename... Args>
+    bool notify_confirmed(CallClass call_class, const std::string& func_name,
+                          const satellite_link::TraceContext& trace, Args&&... args) {
+        const std::uint64_t seq = this->next_notification_seq++;
+        return this->call(call_class, func_name, seq, trace, std::forward<Args>(args)...).has_value();
+    }
+
+    /// @brief Client stub of a tunnelled command: forwards the command described by the given descriptor
+    ///        (generated from the interface definition) with the given arguments to the SatelliteAgent.
+    /// @return For notifications nothing, for void commands whether the call succeeded, otherwise the
+    ///         decoded result or nothing if the call failed or timed out.
+    template <typename Cmd, typename... Args> auto forward(const Args&... args) {
+        static_assert(std::is_same_v<std::tuple<Args...>, typename Cmd::argument_types>,
+                      "arguments do not match the interface definition");
+        using R = typename Cmd::result_type;
+
+        // the root span of the command, the agent's span of its execution becomes a child of it
+        satellite_link::Span span(this->tracer, Cmd::name, "command");
+
+        if constexpr (Cmd::notification) {
+            this->notify(Cmd::call_class, Cmd::name, span.context(),
+                         satellite_link::Codec<Args>::encode(args, this->payload_encoding, &this->blob_channel)...);
+        } else {
+            auto rpc_rv =
+                this->call(Cmd::call_class, Cmd::name, span.context(),
+                           satellite_link::Codec<Args>::encode(args, this->payload_encoding, &this->blob_channel)...);
+
+            if constexpr (std::is_void_v<R>) {
+                return rpc_rv.has_value();
+            } else {
+                std::optional<R> rv;
+
+                if (rpc_rv) {
+                    try {
+                        rv = satellite_link::Codec<R>::decode(rpc_rv->get(), &this->blob_channel);
+                    } catch (const std::exception& e) {
+                        this->log_malformed_result(Cmd::name, e);
+                    }
+                }
+
+                return rv;
+            }
+        }
+    }
+
+    /// @brief Sequence number of the next notification sent to the SatelliteAgent.
+    std::atomic<std::uint64_t> next_notification_seq{1};
+
+    /// @brief Round trip time in milliseconds of the link, measured by the heartbeat; -1 if not measured yet.
+    std::atomic<double> round_trip_time_ms{-1.0};
+
+    /// @brief Estimated offset in milliseconds of the SatelliteAgent's clock, i.e. its time minus ours.
+    std::atomic<double> clock_offset_ms{0.0};
+
+    /// @brief Metrics of the link, returned by the command "get_statistics" and written to 'metrics_file'.
+    satellite_link::Metrics metrics{"satellite_controller_"};
     // ev@1fce4c5e-0ab8-41bb-90f7-14277703d2ac:v1
 
 protected:
@@ -107,6 +251,148 @@ private:
 
     // ev@211cfdbe-f69a-4cd6-a4ec-f8aaa3d1b6c8:v1
     // insert your private definitions here
+    /// @brief Helper to return the configured deadline of the given call class.
+    std::chrono::milliseconds call_timeout(CallClass call_class) const;
+
+    /// @brief Last value of a delta encoded variable, the base for the next diff.
+    struct DeltaBase {
+        std::uint64_t seq{0};
+        nlohmann::json value;
+    };
+
+    /// @brief Bases of all delta encoded variables; only used by the dispatch thread.
+    std::array<DeltaBase, satellite_link::agent_var_infos.size()> delta_bases;
+
+    /// @brief A variable or error received from the SatelliteAgent, waiting to be dispatched.
+    struct ReceivedItem {
+        satellite_link::BatchList list;
+        std::uint64_t seq;
+        nlohmann::json item;
+    };
+
+    /// @brief Batches received by the polling thread, dispatched in order by the dispatch thread; this
+    ///        decouples the next "retrieve_vars_and_errors" from publishing the previous batch.
+    std::deque<std::vector<ReceivedItem>> dispatch_queue;
+
+    /// @brief Set by the polling thread when the connection is gone, the dispatch thread exits then.
+    bool dispatch_stop{false};
+
+    /// @brief Used to signal changes of 'dispatch_queue' and 'dispatch_stop', in both directions.
+    std::condition_variable cv_dispatch_queue_changed;
+
+    /// @brief Mutex to protect 'dispatch_queue' and 'dispatch_stop'.
+    std::mutex dispatch_queue_guard;
+
+    /// @brief Thread function dispatching the received batches into EVerest.
+    void run_dispatch();
+
+    /// @brief Helper to dispatch a single variable or error received from the SatelliteAgent.
+    void dispatch_item(ReceivedItem& received);
+
+    /// @brief Whether the SatelliteAgent reported dropped events and a CommunicationFault is raised for it;
+    ///        cleared with the first batch which reports none. Only used by the dispatch thread.
+    bool events_dropped_faulted{false};
+
+    /// @brief Whether the batch being dispatched reported dropped events; only used by the dispatch thread.
+    bool batch_reported_dropped{false};
+
+    /// @brief Helper to get the value of a variable item received from the SatelliteAgent, applying the
+    ///        diff against the base in case of a delta encoded variable. Returns nothing if this is not
+    ///        possible, e.g. because an update was lost.
+    std::optional<nlohmann::json> apply_var_item(satellite_link::AgentVar var, std::uint64_t seq,
+                                                 nlohmann::json& item);
+
+    /// @brief Thread function sending the heartbeat to the SatelliteAgent, runs as long as connected.
+    void run_heartbeat();
+
+    /// @brief Estimated offset in microseconds of the SatelliteAgent's monotonic clock, i.e. its time minus
+    ///        ours; only valid when 'agent_steady_offset_known' is set.
+    std::atomic<std::int64_t> agent_steady_offset_us{0};
+    std::atomic_bool agent_steady_offset_known{false};
+
+    /// @brief Helper to account the end-to-end latency of a variable, from its publication on the SatelliteAgent
+    ///        until it is published by us; only used by the dispatch thread.
+    void track_var_latency(satellite_link::AgentVar var, std::int64_t agent_published_us);
+
+    /// @brief Per variable: when its latency was reported as too high the last time.
+    std::array<std::chrono::steady_clock::time_point, satellite_link::agent_var_infos.size()> var_latency_warned{};
+
+    /// @brief Blob channel of the controller: uploads its blobs to the SatelliteAgent before the call
+    ///        referencing them, and fetches the blobs referenced by the agent; both chunk by chunk.
+    class RpcBlobChannel : public satellite_link::BlobChannel {
+    public:
+        explicit RpcBlobChannel(SatelliteController& mod) : mod(mod) {
+        }
+
+        std::optional<satellite_link::BlobRef> send(std::vector<std::uint8_t>& bytes) override;
+        std::vector<std::uint8_t> receive(const satellite_link::BlobRef& ref) override;
+
+    private:
+        SatelliteController& mod;
+        std::atomic<std::uint64_t> next_id{1};
+    };
+
+    /// @brief Transfers the blobs of variables and commands which are too large to be sent inline.
+    RpcBlobChannel blob_channel{*this};
+
+    /// @brief Helper to publish a variable received from the SatelliteAgent on the matching interface.
+    void publish_var(satellite_link::AgentVar var, const nlohmann::json& value);
+
+    /// @brief Helper to add the connector of our rfid_token_provider mapping to a token read on the satellite.
+    void map_rfid_token(types::authorization::ProvidedIdToken& id_token);
+
+    /// @brief Helper to log a result of the given function which could not be decoded.
+    void log_malformed_result(const std::string& func_name, const std::exception& e) const;
+
+    /// @brief Helper to wait for the result of a call started by 'call'; the result or failure is recorded
+    ///        for the call with the given id of 'recorder'.
+    std::optional<RPCLIB_MSGPACK::object_handle> wait_for_call(CallClass call_class, const std::string& func_name,
+                                                               std::future<RPCLIB_MSGPACK::object_handle> future,
+                                                               std::uint64_t record_id = 0);
+
+    /// @brief Metrics of the calls of one function of the SatelliteAgent.
+    struct CallMetrics {
+        satellite_link::Histogram* duration{nullptr};
+        satellite_link::Counter* timeouts{nullptr};
+        satellite_link::Counter* errors{nullptr};
+    };
+
+    /// @brief Registers (or looks up) the metrics of calls of the given function.
+    CallMetrics make_call_metrics(const std::string& func_name);
+
+    /// @brief Per function called on the SatelliteAgent, set up in 'init' and only read afterwards,
+    ///        so 'wait_for_call' does not look up the metrics registry for each call.
+    std::unordered_map<std::string, CallMetrics> call_metrics;
+
+    /// @brief Per variable received from the SatelliteAgent: count of received values, and time to publish
+    ///        them in EVerest; set up in 'init'.
+    std::array<satellite_link::Counter*, satellite_link::agent_var_infos.size()> vars_received{};
+    std::array<satellite_link::Histogram*, satellite_link::agent_var_infos.size()> var_publish_duration{};
+    /// @brief Per variable received from the SatelliteAgent: end-to-end latency and its maximum.
+    std::array<satellite_link::Histogram*, satellite_link::agent_var_infos.size()> var_latency{};
+    std::array<satellite_link::Gauge*, satellite_link::agent_var_infos.size()> var_latency_max{};
+    // metrics of the hot paths, looked up once
+    satellite_link::Counter& errors_received{
+        this->metrics.counter("errors_received", "Errors raised or cleared, received from the SatelliteAgent")};
+    satellite_link::Counter& agent_events_dropped{this->metrics.counter(
+        "agent_events_dropped", "Events the SatelliteAgent dropped since its event queue was full")};
+    satellite_link::Counter& received_bytes{
+        this->metrics.counter("received_bytes", "Size of the batches of variables and errors")};
+    satellite_link::Counter& retrieve_timeouts{
+        this->metrics.counter("retrieve_timeouts", "Queries of variables and errors which timed out")};
+    satellite_link::Histogram& batch_parse_duration{
+        this->metrics.histogram("batch_parse_duration_seconds", "Time to parse a batch of variables and errors")};
+    satellite_link::Gauge& dispatch_queue_depth{this->metrics.gauge(
+        "dispatch_queue_depth", "Received batches waiting for dispatch, including the one being dispatched")};
+    satellite_link::Counter& heartbeats_missed{
+        this->metrics.counter("heartbeats_missed", "Heartbeats without response in time")};
+    satellite_link::Gauge& round_trip_time{
+        this->metrics.gauge("round_trip_time_seconds", "Round trip time of the link, measured by the heartbeat")};
+    satellite_link::Gauge& clock_offset{
+        this->metrics.gauge("clock_offset_seconds", "Estimated offset of the SatelliteAgent's clock")};
+
+    /// @brief Writes 'metrics' to 'metrics_file' periodically, runs forever.
+    void run_metrics_file();
     // ev@211cfdbe-f69a-4cd6-a4ec-f8aaa3d1b6c8:v1
 };
 
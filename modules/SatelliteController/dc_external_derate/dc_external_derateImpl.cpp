@@ -3,6 +3,8 @@
 
 #include "dc_external_derateImpl.hpp"
 
+namespace commands = satellite_link::commands::dc_external_derate;
+
 namespace module {
 namespace dc_external_derate {
 
@@ -13,9 +15,7 @@ void dc_external_derateImpl::ready() {
 }
 
 void dc_external_derateImpl::handle_set_external_derating(types::dc_external_derate::ExternalDerating& derate) {
-    json j = derate;
-
-    this->mod->rpc->call("dc_external_derate_set_external_derating", j.dump());
+    this->mod->forward<commands::set_external_derating>(derate);
 }
 
 } // namespace dc_external_derate
@@ -2,6 +2,9 @@
 // Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
 
 #include "display_messageImpl.hpp"
+#include <stdexcept>
+
+namespace commands = satellite_link::commands::display_message;
 
 namespace module {
 namespace display_message {
@@ -14,29 +17,35 @@ void display_messageImpl::ready() {
 
 types::display_message::SetDisplayMessageResponse
 display_messageImpl::handle_set_display_message(std::vector<types::display_message::DisplayMessage>& request) {
-    json j = request;
-
-    json rv = json::parse(this->mod->rpc->call("display_message_set_display_message", j.dump()).as<std::string>());
-
-    return rv;
+    auto rv = this->mod->forward<commands::set_display_message>(request);
+    if (not rv) {
+        types::display_message::SetDisplayMessageResponse failed;
+        failed.status = types::display_message::DisplayMessageStatusEnum::Rejected;
+        return failed;
+    }
+
+    return rv.value();
 }
 
 types::display_message::GetDisplayMessageResponse
 display_messageImpl::handle_get_display_messages(types::display_message::GetDisplayMessageRequest& request) {
-    json j = request;
+    auto rv = this->mod->forward<commands::get_display_messages>(request);
+    if (not rv)
+        throw std::runtime_error("Could not retrieve display messages from remote SatelliteAgent");
 
-    json rv = json::parse(this->mod->rpc->call("display_message_get_display_messages", j.dump()).as<std::string>());
-
-    return rv;
+    return rv.value();
 }
 
 types::display_message::ClearDisplayMessageResponse
 display_messageImpl::handle_clear_display_message(types::display_message::ClearDisplayMessageRequest& request) {
-    json j = request;
-
-    json rv = json::parse(this->mod->rpc->call("display_message_clear_display_message", j.dump()).as<std::string>());
-
-    return rv;
+    auto rv = this->mod->forward<commands::clear_display_message>(request);
+    if (not rv) {
+        types::display_message::ClearDisplayMessageResponse failed;
+        failed.status = types::display_message::ClearMessageResponseEnum::Unknown;
+        return failed;
+    }
+
+    return rv.value();
 }
 
 } // namespace display_message
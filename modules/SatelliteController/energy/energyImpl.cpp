@@ -2,23 +2,64 @@
 // Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
 
 #include "energyImpl.hpp"
-#include <nlohmann/json.hpp>
+#include <thread>
+#include <utility>
 
-using nlohmann::json;
+namespace commands = satellite_link::commands::energy;
 
 namespace module {
 namespace energy {
 
 void energyImpl::init() {
+    this->limits_sent =
+        &this->mod->metrics.counter("limits_sent", "Updates of the enforced limits sent to the SatelliteAgent");
+    this->limits_superseded = &this->mod->metrics.counter(
+        "limits_superseded", "Updates of the enforced limits replaced by a newer one before they were sent");
 }
 
 void energyImpl::ready() {
+    std::thread([this]() {
+        this->run_limits_sender();
+    }).detach();
 }
 
 void energyImpl::handle_enforce_limits(types::energy::EnforcedLimits& value) {
-    json j = value;
+    {
+        std::scoped_lock lock(this->pending_limits_guard);
 
-    this->mod->rpc->call("energy_enforce_limits", j.dump());
+        // latest wins: while the link is busy, outdated limits are not worth to be sent anymore
+        if (this->pending_limits.has_value()) {
+            this->limits_superseded->inc();
+            EVLOG_debug << "Superseded pending limits not sent yet (" << this->limits_superseded->get()
+                        << " in total).";
+        }
+
+        this->pending_limits = value;
+    }
+
+    this->cv_pending_limits.notify_one();
+}
+
+void energyImpl::run_limits_sender() {
+    for (;;) {
+        types::energy::EnforcedLimits limits;
+
+        {
+            std::unique_lock<std::mutex> lock(this->pending_limits_guard);
+            this->cv_pending_limits.wait(lock, [this]() { return this->pending_limits.has_value(); });
+
+            limits = std::move(this->pending_limits.value());
+            this->pending_limits.reset();
+        }
+
+        // wait for the confirmation, so that newer limits are coalesced while this call is in flight
+        satellite_link::Span span(this->mod->tracer, commands::enforce_limits::name, "command");
+        this->mod->notify_confirmed(commands::enforce_limits::call_class, commands::enforce_limits::name,
+                                    span.context(),
+                                    satellite_link::Codec<types::energy::EnforcedLimits>::encode(
+                                        limits, this->mod->payload_encoding));
+        this->limits_sent->inc();
+    }
 }
 
 } // namespace energy
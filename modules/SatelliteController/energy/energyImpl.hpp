@@ -14,6 +14,9 @@
 
 // ev@75ac1216-19eb-4182-a85c-820f1fc2c091:v1
 // insert your custom include headers here
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 // ev@75ac1216-19eb-4182-a85c-820f1fc2c091:v1
 
 namespace module {
@@ -48,6 +51,21 @@ private:
 
     // ev@3370e4dd-95f4-47a9-aaec-ea76f34a66c9:v1
     // insert your private definitions here
+    /// @brief Latest limits which were not sent yet; a newer update replaces an older one,
+    ///        so that only the latest limits are sent once the previous call completed.
+    std::optional<types::energy::EnforcedLimits> pending_limits;
+    /// @brief Mutex used for locks to protect 'pending_limits'.
+    std::mutex pending_limits_guard;
+    /// @brief Condition variable to signal that 'pending_limits' was set.
+    std::condition_variable cv_pending_limits;
+
+    /// @brief Sends the pending limits one after another, runs forever.
+    void run_limits_sender();
+
+    /// @brief Count of limit updates which were sent to the SatelliteAgent, and of those which were
+    ///        replaced by a newer one before they could be sent; registered in 'init'.
+    satellite_link::Counter* limits_sent{nullptr};
+    satellite_link::Counter* limits_superseded{nullptr};
     // ev@3370e4dd-95f4-47a9-aaec-ea76f34a66c9:v1
 };
 
@@ -2,10 +2,9 @@
 // Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
 
 #include "evse_managerImpl.hpp"
-#include <string>
-#include <nlohmann/json.hpp>
+#include <stdexcept>
 
-using nlohmann::json;
+namespace commands = satellite_link::commands::evse_manager;
 
 namespace module {
 namespace evse_manager {
@@ -17,71 +16,67 @@ void evse_managerImpl::ready() {
 }
 
 types::evse_manager::Evse evse_managerImpl::handle_get_evse() {
-    json j = json::parse(this->mod->rpc->call("evse_manager_get_evse").as<std::string>());
-    return j;
+    auto rv = this->mod->forward<commands::get_evse>();
+    if (not rv)
+        throw std::runtime_error("Could not retrieve EVSE from remote SatelliteAgent");
+
+    return rv.value();
 }
 
 bool evse_managerImpl::handle_enable_disable(int& connector_id, types::evse_manager::EnableDisableSource& cmd_source) {
-    json j = cmd_source;
-
-    return this->mod->rpc->call("evse_manager_enable_disable", connector_id, j.dump()).as<bool>();
+    return this->mod->forward<commands::enable_disable>(connector_id, cmd_source).value_or(false);
 }
 
 void evse_managerImpl::handle_authorize_response(types::authorization::ProvidedIdToken& provided_token,
                                                  types::authorization::ValidationResult& validation_result) {
-    json j_t = provided_token;
-    json j_r = validation_result;
-
-    this->mod->rpc->call("evse_manager_authorize_response", j_t.dump(), j_r.dump());
+    this->mod->forward<commands::authorize_response>(provided_token, validation_result);
 }
 
 void evse_managerImpl::handle_withdraw_authorization() {
-    this->mod->rpc->call("evse_manager_withdraw_authorization");
+    this->mod->forward<commands::withdraw_authorization>();
 }
 
 bool evse_managerImpl::handle_reserve(int& reservation_id) {
-    return this->mod->rpc->call("evse_manager_reserve", reservation_id).as<bool>();
+    return this->mod->forward<commands::reserve>(reservation_id).value_or(false);
 }
 
 void evse_managerImpl::handle_cancel_reservation() {
-    this->mod->rpc->call("evse_manager_cancel_reservation");
+    this->mod->forward<commands::cancel_reservation>();
 }
 
 bool evse_managerImpl::handle_pause_charging() {
-    return this->mod->rpc->call("evse_manager_pause_charging").as<bool>();
+    return this->mod->forward<commands::pause_charging>().value_or(false);
 }
 
 bool evse_managerImpl::handle_resume_charging() {
-    return this->mod->rpc->call("evse_manager_resume_charging").as<bool>();
+    return this->mod->forward<commands::resume_charging>().value_or(false);
 }
 
 bool evse_managerImpl::handle_stop_transaction(types::evse_manager::StopTransactionRequest& request) {
-    json j = request;
-
-    return this->mod->rpc->call("evse_manager_stop_transaction", j.dump()).as<bool>();
+    return this->mod->forward<commands::stop_transaction>(request).value_or(false);
 }
 
 bool evse_managerImpl::handle_force_unlock(int& connector_id) {
-    return this->mod->rpc->call("evse_manager_force_unlock", connector_id).as<bool>();
+    return this->mod->forward<commands::force_unlock>(connector_id).value_or(false);
 }
 
 bool evse_managerImpl::handle_external_ready_to_start_charging() {
-    return this->mod->rpc->call("evse_manager_external_ready_to_start_charging").as<bool>();
+    return this->mod->forward<commands::external_ready_to_start_charging>().value_or(false);
 }
 
 void evse_managerImpl::handle_set_plug_and_charge_configuration(
     types::evse_manager::PlugAndChargeConfiguration& plug_and_charge_configuration) {
-    json j = plug_and_charge_configuration;
-
-    this->mod->rpc->call("evse_manager_set_plug_and_charge_configuration", j.dump());
+    this->mod->forward<commands::set_plug_and_charge_configuration>(plug_and_charge_configuration);
 }
 
 types::evse_manager::UpdateAllowedEnergyTransferModesResult
 evse_managerImpl::handle_update_allowed_energy_transfer_modes(
     std::vector<types::iso15118::EnergyTransferMode>& allowed_energy_transfer_modes) {
-    json j = allowed_energy_transfer_modes;
-    json rv = json::parse(this->mod->rpc->call("evse_manager_update_allowed_energy_transfer_modes", j.dump()).as<std::string>());
-    return rv;
+    auto rv = this->mod->forward<commands::update_allowed_energy_transfer_modes>(allowed_energy_transfer_modes);
+    if (not rv)
+        throw std::runtime_error("Could not update allowed energy transfer modes on remote SatelliteAgent");
+
+    return rv.value();
 }
 
 } // namespace evse_manager
@@ -3,6 +3,8 @@
 
 #include "iso15118_extensionsImpl.hpp"
 
+namespace commands = satellite_link::commands::iso15118_extensions;
+
 namespace module {
 namespace iso15118_extensions {
 
@@ -14,9 +16,7 @@ void iso15118_extensionsImpl::ready() {
 
 void iso15118_extensionsImpl::handle_set_get_certificate_response(
     types::iso15118::ResponseExiStreamStatus& certificate_response) {
-    json j = certificate_response;
-
-    this->mod->rpc->call("iso15118_extensions_set_get_certificate_response", j.dump());
+    this->mod->forward<commands::set_get_certificate_response>(certificate_response);
 }
 
 } // namespace iso15118_extensions
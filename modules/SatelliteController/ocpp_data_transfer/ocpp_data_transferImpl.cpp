@@ -3,6 +3,8 @@
 
 #include "ocpp_data_transferImpl.hpp"
 
+namespace commands = satellite_link::commands::ocpp_data_transfer;
+
 namespace module {
 namespace ocpp_data_transfer {
 
@@ -14,11 +16,14 @@ void ocpp_data_transferImpl::ready() {
 
 types::ocpp::DataTransferResponse
 ocpp_data_transferImpl::handle_data_transfer(types::ocpp::DataTransferRequest& request) {
-    json j = request;
-
-    json rv = json::parse(this->mod->rpc->call("ocpp_data_transfer_data_transfer", j.dump()).as<std::string>());
-
-    return rv;
+    auto rv = this->mod->forward<commands::data_transfer>(request);
+    if (not rv) {
+        types::ocpp::DataTransferResponse failed;
+        failed.status = types::ocpp::DataTransferStatus::Rejected;
+        return failed;
+    }
+
+    return rv.value();
 }
 
 } // namespace ocpp_data_transfer
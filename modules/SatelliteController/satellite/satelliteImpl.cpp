@@ -24,5 +24,31 @@ bool satelliteImpl::handle_is_connected() {
     return this->mod->rpc->get_connection_state() == rpc::client::connection_state::connected;
 }
 
+double satelliteImpl::handle_get_round_trip_time_ms() {
+    return this->mod->round_trip_time_ms;
+}
+
+double satelliteImpl::handle_get_clock_offset_ms() {
+    return this->mod->clock_offset_ms;
+}
+
+std::string satelliteImpl::handle_get_statistics() {
+    std::string agent_metrics;
+
+    // the agent's metrics are appended to ours, if it can be reached
+    if (const auto rv = this->mod->call(satellite_link::CallClass::Default, "get_statistics")) {
+        try {
+            agent_metrics = rv->get().as<std::string>();
+        } catch (const std::exception& e) {
+            EVLOG_warning << "Could not decode the metrics of the SatelliteAgent: " << e.what();
+        }
+    }
+
+    if (agent_metrics.empty())
+        return this->mod->metrics.to_openmetrics();
+
+    return this->mod->metrics.to_openmetrics(false) + agent_metrics;
+}
+
 } // namespace satellite
 } // namespace module
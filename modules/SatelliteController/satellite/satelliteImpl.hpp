@@ -36,6 +36,9 @@ protected:
     virtual std::string handle_get_local_endpoint_address() override;
     virtual std::string handle_get_remote_endpoint_address() override;
     virtual bool handle_is_connected() override;
+    virtual double handle_get_round_trip_time_ms() override;
+    virtual double handle_get_clock_offset_ms() override;
+    virtual std::string handle_get_statistics() override;
 
     // ev@d2d1847a-7b88-41dd-ad07-92785f06f5c4:v1
     // insert your protected definitions here
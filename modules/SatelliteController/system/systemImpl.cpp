@@ -3,9 +3,8 @@
 
 #include "systemImpl.hpp"
 #include <string>
-#include <nlohmann/json.hpp>
 
-using nlohmann::json;
+namespace commands = satellite_link::commands::system;
 
 namespace module {
 namespace system {
@@ -18,12 +17,8 @@ void systemImpl::ready() {
 
 types::system::UpdateFirmwareResponse
 systemImpl::handle_update_firmware(types::system::FirmwareUpdateRequest& firmware_update_request) {
-    types::system::UpdateFirmwareResponse rv;
-    json j = firmware_update_request;
-    std::string rpc_rv;
-
-    rpc_rv = this->mod->rpc->call("system_update_firmware", j.dump()).as<std::string>();
-    rv = types::system::string_to_update_firmware_response(rpc_rv);
+    const auto rv = this->mod->forward<commands::update_firmware>(firmware_update_request)
+                        .value_or(types::system::UpdateFirmwareResponse::Rejected);
 
     if (rv == types::system::UpdateFirmwareResponse::Accepted) {
         this->mod->disconnect_expected = true;
@@ -33,41 +28,38 @@ systemImpl::handle_update_firmware(types::system::FirmwareUpdateRequest& firmwar
 }
 
 void systemImpl::handle_allow_firmware_installation() {
-    this->mod->rpc->call("system_allow_firmware_installation");
+    this->mod->forward<commands::allow_firmware_installation>();
 }
 
 types::system::UploadLogsResponse
 systemImpl::handle_upload_logs(types::system::UploadLogsRequest& upload_logs_request) {
-    json j = upload_logs_request;
-
-    j = json::parse(this->mod->rpc->call("system_upload_logs", j.dump()).as<std::string>());
+    auto rv = this->mod->forward<commands::upload_logs>(upload_logs_request);
+    if (not rv) {
+        types::system::UploadLogsResponse failed;
+        failed.upload_logs_status = types::system::UploadLogsStatus::Rejected;
+        return failed;
+    }
 
-    return j;
+    return rv.value();
 }
 
 bool systemImpl::handle_is_reset_allowed(types::system::ResetType& type) {
-    std::string value = types::system::reset_type_to_string(type);
-
-    return this->mod->rpc->call("sytem_is_reset_allowed", value).as<bool>();
+    return this->mod->forward<commands::is_reset_allowed>(type).value_or(false);
 }
 
 void systemImpl::handle_reset(types::system::ResetType& type, bool& scheduled) {
-    std::string value = types::system::reset_type_to_string(type);
-
     // remember to be not surprised when disconnect happens
     this->mod->disconnect_expected = true;
 
-    this->mod->rpc->call("sytem_reset", value, scheduled);
+    this->mod->forward<commands::reset>(type, scheduled);
 }
 
 bool systemImpl::handle_set_system_time(std::string& timestamp) {
-    return this->mod->rpc->call("system_set_system_time", timestamp).as<bool>();
+    return this->mod->forward<commands::set_system_time>(timestamp).value_or(false);
 }
 
 types::system::BootReason systemImpl::handle_get_boot_reason() {
-    std::string rv = this->mod->rpc->call("system_get_boot_reason").as<std::string>();
-
-    return types::system::string_to_boot_reason(rv);
+    return this->mod->forward<commands::get_boot_reason>().value_or(types::system::BootReason::Unknown);
 }
 
 } // namespace system
@@ -3,6 +3,8 @@
 
 #include "uk_random_delayImpl.hpp"
 
+namespace commands = satellite_link::commands::uk_random_delay;
+
 namespace module {
 namespace uk_random_delay {
 
@@ -13,19 +15,19 @@ void uk_random_delayImpl::ready() {
 }
 
 void uk_random_delayImpl::handle_enable() {
-    this->mod->rpc->call("uk_random_delay_enable");
+    this->mod->forward<commands::enable>();
 }
 
 void uk_random_delayImpl::handle_disable() {
-    this->mod->rpc->call("uk_random_delay_disable");
+    this->mod->forward<commands::disable>();
 }
 
 void uk_random_delayImpl::handle_cancel() {
-    this->mod->rpc->call("uk_random_delay_cancel");
+    this->mod->forward<commands::cancel>();
 }
 
 void uk_random_delayImpl::handle_set_duration_s(int& value) {
-    this->mod->rpc->call("uk_random_delay_set_duration_s", value);
+    this->mod->forward<commands::set_duration_s>(value);
 }
 
 } // namespace uk_random_delay
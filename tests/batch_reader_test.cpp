@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <satellite_link/batch_reader.hpp>
+
+using json = nlohmann::json;
+using satellite_link::BatchList;
+using satellite_link::BatchReader;
+
+namespace {
+
+struct Item {
+    BatchList list;
+    json value;
+};
+
+// feeds the given text into a BatchReader and collects the items it passes on
+struct Collector {
+    std::vector<Item> items;
+    BatchReader reader{[this](BatchList list, json& item) { this->items.push_back({list, std::move(item)}); }};
+
+    bool parse(const std::string& text) {
+        return json::sax_parse(text, &this->reader);
+    }
+
+    bool parse_msgpack(const json& value) {
+        return json::sax_parse(json::to_msgpack(value), &this->reader, json::input_format_t::msgpack);
+    }
+};
+
+} // namespace
+
+TEST(BatchReader, ItemsInOrder) {
+    Collector c;
+
+    ASSERT_TRUE(c.parse(R"({"errors": [{"seq": 3}], "vars": [{"seq": 1, "value": 1.5}, {"seq": 2, "value": "x"}]})"));
+
+    ASSERT_EQ(c.items.size(), 3);
+    EXPECT_EQ(c.items[0].list, BatchList::Errors);
+    EXPECT_EQ(c.items[0].value, json({{"seq", 3}}));
+    EXPECT_EQ(c.items[1].list, BatchList::Vars);
+    EXPECT_EQ(c.items[1].value, json({{"seq", 1}, {"value", 1.5}}));
+    EXPECT_EQ(c.items[2].list, BatchList::Vars);
+    EXPECT_EQ(c.items[2].value, json({{"seq", 2}, {"value", "x"}}));
+    EXPECT_TRUE(c.reader.error().empty());
+}
+
+TEST(BatchReader, EmptyLists) {
+    Collector c;
+
+    ASSERT_TRUE(c.parse(R"({"errors": [], "vars": []})"));
+    EXPECT_TRUE(c.items.empty());
+}
+
+TEST(BatchReader, NestedContainers) {
+    const auto item = R"({
+        "seq": 7,
+        "value": {
+            "energy_Wh_import": {"total": 1.0, "phases": [1, [2, 3], {"L1": null}]},
+            "empty_object": {},
+            "empty_array": [],
+            "flags": [true, false],
+            "objects": [{"a": {"b": {"c": -1}}}, {}]
+        }
+    })"_json;
+    Collector c;
+
+    ASSERT_TRUE(c.parse(json({{"vars", {item, item}}}).dump()));
+
+    ASSERT_EQ(c.items.size(), 2);
+    EXPECT_EQ(c.items[0].value, item);
+    EXPECT_EQ(c.items[1].value, item);
+}
+
+TEST(BatchReader, UnknownMembersSkipped) {
+    Collector c;
+
+    // neither the unknown list nor the scalars or containers outside of the lists are items
+    ASSERT_TRUE(c.parse(R"({
+        "version": 2,
+        "meta": {"vars": [{"seq": 100}], "nested": [[{"seq": 101}]]},
+        "other": [{"seq": 102}, {"seq": 103}],
+        "vars": [{"seq": 1}, 5, "text", [{"seq": 104}], {"seq": 2}],
+        "trailer": [{"seq": 105}]
+    })"));
+
+    ASSERT_EQ(c.items.size(), 2);
+    EXPECT_EQ(c.items[0].value.at("seq"), 1);
+    EXPECT_EQ(c.items[1].value.at("seq"), 2);
+}
+
+TEST(BatchReader, Msgpack) {
+    const json batch{
+        {"errors", json::array()},
+        {"vars", {{{"seq", 1}, {"value", json::binary({0x01, 0x02, 0x03})}}, {{"seq", 2}, {"value", -7}}}},
+    };
+    Collector c;
+
+    ASSERT_TRUE(c.parse_msgpack(batch));
+
+    ASSERT_EQ(c.items.size(), 2);
+    EXPECT_EQ(c.items[0].value.at("value"), json::binary({0x01, 0x02, 0x03}));
+    EXPECT_EQ(c.items[1].value.at("value"), -7);
+}
+
+TEST(BatchReader, ItemCutOffByParseError) {
+    Collector c;
+
+    // the item being parsed when the error occurs is not passed on, the complete ones before are
+    EXPECT_FALSE(c.parse(R"({"errors": [{"seq": 3}], "vars": [{"seq": 1}, {"seq": 2, "value": {"a": [1, )"));
+
+    ASSERT_EQ(c.items.size(), 2);
+    EXPECT_EQ(c.items[0].value.at("seq"), 3);
+    EXPECT_EQ(c.items[1].value.at("seq"), 1);
+    EXPECT_FALSE(c.reader.error().empty());
+}
+
+TEST(BatchReader, TruncatedMsgpack) {
+    const json batch{{"vars", {{{"seq", 1}, {"value", "first"}}, {{"seq", 2}, {"value", "second"}}}}};
+    auto buffer = json::to_msgpack(batch);
+    buffer.resize(buffer.size() - 3);
+
+    Collector c;
+    EXPECT_FALSE(json::sax_parse(buffer, &c.reader, json::input_format_t::msgpack));
+
+    ASSERT_EQ(c.items.size(), 1);
+    EXPECT_EQ(c.items[0].value.at("seq"), 1);
+    EXPECT_FALSE(c.reader.error().empty());
+}
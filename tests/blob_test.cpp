@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <satellite_link/blob.hpp>
+#include <satellite_link/packed.hpp>
+
+using satellite_link::BLOB_CHUNK_SIZE;
+using satellite_link::BlobAssembler;
+using satellite_link::BlobRef;
+using satellite_link::BlobStore;
+
+namespace {
+
+std::vector<std::uint8_t> bytes_of_size(std::size_t size) {
+    std::vector<std::uint8_t> bytes(size);
+    for (std::size_t i = 0; i < size; i++)
+        bytes[i] = static_cast<std::uint8_t>(i * 7 + i / 251);
+    return bytes;
+}
+
+std::string encode(const std::vector<std::uint8_t>& bytes) {
+    std::string text;
+    satellite_link::base64_encode(bytes.data(), bytes.size(), text);
+    return text;
+}
+
+std::optional<std::vector<std::uint8_t>> decode(const std::string& text) {
+    const auto size = satellite_link::base64_decoded_size(text);
+    if (not size.has_value())
+        return std::nullopt;
+
+    std::vector<std::uint8_t> bytes(size.value());
+    if (not satellite_link::base64_decode(text, bytes.data()))
+        return std::nullopt;
+
+    return bytes;
+}
+
+// a blob of three chunks, the last one shorter than the others
+const auto blob = bytes_of_size(2 * BLOB_CHUNK_SIZE + 100);
+
+bool add_chunk(BlobAssembler& assembler, std::uint64_t id, std::size_t index,
+               const std::vector<std::uint8_t>& bytes = blob) {
+    const auto offset = index * BLOB_CHUNK_SIZE;
+    const auto size = std::min(BLOB_CHUNK_SIZE, bytes.size() - offset);
+
+    return assembler.add_chunk(id, offset, bytes.size(), bytes.data() + offset, size);
+}
+
+// a blob channel which transfers the blobs through a BlobStore and a BlobAssembler, chunk by chunk,
+// as the two modules do over the RPC link
+class LoopbackBlobChannel : public satellite_link::BlobChannel {
+public:
+    std::optional<BlobRef> send(std::vector<std::uint8_t>& bytes) override {
+        return this->store.put(std::move(bytes));
+    }
+
+    std::vector<std::uint8_t> receive(const BlobRef& ref) override {
+        for (std::uint64_t offset = 0; offset < ref.size; offset += BLOB_CHUNK_SIZE) {
+            const auto chunk = this->store.chunk(ref.id, offset);
+            if (not chunk.has_value() or
+                not this->assembler.add_chunk(ref.id, offset, ref.size, chunk->data(), chunk->size()))
+                throw std::runtime_error("Could not fetch blob " + std::to_string(ref.id));
+        }
+
+        return this->assembler.take(ref);
+    }
+
+private:
+    BlobStore store;
+    BlobAssembler assembler;
+};
+
+} // namespace
+
+TEST(Base64, KnownValues) {
+    // test vectors of RFC 4648
+    const std::vector<std::pair<std::string, std::string>> vectors{
+        {"", ""},
+        {"f", "Zg=="},
+        {"fo", "Zm8="},
+        {"foo", "Zm9v"},
+        {"foob", "Zm9vYg=="},
+        {"fooba", "Zm9vYmE="},
+        {"foobar", "Zm9vYmFy"},
+    };
+
+    for (const auto& [plain, text] : vectors) {
+        const std::vector<std::uint8_t> bytes(plain.begin(), plain.end());
+
+        EXPECT_EQ(encode(bytes), text);
+        EXPECT_EQ(decode(text), bytes) << text;
+    }
+}
+
+TEST(Base64, RoundTrip) {
+    for (std::size_t size = 0; size < 300; size++) {
+        const auto bytes = bytes_of_size(size);
+        const auto text = encode(bytes);
+
+        EXPECT_EQ(satellite_link::base64_decoded_size(text), size);
+        EXPECT_EQ(decode(text), bytes) << "size " << size;
+    }
+}
+
+TEST(Base64, AllByteValues) {
+    std::vector<std::uint8_t> bytes;
+    for (int i = 0; i < 256; i++)
+        bytes.push_back(static_cast<std::uint8_t>(i));
+
+    EXPECT_EQ(decode(encode(bytes)), bytes);
+}
+
+TEST(Base64, NonCanonicalRejected) {
+    const std::vector<std::string> texts{
+        "Zg",         // missing padding
+        "Zg=",        // incomplete padding
+        "Zh==",       // unused bits set
+        "Zm9=",       // unused bits set
+        "Zg==Zg==",   // padding in the middle
+        "=Zg=",       // padding at the start
+        "Z===",       // too much padding
+        "====",       // nothing but padding
+        "Zm9v\nZg=",  // line break
+        "Zm 9",       // white space
+        "Zm9-",       // URL-safe alphabet
+        "Zm9_",       // URL-safe alphabet
+        "Zm9v\x80gA=", // not ASCII
+    };
+
+    for (const auto& text : texts)
+        EXPECT_FALSE(decode(text).has_value()) << text;
+}
+
+TEST(PackedBlob, Representations) {
+    const auto small = encode(bytes_of_size(100));
+    const auto large = encode(bytes_of_size(satellite_link::BLOB_INLINE_MAX_SIZE + 1));
+    const std::string non_canonical{"Zh=="};
+
+    LoopbackBlobChannel channel;
+
+    for (const auto& text : {small, large, non_canonical}) {
+        std::vector<std::uint8_t> buffer;
+        satellite_link::PackedWriter(buffer, &channel).put_blob(text);
+
+        const auto expected = text == non_canonical ? satellite_link::PackedBlob::Text
+                              : text == large       ? satellite_link::PackedBlob::Ref
+                                                    : satellite_link::PackedBlob::Inline;
+        EXPECT_EQ(static_cast<satellite_link::PackedBlob>(buffer.at(0)), expected);
+
+        // the original text survives the round-trip, whichever representation was used
+        std::string decoded;
+        satellite_link::PackedReader reader(buffer, &channel);
+        reader.get_blob(decoded);
+
+        EXPECT_EQ(decoded, text);
+        EXPECT_TRUE(reader.at_end());
+    }
+}
+
+TEST(PackedBlob, ReferenceWithoutChannel) {
+    LoopbackBlobChannel channel;
+    std::vector<std::uint8_t> buffer;
+    satellite_link::PackedWriter(buffer, &channel)
+        .put_blob(encode(bytes_of_size(satellite_link::BLOB_INLINE_MAX_SIZE + 1)));
+
+    std::string decoded;
+    satellite_link::PackedReader reader(buffer);
+    EXPECT_THROW(reader.get_blob(decoded), satellite_link::PackedFormatError);
+}
+
+TEST(BlobAssembler, InOrder) {
+    BlobAssembler assembler;
+
+    for (std::size_t index = 0; index < 3; index++)
+        EXPECT_TRUE(add_chunk(assembler, 1, index));
+
+    EXPECT_EQ(assembler.take({1, blob.size()}), blob);
+}
+
+TEST(BlobAssembler, OutOfOrder) {
+    BlobAssembler assembler;
+
+    EXPECT_TRUE(add_chunk(assembler, 1, 2));
+    EXPECT_TRUE(add_chunk(assembler, 1, 0));
+    EXPECT_THROW(assembler.take({1, blob.size()}), std::runtime_error);
+
+    // the failed take leaves the partial blob in place
+    EXPECT_TRUE(add_chunk(assembler, 1, 1));
+    EXPECT_EQ(assembler.take({1, blob.size()}), blob);
+}
+
+TEST(BlobAssembler, DuplicateChunk) {
+    BlobAssembler assembler;
+    auto other = blob;
+    other[0] ^= 0xff;
+
+    // a duplicate is accepted, but neither counts as another chunk nor overwrites the first one
+    EXPECT_TRUE(add_chunk(assembler, 1, 0));
+    EXPECT_TRUE(add_chunk(assembler, 1, 0, other));
+    EXPECT_TRUE(add_chunk(assembler, 1, 2));
+    EXPECT_THROW(assembler.take({1, blob.size()}), std::runtime_error);
+
+    EXPECT_TRUE(add_chunk(assembler, 1, 1));
+    EXPECT_TRUE(add_chunk(assembler, 1, 1));
+    EXPECT_EQ(assembler.take({1, blob.size()}), blob);
+}
+
+TEST(BlobAssembler, InterleavedBlobs) {
+    const auto second = bytes_of_size(BLOB_CHUNK_SIZE + 1);
+    BlobAssembler assembler;
+
+    EXPECT_TRUE(add_chunk(assembler, 2, 1, second));
+    EXPECT_TRUE(add_chunk(assembler, 1, 1));
+    EXPECT_TRUE(add_chunk(assembler, 1, 0));
+    EXPECT_TRUE(add_chunk(assembler, 2, 0, second));
+    EXPECT_TRUE(add_chunk(assembler, 1, 2));
+
+    EXPECT_EQ(assembler.take({2, second.size()}), second);
+    EXPECT_EQ(assembler.take({1, blob.size()}), blob);
+}
+
+TEST(BlobAssembler, InvalidChunks) {
+    BlobAssembler assembler;
+    const auto* data = blob.data();
+
+    EXPECT_FALSE(assembler.add_chunk(1, 0, 0, data, 0));
+    EXPECT_FALSE(assembler.add_chunk(1, 0, satellite_link::MAX_BLOB_SIZE + 1, data, BLOB_CHUNK_SIZE));
+    EXPECT_FALSE(assembler.add_chunk(1, 1, blob.size(), data, BLOB_CHUNK_SIZE));
+    EXPECT_FALSE(assembler.add_chunk(1, 3 * BLOB_CHUNK_SIZE, blob.size(), data, 100));
+    EXPECT_FALSE(assembler.add_chunk(1, 0, blob.size(), data, BLOB_CHUNK_SIZE - 1));
+    EXPECT_FALSE(assembler.add_chunk(1, 2 * BLOB_CHUNK_SIZE, blob.size(), data, BLOB_CHUNK_SIZE));
+
+    // the size of a blob must not change between its chunks
+    EXPECT_TRUE(add_chunk(assembler, 1, 0));
+    EXPECT_FALSE(assembler.add_chunk(1, BLOB_CHUNK_SIZE, blob.size() + 1, data, BLOB_CHUNK_SIZE));
+}
+
+TEST(BlobAssembler, Take) {
+    BlobAssembler assembler;
+
+    EXPECT_THROW(assembler.take({1, blob.size()}), std::runtime_error);
+
+    for (std::size_t index = 0; index < 3; index++)
+        add_chunk(assembler, 1, index);
+
+    EXPECT_THROW(assembler.take({1, blob.size() - 1}), std::runtime_error);
+    EXPECT_EQ(assembler.take({1, blob.size()}), blob);
+    EXPECT_THROW(assembler.take({1, blob.size()}), std::runtime_error);
+}
+
+TEST(BlobStore, Chunks) {
+    BlobStore store;
+    const auto ref = store.put(blob);
+
+    EXPECT_EQ(ref.size, blob.size());
+    EXPECT_EQ(store.chunk(ref.id, 0)->size(), BLOB_CHUNK_SIZE);
+    EXPECT_EQ(store.chunk(ref.id, 2 * BLOB_CHUNK_SIZE)->size(), 100);
+    EXPECT_FALSE(store.chunk(ref.id, blob.size()).has_value());
+    EXPECT_FALSE(store.chunk(ref.id + 1, 0).has_value());
+}
+
+TEST(BlobStore, OldestDropped) {
+    BlobStore store;
+    const auto first = store.put(blob);
+
+    for (std::size_t i = 0; i < satellite_link::MAX_PENDING_BLOBS; i++)
+        store.put(bytes_of_size(1));
+
+    EXPECT_FALSE(store.chunk(first.id, 0).has_value());
+}
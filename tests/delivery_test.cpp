@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <variant>
+#include <vector>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <satellite_link/delivery.hpp>
+#include <satellite_link/var_queue.hpp>
+
+using json = nlohmann::json;
+using satellite_link::AgentVar;
+using satellite_link::ReceiveWindow;
+using satellite_link::UnackedItems;
+using satellite_link::VarQueue;
+
+namespace {
+
+std::vector<std::uint64_t> seqs_of(const json& items) {
+    std::vector<std::uint64_t> seqs;
+    for (const auto& item : items)
+        seqs.push_back(item.at("seq").get<std::uint64_t>());
+    return seqs;
+}
+
+std::vector<AgentVar> vars_of(const std::vector<satellite_link::VarEvent>& events) {
+    std::vector<AgentVar> vars;
+    for (const auto& event : events)
+        vars.push_back(event.var);
+    return vars;
+}
+
+// a queue with its mutex, whose wait returns how long it took
+struct Queue {
+    std::mutex guard;
+    VarQueue queue{this->guard};
+
+    std::chrono::steady_clock::duration wait(std::chrono::milliseconds max_wait,
+                                             std::chrono::milliseconds bulk_window) {
+        std::unique_lock<std::mutex> lock(this->guard);
+        const auto start = std::chrono::steady_clock::now();
+
+        this->queue.wait(lock, start + max_wait, bulk_window, []() { return false; });
+        return std::chrono::steady_clock::now() - start;
+    }
+};
+
+} // namespace
+
+TEST(UnackedItems, NumbersAndAcknowledges) {
+    UnackedItems unacked;
+
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::EvseManagerEvseId, {}));
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::EvseManagerReady, {}));
+    unacked.add_error({{"action", "raise"}});
+
+    EXPECT_EQ(unacked.size(), 3);
+    EXPECT_EQ(seqs_of(unacked.batch().at("vars")), std::vector<std::uint64_t>({1, 2}));
+    EXPECT_EQ(seqs_of(unacked.batch().at("errors")), std::vector<std::uint64_t>({3}));
+    EXPECT_EQ(unacked.batch().at("vars")[1].at("tag"), satellite_link::to_tag(AgentVar::EvseManagerReady));
+
+    // nothing acknowledged yet, so everything is delivered again
+    EXPECT_TRUE(unacked.acknowledge(0));
+    EXPECT_TRUE(unacked.acknowledge(1));
+    EXPECT_EQ(unacked.size(), 2);
+
+    EXPECT_FALSE(unacked.acknowledge(3));
+    EXPECT_TRUE(unacked.empty());
+
+    // the numbering goes on after the acknowledgement
+    unacked.add_error({{"action", "clear"}});
+    EXPECT_EQ(seqs_of(unacked.batch().at("errors")), std::vector<std::uint64_t>({4}));
+}
+
+TEST(UnackedItems, StatesReplacePendingItem) {
+    UnackedItems unacked;
+
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::EvseManagerEvseId, {}));
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::SystemLogStatus, {}));
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::SystemLogStatus, {}));
+    EXPECT_TRUE(unacked.pending(AgentVar::EvseManagerEvseId));
+    EXPECT_FALSE(unacked.pending(AgentVar::EvseManagerReady));
+
+    // a newer value of a state supersedes the pending one, events are all kept
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::EvseManagerEvseId, {}));
+    EXPECT_EQ(seqs_of(unacked.batch().at("vars")), std::vector<std::uint64_t>({2, 3, 4}));
+
+    EXPECT_FALSE(unacked.acknowledge(4));
+    EXPECT_FALSE(unacked.pending(AgentVar::EvseManagerEvseId));
+}
+
+TEST(UnackedItems, FullWithEventsOnly) {
+    UnackedItems unacked;
+
+    for (std::size_t i = 0; i < UnackedItems::CAPACITY; i++) {
+        EXPECT_FALSE(unacked.full());
+        unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::SystemLogStatus, {}));
+    }
+
+    EXPECT_TRUE(unacked.full());
+    EXPECT_TRUE(unacked.acknowledge(1));
+    EXPECT_FALSE(unacked.full());
+}
+
+TEST(UnackedItems, BlobsHeldUntilAcknowledged) {
+    satellite_link::BlobStore store;
+    UnackedItems unacked(&store);
+    satellite_link::HoldingBlobChannel channel(store);
+    std::vector<std::uint8_t> bytes(100);
+
+    const auto ref = channel.send(bytes);
+    ASSERT_TRUE(ref.has_value());
+    unacked.add_var(satellite_link::make_var_item(unacked.next_seq(), AgentVar::SystemLogStatus, {}),
+                    channel.take_held());
+
+    // far more blobs than the store keeps otherwise
+    for (std::size_t i = 0; i < 2 * satellite_link::MAX_PENDING_BLOBS; i++)
+        store.put(std::vector<std::uint8_t>(1));
+    EXPECT_TRUE(store.chunk(ref->id, 0).has_value());
+
+    // once acknowledged, the blob is released and dropped like any other
+    unacked.acknowledge(1);
+    for (std::size_t i = 0; i < satellite_link::MAX_PENDING_BLOBS; i++)
+        store.put(std::vector<std::uint8_t>(1));
+    EXPECT_FALSE(store.chunk(ref->id, 0).has_value());
+}
+
+TEST(ReceiveWindow, SkipsItemsReceivedBefore) {
+    ReceiveWindow window;
+
+    window.start_batch();
+    EXPECT_TRUE(window.receive(3));
+    EXPECT_TRUE(window.receive(1));
+    EXPECT_TRUE(window.receive(2));
+    EXPECT_EQ(window.ack(), 3);
+
+    // the acknowledgement was lost, so the agent delivers the items again together with new ones
+    window.start_batch();
+    EXPECT_FALSE(window.receive(1));
+    EXPECT_FALSE(window.receive(3));
+    EXPECT_TRUE(window.receive(4));
+    EXPECT_EQ(window.ack(), 4);
+}
+
+TEST(ReceiveWindow, AbortKeepsUnbrokenRun) {
+    ReceiveWindow window;
+
+    window.start_batch();
+    window.receive(1);
+    window.receive(2);
+    ASSERT_EQ(window.ack(), 2);
+
+    // the errors (7) come first, then the variables (3..6) are cut off after 4
+    window.start_batch();
+    window.receive(7);
+    window.receive(3);
+    window.receive(4);
+
+    EXPECT_EQ(window.abort_batch(), 4);
+    EXPECT_EQ(window.ack(), 4);
+
+    // nothing usable received
+    window.start_batch();
+    window.receive(6);
+    EXPECT_EQ(window.abort_batch(), 4);
+}
+
+TEST(VarQueue, StatesCoalesce) {
+    Queue q;
+
+    EXPECT_TRUE(q.queue.push(AgentVar::EvseManagerEvseId, std::string("first")));
+    EXPECT_TRUE(q.queue.push(AgentVar::EvseManagerEvseId, std::string("second")));
+
+    std::scoped_lock lock(q.guard);
+    const auto events = q.queue.drain();
+
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(std::get<std::string>(events[0].value), "second");
+    EXPECT_TRUE(q.queue.drain().empty());
+}
+
+TEST(VarQueue, DrainedByPriorityThenPublication) {
+    Queue q;
+
+    q.queue.push(AgentVar::SystemLogStatus, types::system::LogStatus{});
+    q.queue.push(AgentVar::EvseManagerTelemetry, types::evse_board_support::Telemetry{});
+    q.queue.push(AgentVar::EvseManagerEvseId, std::string("evse1"));
+    q.queue.push(AgentVar::EvseManagerReady, true);
+    q.queue.push(AgentVar::SystemFirmwareUpdateStatus, types::system::FirmwareUpdateStatus{});
+
+    std::scoped_lock lock(q.guard);
+
+    EXPECT_EQ(vars_of(q.queue.drain()),
+              std::vector<AgentVar>({AgentVar::EvseManagerReady, AgentVar::SystemLogStatus, AgentVar::EvseManagerEvseId,
+                                     AgentVar::SystemFirmwareUpdateStatus, AgentVar::EvseManagerTelemetry}));
+}
+
+TEST(VarQueue, EventsDroppedWhenFull) {
+    Queue q;
+
+    for (std::size_t i = 0; i < VarQueue::CAPACITY; i++)
+        ASSERT_TRUE(q.queue.push(AgentVar::SystemLogStatus, types::system::LogStatus{}));
+
+    EXPECT_FALSE(q.queue.push(AgentVar::SystemLogStatus, types::system::LogStatus{}));
+    EXPECT_FALSE(q.queue.push(AgentVar::SystemLogStatus, types::system::LogStatus{}));
+
+    // the loss is counted, so that it can be reported to the controller
+    EXPECT_EQ(q.queue.take_dropped(), 2);
+    EXPECT_EQ(q.queue.take_dropped(), 0);
+
+    // states have their own slots and are never dropped
+    EXPECT_TRUE(q.queue.push(AgentVar::EvseManagerReady, true));
+
+    std::scoped_lock lock(q.guard);
+    EXPECT_EQ(q.queue.drain().size(), VarQueue::CAPACITY + 1);
+}
+
+TEST(VarQueue, EventsLeftQueuedOnRequest) {
+    Queue q;
+
+    q.queue.push(AgentVar::SystemLogStatus, types::system::LogStatus{});
+    q.queue.push(AgentVar::EvseManagerReady, true);
+
+    std::scoped_lock lock(q.guard);
+    EXPECT_EQ(vars_of(q.queue.drain(false)), std::vector<AgentVar>({AgentVar::EvseManagerReady}));
+    EXPECT_EQ(vars_of(q.queue.drain()), std::vector<AgentVar>({AgentVar::SystemLogStatus}));
+}
+
+TEST(VarQueue, WaitEndsWhenSomethingIsPending) {
+    Queue q;
+
+    q.queue.push(AgentVar::EvseManagerReady, true);
+    EXPECT_LT(q.wait(std::chrono::seconds(10), std::chrono::seconds(10)), std::chrono::seconds(5));
+}
+
+TEST(VarQueue, BulkUpdatesWaitForTheirWindow) {
+    Queue q;
+    const auto start = std::chrono::steady_clock::now();
+
+    // the window starts with the publication
+    q.queue.push(AgentVar::EvseManagerTelemetry, types::evse_board_support::Telemetry{});
+    q.wait(std::chrono::seconds(10), std::chrono::milliseconds(50));
+
+    const auto waited = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(waited, std::chrono::milliseconds(50));
+    EXPECT_LT(waited, std::chrono::seconds(5));
+
+    std::scoped_lock lock(q.guard);
+    EXPECT_EQ(q.queue.drain().size(), 1);
+}
+
+TEST(VarQueue, WaitStopsOnRequest) {
+    Queue q;
+    std::unique_lock<std::mutex> lock(q.guard);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    q.queue.wait(lock, deadline, std::chrono::milliseconds(0), []() { return true; });
+    EXPECT_LT(std::chrono::steady_clock::now(), deadline);
+}
@@ -0,0 +1,345 @@
+// SPDX-License-Identifier: GPL-3.0-only
+// Copyright Michael Heimpold, chargebyte GmbH, Pionix GmbH and Contributors to EVerest
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <satellite_link/packed_types.hpp>
+
+using json = nlohmann::json;
+using satellite_link::PackedFormatError;
+using satellite_link::PackedReader;
+using satellite_link::PackedWriter;
+
+namespace {
+
+using Powermeter = types::powermeter::Powermeter;
+using Telemetry = types::evse_board_support::Telemetry;
+
+const auto powermeter = R"({
+    "timestamp": "2026-02-11T14:03:27.412Z",
+    "meter_id": "SDM72DM-0001",
+    "phase_seq_error": false,
+    "energy_Wh_import": {"total": 1523874.0, "L1": 508112.0, "L2": 507903.0, "L3": 507859.0},
+    "energy_Wh_export": {"total": 0.0},
+    "power_W": {"total": 10872.4, "L1": 3620.1, "L2": 3631.5, "L3": 3620.8},
+    "voltage_V": {"L1": 230.4, "L2": 231.1, "L3": 229.8},
+    "VAR": {"total": 12.5, "VARphA": 4.25},
+    "current_A": {"L1": 15.71, "L2": 15.72, "L3": 15.76, "N": 0.08},
+    "frequency_Hz": {"L1": 50.01}
+})"_json;
+
+const auto telemetry = R"({
+    "evse_temperature_C": 31.5,
+    "fan_rpm": 0.0,
+    "supply_voltage_12V": 12.07,
+    "supply_voltage_minus_12V": -11.94,
+    "relais_on": true
+})"_json;
+
+std::vector<std::uint8_t> varint(std::uint64_t value) {
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put_varint(value);
+    return buffer;
+}
+
+template <typename T> std::vector<std::uint8_t> pack(const json& value) {
+    std::vector<std::uint8_t> buffer;
+    satellite_link::pack_value(value.get<T>(), buffer, nullptr);
+    return buffer;
+}
+
+template <typename T> json unpack(const std::vector<std::uint8_t>& buffer) {
+    return satellite_link::unpack_value<T>(buffer.data(), buffer.size(), nullptr);
+}
+
+// every proper prefix of a packed value must be rejected, never read beyond the end
+template <typename T> void expect_truncation_rejected(const std::vector<std::uint8_t>& buffer) {
+    for (std::size_t size = 0; size < buffer.size(); size++)
+        EXPECT_THROW(satellite_link::unpack_value<T>(buffer.data(), size, nullptr), PackedFormatError)
+            << "truncated to " << size << " of " << buffer.size() << " bytes";
+}
+
+} // namespace
+
+TEST(PackedVarint, RoundTrip) {
+    const std::vector<std::uint64_t> values{
+        0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0xffffffff, 0x100000000, 1ULL << 63,
+        std::numeric_limits<std::uint64_t>::max(),
+    };
+
+    for (const auto value : values) {
+        const auto buffer = varint(value);
+        PackedReader reader(buffer);
+
+        EXPECT_EQ(reader.get_varint(), value);
+        EXPECT_TRUE(reader.at_end());
+    }
+}
+
+TEST(PackedVarint, Size) {
+    EXPECT_EQ(varint(0), (std::vector<std::uint8_t>{0x00}));
+    EXPECT_EQ(varint(0x7f), (std::vector<std::uint8_t>{0x7f}));
+    EXPECT_EQ(varint(0x80), (std::vector<std::uint8_t>{0x80, 0x01}));
+    EXPECT_EQ(varint(300), (std::vector<std::uint8_t>{0xac, 0x02}));
+    EXPECT_EQ(varint(0x4000).size(), 3);
+    EXPECT_EQ(varint(std::numeric_limits<std::uint64_t>::max()).size(), 10);
+}
+
+TEST(PackedVarint, Truncated) {
+    auto buffer = varint(0x4000);
+    buffer.pop_back();
+
+    PackedReader reader(buffer);
+    EXPECT_THROW(reader.get_varint(), PackedFormatError);
+}
+
+TEST(PackedVarint, TooLong) {
+    const std::vector<std::uint8_t> buffer(11, 0x80);
+
+    PackedReader reader(buffer);
+    EXPECT_THROW(reader.get_varint(), PackedFormatError);
+}
+
+TEST(PackedNumbers, LittleEndian) {
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put(std::uint32_t{0x01020304});
+
+    EXPECT_EQ(buffer, (std::vector<std::uint8_t>{0x04, 0x03, 0x02, 0x01}));
+}
+
+TEST(PackedNumbers, RoundTrip) {
+    std::vector<std::uint8_t> buffer;
+    PackedWriter writer(buffer);
+
+    writer.put(true);
+    writer.put(-1.5f);
+    writer.put(std::numeric_limits<double>::lowest());
+    writer.put(std::int32_t{-42});
+    writer.put(std::numeric_limits<std::uint64_t>::max());
+
+    PackedReader reader(buffer);
+    bool b{false};
+    float f{0};
+    double d{0};
+    std::int32_t i{0};
+    std::uint64_t u{0};
+
+    reader.get(b);
+    reader.get(f);
+    reader.get(d);
+    reader.get(i);
+    reader.get(u);
+
+    EXPECT_TRUE(b);
+    EXPECT_EQ(f, -1.5f);
+    EXPECT_EQ(d, std::numeric_limits<double>::lowest());
+    EXPECT_EQ(i, -42);
+    EXPECT_EQ(u, std::numeric_limits<std::uint64_t>::max());
+    EXPECT_TRUE(reader.at_end());
+
+    float truncated{0};
+    PackedReader short_reader(buffer.data(), 3);
+    short_reader.get_u8();
+    EXPECT_THROW(short_reader.get(truncated), PackedFormatError);
+}
+
+TEST(PackedStrings, RoundTrip) {
+    std::vector<std::uint8_t> buffer;
+    PackedWriter writer(buffer);
+
+    writer.put(std::string());
+    writer.put(std::string("SDM72DM-0001"));
+    writer.put(std::string(200, 'x'));
+
+    PackedReader reader(buffer);
+    std::string s;
+
+    reader.get(s);
+    EXPECT_EQ(s, "");
+    reader.get(s);
+    EXPECT_EQ(s, "SDM72DM-0001");
+    reader.get(s);
+    EXPECT_EQ(s, std::string(200, 'x'));
+    EXPECT_TRUE(reader.at_end());
+}
+
+TEST(PackedStrings, SizeBeyondEnd) {
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put(std::string("hello"));
+    buffer.pop_back();
+
+    PackedReader reader(buffer);
+    std::string s;
+    EXPECT_THROW(reader.get(s), PackedFormatError);
+}
+
+TEST(PackedFields, PresenceMask) {
+    const float mandatory{1.0f};
+    const std::optional<float> absent;
+    const std::optional<float> present{2.0f};
+    const std::optional<double> last{3.0};
+
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put_fields(mandatory, absent, present, last);
+
+    // mask, followed by the three present values
+    ASSERT_EQ(buffer.size(), 1 + 4 + 4 + 8);
+    EXPECT_EQ(buffer[0], 0b1101);
+
+    float a{0};
+    std::optional<float> b{9.0f};
+    std::optional<float> c;
+    std::optional<double> d;
+
+    PackedReader reader(buffer);
+    reader.get_fields(satellite_link::field("a", a), satellite_link::field("b", b), satellite_link::field("c", c),
+                      satellite_link::field("d", d));
+
+    EXPECT_EQ(a, 1.0f);
+    EXPECT_FALSE(b.has_value());
+    EXPECT_EQ(c, 2.0f);
+    EXPECT_EQ(d, 3.0);
+    EXPECT_TRUE(reader.at_end());
+}
+
+TEST(PackedFields, AllEightPresent) {
+    const std::optional<std::uint32_t> v{7};
+
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put_fields(v, v, v, v, v, v, v, v);
+
+    EXPECT_EQ(buffer[0], 0xff);
+    EXPECT_EQ(buffer.size(), 1 + 8 * 4);
+}
+
+TEST(PackedFields, MissingMandatoryField) {
+    const std::optional<float> absent;
+
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put_fields(absent);
+
+    float mandatory{0};
+    PackedReader reader(buffer);
+    EXPECT_THROW(reader.get_fields(satellite_link::field("mandatory", mandatory)), PackedFormatError);
+}
+
+TEST(PackedFields, Truncated) {
+    const std::optional<float> present{2.0f};
+
+    std::vector<std::uint8_t> buffer;
+    PackedWriter(buffer).put_fields(present, present);
+    buffer.pop_back();
+
+    std::optional<float> a;
+    std::optional<float> b;
+    PackedReader reader(buffer);
+    EXPECT_THROW(reader.get_fields(satellite_link::field("a", a), satellite_link::field("b", b)), PackedFormatError);
+}
+
+TEST(Timestamp, ToMs) {
+    EXPECT_EQ(satellite_link::timestamp_to_ms("1970-01-01T00:00:00.000Z"), 0);
+    EXPECT_EQ(satellite_link::timestamp_to_ms("2026-02-11T14:03:27.412Z"), 1770818607412);
+    EXPECT_EQ(satellite_link::timestamp_to_ms("2000-02-29T23:59:59.999Z"), 951868799999);
+}
+
+TEST(Timestamp, NonCanonicalRejected) {
+    const std::vector<std::string> texts{
+        "",
+        "2026-02-11T14:03:27Z",
+        "2026-02-11T14:03:27.41Z",
+        "2026-02-11T14:03:27.412+01:00",
+        "2026-02-11T14:03:27.412z",
+        "2026-02-11 14:03:27.412Z",
+        "1969-12-31T23:59:59.999Z",
+        "2026-13-01T00:00:00.000Z",
+        "2026-04-31T00:00:00.000Z",
+        "2023-02-29T00:00:00.000Z",
+        "2100-02-29T00:00:00.000Z",
+        "2026-02-11T24:00:00.000Z",
+        "2026-02-11T14:60:00.000Z",
+        "2026-02-11T14:03:60.000Z",
+    };
+
+    for (const auto& text : texts)
+        EXPECT_FALSE(satellite_link::timestamp_to_ms(text).has_value()) << text;
+}
+
+TEST(Timestamp, RoundTrip) {
+    const std::vector<std::string> texts{
+        "1970-01-01T00:00:00.000Z", "2000-02-29T23:59:59.999Z", "2024-12-31T23:59:59.999Z",
+        "2026-02-11T14:03:27.412Z", "2100-03-01T00:00:00.001Z", "9999-12-31T23:59:59.999Z",
+    };
+
+    for (const auto& text : texts) {
+        const auto ms = satellite_link::timestamp_to_ms(text);
+
+        ASSERT_TRUE(ms.has_value()) << text;
+        EXPECT_EQ(satellite_link::ms_to_timestamp(ms.value()), text);
+    }
+}
+
+TEST(PackedTelemetry, RoundTrip) {
+    const auto buffer = pack<Telemetry>(telemetry);
+
+    EXPECT_EQ(unpack<Telemetry>(buffer), json(telemetry.get<Telemetry>()));
+    expect_truncation_rejected<Telemetry>(buffer);
+}
+
+TEST(PackedPowermeter, RoundTrip) {
+    const auto buffer = pack<Powermeter>(powermeter);
+
+    EXPECT_EQ(unpack<Powermeter>(buffer), json(powermeter.get<Powermeter>()));
+    expect_truncation_rejected<Powermeter>(buffer);
+}
+
+TEST(PackedPowermeter, NonCanonicalTimestampKept) {
+    auto value = powermeter;
+    value["timestamp"] = "2026-02-11T15:03:27.412+01:00";
+
+    const auto buffer = pack<Powermeter>(value);
+
+    EXPECT_EQ(unpack<Powermeter>(buffer).at("timestamp"), value["timestamp"]);
+}
+
+TEST(PackedPowermeter, Tail) {
+    using P = satellite_link::Packed<Powermeter>;
+
+    auto value = powermeter;
+    value["signed_meter_value"] = {
+        {"signed_meter_data", "AAECAw=="}, {"signing_method", "ECDSA-P256"}, {"encoding_method", "OCMF"}};
+
+    const auto without_tail = pack<Powermeter>(powermeter);
+    const auto with_tail = pack<Powermeter>(value);
+
+    // the flags follow the format version
+    EXPECT_EQ(PackedReader(without_tail.data() + 1, without_tail.size() - 1).get_varint() & P::TAIL, 0);
+    EXPECT_NE(PackedReader(with_tail.data() + 1, with_tail.size() - 1).get_varint() & P::TAIL, 0);
+
+    const auto decoded = unpack<Powermeter>(with_tail);
+    EXPECT_EQ(decoded, json(value.get<Powermeter>()));
+    EXPECT_TRUE(decoded.contains("signed_meter_value"));
+    expect_truncation_rejected<Powermeter>(with_tail);
+}
+
+TEST(PackedValue, UnsupportedVersion) {
+    auto buffer = pack<Powermeter>(powermeter);
+    buffer[0] = satellite_link::PACKED_FORMAT_VERSION + 1;
+
+    EXPECT_THROW(unpack<Powermeter>(buffer), PackedFormatError);
+}
+
+TEST(ForwardedValue, BothRepresentations) {
+    const auto value = powermeter.get<Powermeter>();
+
+    const auto packed = satellite_link::to_forwarded_value(value, true);
+    const auto plain = satellite_link::to_forwarded_value(value, false);
+
+    EXPECT_TRUE(packed.is_binary());
+    EXPECT_TRUE(plain.is_object());
+    EXPECT_EQ(json(satellite_link::from_forwarded_value<Powermeter>(packed)), json(value));
+    EXPECT_EQ(json(satellite_link::from_forwarded_value<Powermeter>(plain)), json(value));
+}